@@ -24,6 +24,23 @@
 #include <dmraid/reconfig.h>
 #include <dmraid/dmreg.h>
 
+/*
+ * Thread safety.
+ *
+ * All mutable library state lives in the library context, so several
+ * contexts (see libdmraid_init()) may be used by different threads of
+ * one process in parallel. A context itself must not be used by more
+ * than one thread at a time.
+ *
+ * Calls into libdevmapper, which keeps process wide state, get
+ * serialized internally. The file lock taken by lib_perform() with
+ * LOCK serializes RAID set changes of contexts across threads and
+ * processes alike.
+ *
+ * The events DSO keeps the state of each RAID set it monitors with
+ * the dmeventd registration of the set rather than in globals.
+ */
+
 /*
  * Retrieve version identifiers.
  */
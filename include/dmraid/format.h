@@ -123,12 +123,17 @@ struct dmraid_format {
 
 	/*
 	 * Group a RAID device into a set.
+	 *
+	 * Devices of different formats may be grouped in parallel,
+	 * those of one format get grouped one by one in list order.
 	 */
 	struct raid_set *(*group) (struct lib_context * lc,
 				   struct raid_dev * rd);
 
 	/*
 	 * Check consistency of the RAID set metadata.
+	 *
+	 * Different top level sets may be checked in parallel.
 	 */
 	int (*check) (struct lib_context * lc, struct raid_set * rs);
 
@@ -170,6 +175,8 @@ extern int check_raid_set(struct lib_context *lc, struct raid_set *rs,
 					  struct raid_set * rs,
 					  struct raid_dev * rd, void *context),
 			  void *f_check_context, const char *handler);
+extern void set_rd_status(struct lib_context *lc, struct raid_dev *rd,
+			  enum status status);
 extern int check_valid_format(struct lib_context *lc, char *fmt);
 extern int init_raid_set(struct lib_context *lc, struct raid_set *rs,
 			 struct raid_dev *rd, unsigned int stride,
@@ -214,6 +221,21 @@ extern void *alloc_private(struct lib_context *lc, const char *who,
 			   size_t size);
 extern void *alloc_private_and_read(struct lib_context *lc, const char *who,
 				    size_t size, char *path, loff_t offset);
+
+struct iovec;
+extern void *alloc_shared_meta(struct lib_context *lc, const char *who,
+			       size_t size, const struct iovec *key, int n);
+extern void *find_shared_meta(struct lib_context *lc, const char *who,
+			      const struct iovec *key, int n);
+extern void *shared_meta_base(struct lib_context *lc, void *ptr);
+extern size_t shared_meta_size(struct lib_context *lc, void *ptr);
+extern void *share_meta(struct lib_context *lc, const char *who, void *buf,
+			size_t size, const struct iovec *key, int n);
+extern void *view_meta(struct lib_context *lc, const char *who, void *base,
+		       size_t size, void *ptr);
+extern void free_meta(struct lib_context *lc, void *ptr);
+extern void *unshare_meta(struct lib_context *lc, struct raid_dev *rd,
+			  void *ptr, size_t size);
 extern struct raid_set *join_superset(struct lib_context *lc,
 				      char *(*f_name) (struct lib_context * lc,
 						       struct raid_dev * rd,
@@ -232,6 +254,12 @@ extern int write_metadata(struct lib_context *lc, const char *handler,
 extern int log_zero_sectors(struct lib_context *lc, char *path,
 			    const char *handler);
 
+struct meta_field;
+extern void meta_to_cpu(void *meta, const struct meta_field *f);
+extern void log_meta(struct lib_context *lc, const void *base,
+		     const void *meta, const struct meta_field *f,
+		     unsigned int idx);
+
 #define	to_disk	to_cpu
 
 #define struct_offset(s, member) ((size_t) &((struct s *) 0)->member)
@@ -257,6 +285,40 @@ extern int log_zero_sectors(struct lib_context *lc, char *path,
 #define	DP(format, basevar, x) \
 	do { P(format, basevar, x, x); } while(0)
 
+/*
+ * Ondisk metadata layout descriptors.
+ *
+ * A table of fields describes a little endian ondisk structure once.
+ * meta_to_cpu() uses it for endianess conversion and log_meta() for
+ * the native log, so that both always agree on the layout.
+ */
+enum meta_field_fmt {
+	MF_DEC,		/* "%u" */
+	MF_HEX,		/* "0x%x" */
+	MF_HEXDEC,	/* "0x%x %u" */
+	MF_STR,		/* "\"%s\"", never converted */
+	MF_NOLOG,	/* Converted but not logged */
+};
+
+struct meta_field {
+	const char *name;	/* Format string taking the element index. */
+	unsigned short offset;	/* Offset of the first element. */
+	unsigned char size;	/* Element size in bytes. */
+	unsigned char fmt;	/* enum meta_field_fmt */
+	unsigned short count;	/* Number of elements. */
+	unsigned short stride;	/* Distance between elements. */
+};
+
+#define	MF_MEMBER(s, m)	(((struct s *) 0)->m)
+#define	MF_NAMED(name, s, m, fmt) \
+	{ name, struct_offset(s, m), sizeof(MF_MEMBER(s, m)), fmt, 1, 0 }
+#define	MF(s, m, fmt)	MF_NAMED(#m, s, m, fmt)
+#define	MF_ARRAY(s, m, fmt) \
+	{ #m "[%u]", struct_offset(s, m), sizeof(MF_MEMBER(s, m)[0]), fmt, \
+	  sizeof(MF_MEMBER(s, m)) / sizeof(MF_MEMBER(s, m)[0]), \
+	  sizeof(MF_MEMBER(s, m)[0]) }
+#define	MF_END		{ NULL, 0, 0, 0, 0, 0 }
+
 /*
  * RAID device, set and vendor metadata retrieval macros.
  */
@@ -21,6 +21,9 @@ enum lc_lists {
 	LC_RAID_DEVS,		/* Raid devices discovered. */
 	LC_RAID_SETS,		/* Raid sets grouped. */
 	/* Add new lists below here ! */
+	LC_SHARED_META,		/* Metadata shared by raid devices. */
+	LC_QUEUED_WRITES,	/* Metadata writes to flush. */
+	LC_DEFERRED_SORTS,	/* Lists to sort after grouping. */
 	LC_LISTS_SIZE,		/* Must be the last enumerator. */
 };
 
@@ -29,6 +32,9 @@ enum lc_lists {
 #define	LC_DI(lc)	(lc_list((lc), LC_DISK_INFOS))
 #define	LC_RD(lc)	(lc_list((lc), LC_RAID_DEVS))
 #define	LC_RS(lc)	(lc_list((lc), LC_RAID_SETS))
+#define	LC_SHARED(lc)	(lc_list((lc), LC_SHARED_META))
+#define	LC_WRITES(lc)	(lc_list((lc), LC_QUEUED_WRITES))
+#define	LC_SORTS(lc)	(lc_list((lc), LC_DEFERRED_SORTS))
 
 enum lc_options {
 	LC_COLUMN = 0,
@@ -48,6 +54,7 @@ enum lc_options {
 	LC_REBUILD_DISK,
 	LC_HOT_SPARE_SET,
 	LC_IGNOREMONITORING,	/* Add new options below this one ! */
+	LC_ERASE_CONFIRMED,
 	LC_OPTIONS_SIZE,	/* Must be the last enumerator. */
 };
 
@@ -58,6 +65,7 @@ enum lc_options {
 #define	OPT_DEBUG(lc)		(lc_opt(lc, LC_DEBUG))
 #define	OPT_DEVICES(lc)		(lc_opt(lc, LC_DEVICES))
 #define	OPT_DUMP(lc)		(lc_opt(lc, LC_DUMP))
+#define	OPT_ERASE_CONFIRMED(lc)	(lc_opt(lc, LC_ERASE_CONFIRMED))
 #define	OPT_FORMAT(lc)		(lc_opt(lc, LC_FORMAT))
 #define	OPT_GROUP(lc)		(lc_opt(lc, LC_GROUP))
 #define OPT_HOT_SPARE_SET(lc)	(lc_opt(lc, LC_HOT_SPARE_SET))
@@ -102,6 +110,7 @@ struct lib_options {
 struct lib_context {
 	struct lib_version version;
 	char *cmd;
+	int dso;		/* Called from the events DSO. */
 
 	/* Option counters used throughout the library. */
 	struct lib_options options[LC_OPTIONS_SIZE];
@@ -116,10 +125,30 @@ struct lib_context {
 	 */
 	struct list_head lists[LC_LISTS_SIZE];
 
+	/* Hash chains of RAID sets by name (see find_set()). */
+#define	SET_INDEX_SIZE	512
+	struct list_head set_index[SET_INDEX_SIZE];
+
+	/* Hash chains of discovered devices (see find_disk()). */
+#define	DISK_INDEX_SIZE	256
+	struct list_head disk_index[DISK_INDEX_SIZE];
+
+	/* Hash chains of shared metadata images by address (see format.c). */
+#define	META_INDEX_SIZE	256
+	struct list_head meta_index[META_INDEX_SIZE];
+
 	char *locking_name;	/* Locking mechanism selector. */
 	struct locking *lock;	/* Resource locking. */
+	int lock_fd;		/* File locking descriptor. */
 
 	mode_t mode;		/* File/directrory create modes. */
+	unsigned int write_queue;	/* queue_writes() nesting depth. */
+	int write_cancel;	/* cancel_writes() called while nested. */
+	unsigned int sort_defer;	/* defer_sorts() nesting depth. */
+	struct list_head *sort_index;	/* Hash chains of LC_SORTS. */
+	struct arena *arena;	/* Objects living as long as the context. */
+	unsigned int geometry_gen;	/* See invalidate_geometry(). */
+	struct set_workers *workers;	/* Grouping/checking workers running. */
 
 	struct {
 		const char *error;	/* For error mappings. */
@@ -13,6 +13,7 @@
 
 #include <dmraid/list.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 /*
  * Unified RAID set types.
@@ -114,12 +115,22 @@ enum find {
 };
 
 /* Device information. */
+enum disk_index {
+	DI_PATH = 0,		/* Device node path. */
+	DI_NAME,		/* Basename of the path. */
+	DI_DEV,			/* Device number. */
+	DI_INDEXES,		/* Must be the last enumerator. */
+};
+
 struct dev_info {
 	struct list_head list;	/* Global chain of discovered devices. */
+	struct list_head index[DI_INDEXES];	/* Hash chains of the index. */
 
 	char *path;		/* Actual device node path. */
 	char *serial;		/* ATA/SCSI serial number. */
 	uint64_t sectors;	/* Device size. */
+	dev_t dev;		/* Device number or 0. */
+	unsigned int wanted;	/* Named on the command line. */
 };
 
 /* Metadata areas and size stored on a RAID device. */
@@ -127,6 +138,7 @@ struct meta_areas {
 	uint64_t offset;	/* on disk metadata offset in sectors. */
 	size_t size;		/* on disk metadata size in bytes. */
 	void *area;		/* pointer to format specific metadata. */
+	int anchor;		/* Others are found by it (see write_metadata()). */
 };
 
 /*
@@ -138,6 +150,7 @@ struct meta_areas {
 struct raid_dev {
 	struct list_head list;	/* Global chain of RAID devices. */
 	struct list_head devs;	/* Chain of devices belonging to set. */
+	struct raid_set *owner;	/* Set the devs chain belongs to. */
 
 	char *name;		/* Metadata format handler generated
 				   name of set this device belongs to. */
@@ -182,8 +195,25 @@ enum flags {
 #define	F_MAXIMIZE(rs)		((rs)->flags & f_maximize)
 #define	F_PARTITIONS(rs)	((rs)->flags & f_partitions)
 
+/*
+ * Status counters of the members of a set.
+ *
+ * Subsets count as operational when ok or inconsistent, devices
+ * by their status. Members not counted in any of these are broken.
+ */
+struct set_members {
+	unsigned int gen;	/* lc->geometry_gen counted in. */
+	enum type type;		/* Set type counted for. */
+	unsigned int total;	/* Subsets and devices. */
+	unsigned int operational;
+	unsigned int inconsistent;
+	unsigned int nosync;
+	unsigned int raid1001;	/* RAID10/01 subsets. */
+};
+
 struct raid_set {
 	struct list_head list;	/* Chain of independent sets. */
+	struct raid_set *parent;	/* Superset or NULL at the top. */
 
 	/*
 	 * List of subsets (eg, RAID10) which make up RAID set stacks.
@@ -205,12 +235,17 @@ struct raid_set {
 	unsigned int found_devs;	/* The number of devices found */
 
 	char *name;		/* Name of the set. */
+	struct list_head index;	/* Chain of the set name index. */
+	unsigned int level;	/* Level in the set hierarchy (1 = top). */
 
 	uint64_t size;		/* size of a raid set */
 	unsigned int stride;	/* Stride size. */
 	enum type type;		/* Unified raid type. */
 	enum flags flags;	/* Set flags. */
 	enum status status;	/* Status of set. */
+
+	struct set_geometry *geometry;	/* Cached size and members. */
+	struct set_members members;	/* See set_rd_status(). */
 };
 
 extern struct raid_set *get_raid_set(struct lib_context *lc,
@@ -221,6 +256,12 @@ extern const char *get_dm_type(struct lib_context *lc, enum type type);
 extern const char *get_set_type(struct lib_context *lc, void *rs);
 extern const char *get_status(struct lib_context *lc, enum status status);
 extern uint64_t total_sectors(struct lib_context *lc, struct raid_set *rs);
+extern uint64_t smallest_member(struct lib_context *lc, struct raid_set *rs,
+				uint64_t min);
+extern unsigned int count_members(struct lib_context *lc, struct raid_set *rs,
+				  uint64_t min);
+extern void invalidate_geometry(struct lib_context *lc);
+extern unsigned int geometry_gen(struct lib_context *lc);
 extern struct dev_info *alloc_dev_info(struct lib_context *lc, char *path);
 extern void free_dev_info(struct lib_context *lc, struct dev_info *di);
 extern struct raid_dev *alloc_raid_dev(struct lib_context *lc, const char *who);
@@ -229,15 +270,38 @@ extern void list_add_sorted(struct lib_context *lc,
 			    struct list_head *to, struct list_head *new,
 			    int (*sort) (struct list_head * pos,
 					 struct list_head * new));
+extern void list_add_deferred(struct lib_context *lc,
+			      struct list_head *to, struct list_head *new,
+			      int (*sort) (struct list_head * pos,
+					   struct list_head * new));
+extern void defer_sorts(struct lib_context *lc);
+extern void flush_sorts(struct lib_context *lc);
 extern struct raid_set *alloc_raid_set(struct lib_context *lc, const char *who);
 extern unsigned int count_sets(struct lib_context *lc, struct list_head *list);
 extern unsigned int count_devs(struct lib_context *lc, struct raid_set *rs,
 			       enum count_type type);
 extern void free_raid_set(struct lib_context *lc, struct raid_set *rs);
+extern void link_dev_info(struct lib_context *lc, struct dev_info *di);
 extern struct dev_info *find_disk(struct lib_context *lc, const char *dp);
+extern struct dev_info *find_disk_by_dev(struct lib_context *lc, dev_t dev);
 extern struct raid_set *find_set(struct lib_context *lc,
 				 struct list_head *list, const char *name,
 				 enum find where);
+extern void rename_raid_set(struct lib_context *lc, struct raid_set *rs,
+			    char *name);
+extern void link_raid_set(struct lib_context *lc, struct raid_set *rs,
+			  struct list_head *list,
+			  int (*f_sort) (struct list_head * pos,
+					 struct list_head * new));
+extern void link_raid_dev(struct lib_context *lc, struct raid_set *rs,
+			  struct raid_dev *rd,
+			  int (*f_sort) (struct list_head * pos,
+					 struct list_head * new));
+extern void link_raid_dev_deferred(struct lib_context *lc,
+				   struct raid_set *rs, struct raid_dev *rd,
+				   int (*f_sort) (struct list_head * pos,
+						  struct list_head * new));
+extern void unlink_raid_dev(struct lib_context *lc, struct raid_dev *rd);
 extern struct raid_set *find_or_alloc_raid_set(struct lib_context *lc,
 					       char *name, enum find where,
 					       struct raid_dev *rd,
@@ -266,6 +330,8 @@ extern int partitioned_set(struct lib_context *lc, void *rs);
 extern int base_partitioned_set(struct lib_context *lc, void *rs);
 extern void discover_raid_devices(struct lib_context *lc, char **devices);
 extern void discover_partitions(struct lib_context *lc);
+extern void lock_sets(struct lib_context *lc);
+extern void unlock_sets(struct lib_context *lc);
 extern int dso_get_members(struct lib_context *lc, int arg);
 extern unsigned int count_devices(struct lib_context *lc, enum dev_type type);
 extern enum status rd_status(struct states *states, unsigned int status,
@@ -19,6 +19,14 @@
 extern struct lib_context *libdmraid_init(int argc, char **argv);
 extern void libdmraid_exit(struct lib_context *lc);
 
+/*
+ * Rescan a single device which appeared, changed or vanished, given
+ * by path or by device number (path = NULL), regrouping and checking
+ * just the RAID sets it is a member of.
+ */
+extern int libdmraid_rescan_device(struct lib_context *lc, const char *path,
+				   dev_t dev);
+
 extern void sysfs_workaround(struct lib_context *lc);
 extern void mk_alpha(struct lib_context *lc, char *str, size_t len);
 extern void mk_alphanum(struct lib_context *lc, char *str, size_t len);
@@ -36,9 +44,35 @@ extern int read_file(struct lib_context *lc, const char *who, char *path,
 		     void *buffer, size_t size, loff_t offset);
 extern int write_file(struct lib_context *lc, const char *who, char *path,
 		      void *buffer, size_t size, loff_t offset);
+extern int write_file_body(struct lib_context *lc, const char *who,
+			   char *path, void *buffer, size_t size,
+			   loff_t offset);
+struct iovec;
+extern int read_file_vec(struct lib_context *lc, const char *who, char *path,
+			 struct iovec *iov, int iovcnt, loff_t offset);
+
+/*
+ * Order queued writes get flushed in: metadata gets written
+ * before the anchor referring to it and erased after it.
+ */
+enum write_phase {
+	WRITE_FIRST,
+	WRITE_LAST,
+};
+
+extern int erase_file(struct lib_context *lc, const char *who, char *path,
+		      size_t size, loff_t offset, enum write_phase phase);
+extern void queue_writes(struct lib_context *lc);
+extern int flush_writes(struct lib_context *lc);
+extern int cancel_writes(struct lib_context *lc);
 
 extern int yes_no_prompt(struct lib_context *lc, const char *prompt, ...);
 
+extern uint32_t sum8(const void *buf, size_t n);
+extern uint16_t sum16(const void *buf, size_t n);
+extern uint32_t sum32(const void *buf, size_t n);
+extern uint32_t crc32_ieee(uint32_t crc, const void *buf, size_t len);
+
 extern void free_string(struct lib_context *lc, char **string);
 extern int p_fmt(struct lib_context *lc, char **string, const char *fmt, ...);
 
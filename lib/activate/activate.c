@@ -36,13 +36,6 @@ valid_rs(struct raid_set *rs)
 		S_NOSYNC(rs->status)) && !T_SPARE(rs);
 }
 
-/* Return rounded size in case of unbalanced mappings */
-static uint64_t
-maximize(struct raid_set *rs, uint64_t sectors, uint64_t last, uint64_t min)
-{
-	return sectors > min ? min(last, sectors) : last;
-}
-
 /* Find biggest device */
 static uint64_t
 _biggest(struct raid_set *rs)
@@ -58,25 +51,6 @@ _biggest(struct raid_set *rs)
 	return ret;
 }
 
-/* Find smallest set/disk larger than given minimum. */
-static uint64_t
-_smallest(struct lib_context *lc, struct raid_set *rs, uint64_t min)
-{
-	uint64_t ret = ~0;
-	struct raid_set *r;
-	struct raid_dev *rd;
-
-	list_for_each_entry(r, &rs->sets, list)
-		ret = maximize(r, total_sectors(lc, r), ret, min);
-
-	list_for_each_entry(rd, &rs->devs, devs) {
-		if (!T_SPARE(rd))
-			ret = maximize(rs, rd->sectors, ret, min);
-	}
-
-	return ret == (uint64_t) ~0 ? 0 : ret;
-}
-
 /*
  * Definitions of mappings.
  */
@@ -269,41 +243,18 @@ _dm_raid0_eol(struct lib_context *lc,
 	return 0;
 }
 
-/* Count RAID sets/devices larger than given minimum size. */
-static unsigned int
-_dm_raid_devs(struct lib_context *lc, struct raid_set *rs, uint64_t min)
-{
-	unsigned int ret = 0;
-	struct raid_set *r;
-	struct raid_dev *rd;
-
-	/* Stacked sets. */
-	list_for_each_entry(r, &rs->sets, list) {
-		if (!T_SPARE(r) && total_sectors(lc, r) > min)
-			ret++;
-	}
-
-	list_for_each_entry(rd, &rs->devs, devs) {
-		if (!T_SPARE(rd) && rd->sectors > min)
-			ret++;
-	}
-
-	return ret;
-}
-
 static int
 dm_raid0(struct lib_context *lc, char **table, struct raid_set *rs)
 {
 	unsigned int stripes = 0;
 	uint64_t min, last_min = 0;
 
-	for (; (min = _smallest(lc, rs, last_min)); last_min = min) {
+	for (; (min = smallest_member(lc, rs, last_min)); last_min = min) {
 		if (last_min && !p_fmt(lc, table, "\n"))
 			goto err;
 
 		if (!_dm_raid0_bol(lc, table, round_down(min, rs->stride),
-				   last_min, _dm_raid_devs(lc, rs,
-							   last_min),
+				   last_min, count_members(lc, rs, last_min),
 				   rs->stride)
 		    || !_dm_raid0_eol(lc, table, rs, &stripes, last_min))
 			goto err;
@@ -450,7 +401,7 @@ dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs)
 		return dm_linear(lc, table, rs);
 	}
 
-	if (!(sectors = _smallest(lc, rs, 0)))
+	if (!(sectors = smallest_member(lc, rs, 0)))
 		LOG_ERR(lc, 0, "can't find smallest mirror!");
 
 	/*
@@ -553,7 +504,7 @@ _dm_raid45_bol(struct lib_context *lc, char **table, struct raid_set *rs,
 		     sectors, get_dm_type(lc, rs->type),
 		     calc_region_size(lc,
 				      total_sectors(lc, rs) /
-				      _dm_raid_devs(lc, rs, 0)),
+				      count_members(lc, rs, 0)),
 		     (need_sync) ? "sync" : "nosync", get_type(lc, rs->type),
 		     rs->stride, members, rebuild_drive.data.i32);
 }
@@ -661,6 +612,8 @@ static struct raid_dev *add_rd_dummy(struct lib_context *lc,
 		memcpy(rd->meta_areas->area, rd_ref->meta_areas->area, area_size);
 	
 		list_add_tail(&rd->devs, rd_list);
+		rd->owner = rd_ref->owner;
+		invalidate_geometry(lc);
 	}
 
 	return rd;
@@ -738,7 +691,7 @@ dm_raid45(struct lib_context *lc, char **table, struct raid_set *rs)
 		}
 	}
     
-	if (!(sectors = _smallest(lc, rs, 0)))
+	if (!(sectors = smallest_member(lc, rs, 0)))
 		LOG_ERR(lc, 0, "can't find smallest RAID4/5 member!");
 
 	/* Adjust sectors with chunk size: only whole chunks count. */
@@ -14,6 +14,9 @@
 
 #include <libdevmapper.h>
 
+#ifndef __KLIBC__
+#include <pthread.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,14 +51,40 @@ dmraid_log(int level, const char *file, int line, const char *f, ...)
 	return;
 }
 
+/*
+ * libdevmapper keeps process wide state (log function, control
+ * descriptor), so tasks of all library contexts get serialized.
+ *
+ * dm_lib_exit() is left to libdevmapper's destructor, because
+ * tearing the library down per task would pull it away from
+ * tasks of other contexts.
+ *
+ * klibc lacks pthreads, hence there's no concurrent tasks to serialize.
+ */
+#ifndef __KLIBC__
+static pthread_once_t dm_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t dm_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+_log_init_dm(void)
+{
+	dm_log_init(dmraid_log);
+}
+
 /* Init device-mapper library. */
 static void
 _init_dm(void)
 {
-	dm_log_init(dmraid_log);
+#ifndef __KLIBC__
+	pthread_once(&dm_once, _log_init_dm);
+	pthread_mutex_lock(&dm_lock);
+#else
+	_log_init_dm();
+#endif
 }
 
-/* Cleanup at exit. */
+/* Cleanup after a task. */
 static void
 _exit_dm(struct dm_task *dmt)
 {
@@ -63,7 +92,9 @@ _exit_dm(struct dm_task *dmt)
 		dm_task_destroy(dmt);
 
 	dm_lib_release();
-	dm_lib_exit();
+#ifndef __KLIBC__
+	pthread_mutex_unlock(&dm_lock);
+#endif
 }
 
 /*
@@ -157,7 +188,12 @@ parse_table(struct lib_context *lc, struct dm_task *dmt, char *table)
 static int
 check_table(struct lib_context *lc, char *table)
 {
-	return handle_table(lc, NULL, table, get_target_list());
+	int ret;
+
+	_init_dm();
+	ret = handle_table(lc, NULL, table, get_target_list());
+	_exit_dm(NULL);
+	return ret;
 }
 
 /* Build a UUID for a dmraid device 
@@ -288,6 +324,71 @@ dm_status(struct lib_context *lc, struct raid_set *rs)
 	return ret;
 }
 
+/* qsort()/bsearch() name comparison. */
+static int
+cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Retrieve the names of all mapped devices with one list request
+ * as a sorted array of *count names to be freed with dbg_free().
+ */
+char **
+dm_names(struct lib_context *lc, unsigned int *count)
+{
+	unsigned int i = 0, n = 0, next;
+	size_t len = 0;
+	char **ret = NULL, *p;
+	struct dm_task *dmt;
+	struct dm_names *names, *nm;
+
+	_init_dm();
+
+	if (!(dmt = dm_task_create(DM_DEVICE_LIST)) ||
+	    !dm_task_run(dmt) ||
+	    !(names = dm_task_get_names(dmt)))
+		goto out;
+
+	/* Size the array and the strings to allocate them in one go. */
+	if (names->dev) {
+		nm = names;
+		do {
+			n++;
+			len += strlen(nm->name) + 1;
+			next = nm->next;
+			nm = (void *) nm + next;
+		} while (next);
+	}
+
+	if (!(ret = dbg_malloc(n * sizeof(*ret) + len + 1))) {
+		log_alloc_err(lc, __func__);
+		goto out;
+	}
+
+	for (p = (char *) (ret + n), nm = names; i < n; i++) {
+		ret[i] = strcpy(p, nm->name);
+		p += strlen(p) + 1;
+		nm = (void *) nm + nm->next;
+	}
+
+	qsort(ret, n, sizeof(*ret), cmp_names);
+	*count = n;
+
+out:
+	_exit_dm(dmt);
+	return ret;
+}
+
+/* Check if a mapped device is on a list retrieved by dm_names(). */
+int
+dm_listed(char **names, unsigned int count, const char *name)
+{
+	return bsearch(&name, names, count, sizeof(*names),
+		       cmp_names) ? 1 : 0;
+}
+
 /* Retrieve device-mapper driver version. */
 int
 dm_version(struct lib_context *lc, char *version, size_t size)
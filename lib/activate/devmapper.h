@@ -12,6 +12,8 @@ char *mkdm_path(struct lib_context *lc, const char *name);
 int dm_create(struct lib_context *lc, struct raid_set *rs, char *table, char *name);
 int dm_remove(struct lib_context *lc, struct raid_set *rs, char *name);
 int dm_status(struct lib_context *lc, struct raid_set *rs);
+char **dm_names(struct lib_context *lc, unsigned int *count);
+int dm_listed(char **names, unsigned int count, const char *name);
 int dm_version(struct lib_context *lc, char *version, size_t size);
 int dm_suspend(struct lib_context *lc, struct raid_set *rs);
 int dm_resume(struct lib_context *lc, struct raid_set *rs);
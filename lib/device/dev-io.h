@@ -14,10 +14,16 @@
 
 #define BLKGETSIZE	_IO(0x12, 0x60) /* get block device size */
 #define BLKSSZGET	_IO(0x12, 0x68) /* get block device sector size */
+#define BLKZEROOUT	_IO(0x12, 0x7f) /* zero out a block device range */
+#ifndef BLKFLSBUF
+#define BLKFLSBUF	_IO(0x12, 0x61) /* flush buffer cache */
+#endif
 
 #define	DMRAID_SECTOR_SIZE	512
 
 int discover_devices(struct lib_context *lc, char **devnodes);
+int discover_device(struct lib_context *lc, const char *name);
+char *devno_name(struct lib_context *lc, dev_t dev);
 int removable_device(struct lib_context *lc, char *dev_path);
 int remove_device_partitions(struct lib_context *lc, void *rs, int dummy);
 
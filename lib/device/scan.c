@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <linux/hdreg.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include "internal.h"
 #include "ata.h"
 #include "scsi.h"
@@ -36,9 +37,9 @@ static char *
 find_sysfs_mp(struct lib_context *lc)
 {
 #ifndef __KLIBC__
-	char *ret = NULL;
+	char *ret = NULL, buf[BUFSIZ];
 	FILE *mfile;
-	struct mntent *ment;
+	struct mntent m, *ment;
 
 	/* Try /proc/mounts first and failback to /etc/mtab. */
 	if (!(mfile = setmntent(_PATH_MOUNTS, "r"))) {
@@ -47,9 +48,11 @@ find_sysfs_mp(struct lib_context *lc)
 				_PATH_MOUNTS, _PATH_MOUNTED);
 	}
 
-	while ((ment = getmntent(mfile))) {
+	while ((ment = getmntent_r(mfile, &m, buf, sizeof(buf)))) {
 		if (!strcmp(ment->mnt_type, "sysfs")) {
-			ret = ment->mnt_dir;
+			if (!(ret = dbg_strdup(ment->mnt_dir)))
+				log_alloc_err(lc, __func__);
+
 			break;
 		}
 	};
@@ -58,7 +61,7 @@ find_sysfs_mp(struct lib_context *lc)
 
 	return ret;
 #else
-	return (char *) "/sys";
+	return dbg_strdup("/sys");
 #endif
 }
 
@@ -66,7 +69,7 @@ find_sysfs_mp(struct lib_context *lc)
 static char *
 mk_sysfs_path(struct lib_context *lc, char const *path)
 {
-	static char *ret = NULL, *sysfs_mp;
+	char *ret, *sysfs_mp;
 
 	if (!(sysfs_mp = find_sysfs_mp(lc)))
 		LOG_ERR(lc, NULL, "finding sysfs mount point");
@@ -76,6 +79,7 @@ mk_sysfs_path(struct lib_context *lc, char const *path)
 	else
 		log_alloc_err(lc, __func__);
 
+	dbg_free(sysfs_mp);
 	return ret;
 }
 
@@ -268,6 +272,7 @@ get_size(struct lib_context *lc, const char *path, char *name, int sysfs)
 	int fd, ret = 0;
 	char *dev_path;
 	struct dev_info *di = NULL;
+	struct stat st;
 
 	if (!(dev_path = dbg_malloc(strlen(_PATH_DEV) + strlen(name) + 1)))
 		return log_alloc_err(lc, __func__);
@@ -278,14 +283,23 @@ get_size(struct lib_context *lc, const char *path, char *name, int sysfs)
 		goto out;
 	}
 
+	/* Device named more than once. */
+	if (find_disk(lc, dev_path)) {
+		ret = 1;
+		goto out;
+	}
+
 	if (removable_device(lc, dev_path) ||
 	    !(di = alloc_dev_info(lc, dev_path)) ||
 	    (sysfs && !sysfs_get_size(lc, di, path, name)) ||
 	    (fd = open(dev_path, O_RDONLY)) == -1)
 		goto out;
 
+	if (!fstat(fd, &st) && S_ISBLK(st.st_mode))
+		di->dev = st.st_rdev;
+
 	if (di_ioctl(lc, fd, di)) {
-		list_add(&di->list, LC_DI(lc));
+		link_dev_info(lc, di);
 		ret = 1;
 	}
 
@@ -345,3 +359,54 @@ out:
 
 	return ret;
 }
+
+/*
+ * Discover a single disk device by name (eg, "sda")
+ * rather than scanning all of them.
+ */
+int
+discover_device(struct lib_context *lc, const char *name)
+{
+	int ret;
+	char *p, *n;
+
+	if (!(n = dbg_strdup(name)))
+		return log_alloc_err(lc, __func__);
+
+	if ((p = mk_sysfs_path(lc, BLOCK))) {
+		ret = get_size(lc, p, n, 1);
+		dbg_free(p);
+	} else
+		ret = get_size(lc, _PATH_DEV, n, 0);
+
+	dbg_free(n);
+	return ret;
+}
+
+/* Return the name of a block device by number from sysfs. */
+#define	DEV_BLOCK	"/dev/block"
+char *
+devno_name(struct lib_context *lc, dev_t dev)
+{
+	ssize_t len = -1;
+	char *ret, *sysfs_path, file[PATH_MAX], link[PATH_MAX];
+
+	if (!(sysfs_path = mk_sysfs_path(lc, DEV_BLOCK)))
+		return NULL;
+
+	/* <sysfs>/dev/block/<major>:<minor> links to the device directory. */
+	if (snprintf(file, sizeof(file), "%s/%u:%u", sysfs_path,
+		     major(dev), minor(dev)) < sizeof(file))
+		len = readlink(file, link, sizeof(link) - 1);
+
+	dbg_free(sysfs_path);
+	if (len < 0)
+		LOG_ERR(lc, NULL, "no device %u:%u in sysfs",
+			major(dev), minor(dev));
+
+	link[len] = 0;
+	if (!(ret = dbg_strdup(get_basename(lc, link))))
+		log_alloc_err(lc, __func__);
+
+	return ret;
+}
@@ -121,50 +121,44 @@ struct dso_raid_dev {
 	int active;			/* Device active if != 0. */
 };
 
-/* Used to store all the registered RAID sets against this DSO
+/* Used to store a RAID set registered against this DSO.
  * This will allow for reporting robust information for when a drive
  * within a RAID set is exhibiting problems. 
+ *
+ * dmeventd hands it back to process_event() and unregister_device()
+ * in their private pointer argument, so the DSO keeps no global state.
  */
 #define	RS_IN_USE	1 /* RAID set structure in use flag. */
 struct dso_raid_set {
 	pthread_mutex_t event_mutex; /* Event processing serialization. */
-	struct dso_raid_set *next;   /* next RAID set registered against DSO. */
 	char *name;		     /* RAID set name. */
 	int num_devs;	 	     /* Number of devices in RAID set. */
 	int max_devs;	 	     /* Number of devices allocated. */
 	unsigned long flags;	     /* Used as lock if RS_IN_USE bit set. */
+	int sgpio;		     /* sgpio app available at registration. */
 
 	/* Do not declare anything below this structure. */
 	struct dso_raid_dev devs[0];
 };
 
-static struct dso_raid_set *raid_sets = NULL;
-
-/*
- * register_device() is called first and performs initialisation.
- * Only one device may be registered or unregistered at a time.
- */
-static pthread_mutex_t _register_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-/* Is sgpio app available? */
-static int _issgpio = 0;
-
 /* Check for availibility of sgpio tool. */
 /* FIXME: what's the use of this when admin removes sgpio? */
-static void _check_sgpio(void)
+static int _check_sgpio(void)
 {
+	int ret = 0;
 	char sgpio_path[50];
 	FILE *fd = popen("which sgpio", "r");
 
 	if (fd) {
 		if (fscanf(fd, "%s", sgpio_path) == 1) {
-			_issgpio = 1;
+			ret = 1;
 			syslog(LOG_ALERT, "SGPIO handling enabled");
 		}
 
 		fclose(fd);
-	} else
-		_issgpio = 0;
+	}
+
+	return ret;
 }
 
 /*
@@ -174,14 +168,14 @@ static void _check_sgpio(void)
  * FIXME: run in seperate thread to prevent blocking main
  *	  dmeventd thread or use sgpio library functions.
  */
-static int _dev_led_one(enum led_ctrl_type status, const char type,
-			struct dso_raid_dev *dev)
+static int _dev_led_one(struct dso_raid_set *rs, enum led_ctrl_type status,
+			const char type, struct dso_raid_dev *dev)
 {
 	int ret, sz;
 	char com[100];
 	static const char *led_ctrl[] = { "off", "fault", "rebuild" };
 
-	if (!_issgpio ||
+	if (!rs->sgpio ||
 	    dev->port < 0)
 		return 0;
 
@@ -210,7 +204,7 @@ static int _dev_led_all(enum led_ctrl_type status, struct dso_raid_set *rs)
 	struct dso_raid_dev *dev;
 
 	for (dev = rs->devs, i = 0; i < rs->num_devs; dev++, i++) {
-		r = _dev_led_one(status, SGPIO_DISK, dev);
+		r = _dev_led_one(rs, status, SGPIO_DISK, dev);
 		if (r && !ret)
 			ret = r;
 	}
@@ -254,32 +248,6 @@ struct prepost prepost[] = {
 
 };
 
-/*
- * Find entry in global RAID set list by @dev_name.
- *
- * Optionally return reference to previous set in @prev.
- */
-static struct dso_raid_set *_find_raid_set(const char *dev_name,
-					  struct dso_raid_set **prev,
-					  int log)
-{
-	struct dso_raid_set *rs = raid_sets;
-
-	if (prev)
-		*prev = rs;
-
-	for ( ; rs && strcmp(rs->name, dev_name); rs = rs->next) {
-		if (prev)
-			*prev = rs;
-	}
-
-	if (!rs && log)
-		syslog(LOG_ERR, "Can't find RAID set for device \"%s\"",
-		       dev_name);
-
-	return rs;
-}
-
 /* Initialize a DSO RAID device structure. */
 static void _dso_dev_init(struct dso_raid_dev *dev)
 {
@@ -333,8 +301,8 @@ static struct dso_raid_set *_init_raid_set(struct dso_raid_set *rs,
 	}
 
 	pthread_mutex_init(&rs->event_mutex, NULL);
-	rs->next = NULL;
 	rs->flags = 0;
+	rs->sgpio = 0;
 	rs->max_devs = rs->num_devs = 0;
 	return rs;
 }
@@ -373,30 +341,6 @@ static struct dso_raid_set *_inc_raid_set(struct dso_raid_set *rs,
 	return rs;
 }
 
-/* Link to global RAID set list. */
-static void _add_raid_set(struct dso_raid_set *rs)
-{
-	/* Link to global RAID set list. */
-	if (raid_sets) {
-		struct dso_raid_set *prev;
-
-		/* Return last RAID set in @prev. */
-		_find_raid_set(" ", &prev, 0);
-		prev->next = rs;
-	} else
-		raid_sets = rs;
-}
-
-/* Delete from global RAID set list. */
-static void _del_raid_set(struct dso_raid_set *rs, struct dso_raid_set *prev)
-{
-	/* Unlink RAID set from global list. */
-	if (rs == raid_sets) /* Remove head node. */
-		raid_sets = rs->next;
-	else		    /* Remove n+1 node. */
-		prev->next = rs->next;
-}
-
 /* Check if device in @path is active and adjust @dev. */
 /* FIXME: straighten this by using libsysfs ? */
 static void _check_raid_dev_active(const char *dev_name,
@@ -634,23 +578,19 @@ out:
 }
 
 /*
- * Add new devices and their properties to RAID set @rs_name for @dev_name.
+ * Add new devices and their properties to RAID set @rs for @dev_name.
  *
  * Return 0 for failure, 1 for success.
  */
-static int _repopulate(const char *rs_name, char *dev_names)
+static int _repopulate(struct dso_raid_set *rs, char *dev_names)
 {
 	int r, ret = 0;
-	char *dev_name;
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
+	char *dev_name, *save;
 	struct dso_raid_dev *dev;
 
-	if (!rs)
-		return 0;
-
 	/* Parse device name from string of names. */
-	while ((dev_name = strtok(dev_names, " "))) {
-		dev_names = NULL; /* Prepare for strtok() iteration. */
+	while ((dev_name = strtok_r(dev_names, " ", &save))) {
+		dev_names = NULL; /* Prepare for strtok_r() iteration. */
 		dev_name = basename(dev_name); /* No dir upfront. */
 
 		/* Check, if RAID device already in RAID set. */
@@ -685,7 +625,7 @@ static int _repopulate(const char *rs_name, char *dev_names)
 }
 
 /* DSO main function. */
-static int _lib_main(char op, const char *device)
+static int _lib_main(struct dso_raid_set *rs, char op, const char *device)
 {
 	int lib_argc = 3, ret = 0;
 	char op_str[] = { op, '\0' },
@@ -716,7 +656,7 @@ static int _lib_main(char op, const char *device)
 
 			if (!ret &&
 			    action == GET_MEMBERS) 
-				ret = _repopulate(device, (char *)OPT_STR(lc, LC_REBUILD_SET));
+				ret = _repopulate(rs, (char *)OPT_STR(lc, LC_REBUILD_SET));
 		}
 
 		libdmraid_exit(lc);
@@ -734,17 +674,12 @@ static int _lib_main(char op, const char *device)
  *
  * Return 1 for failure, 0 for success.
  */
-static int _log_event(struct dm_task *dmt,
+static int _log_event(struct dso_raid_set *rs, struct dm_task *dmt,
 		     const char *major_minor, const char *type)
 {
-	const char *dev_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(dev_name, NULL, 1);
 	struct dso_raid_dev *dev;
 	struct dm_info dev_info;
 
-	if (!rs)
-		return 1;
-
 	/* Match up the major:minor to RAID devices. */
 	dev = _find_dso_dev(rs, BY_NUM, major_minor);
 	if (dev) {
@@ -997,19 +932,16 @@ static struct dso_raid_set *_create_raid_set(const char *rs_name,
 }
 
 /* Function calls dmraid to start and finish RAID rebuild. */
-static int _rebuild(enum rebuild_type rebuild_type, const char *dev_name)
+static int _rebuild(struct dso_raid_set *rs, enum rebuild_type rebuild_type)
 {
 	int ret = 0;
-	struct dso_raid_set *rs = _find_raid_set(dev_name, NULL, 1);
-
-	if (!rs)
-		return 0;
+	const char *dev_name = rs->name;
 
 	switch (rebuild_type) {
 	case REBUILD_START:
-		if (!_lib_main('R', dev_name)) {
+		if (!_lib_main(rs, 'R', dev_name)) {
 			syslog(LOG_INFO, "Rebuild started");
-			_lib_main('r', dev_name);
+			_lib_main(rs, 'r', dev_name);
 
 			/* Turn all LEDs to rebuild state. */
 			_dev_led_all(DSO_LED_REBUILD, rs);
@@ -1020,8 +952,8 @@ static int _rebuild(enum rebuild_type rebuild_type, const char *dev_name)
 		break;
 
 	case REBUILD_END:
-		if (!_lib_main('F', dev_name) ||
-		    !_lib_main('r', dev_name))
+		if (!_lib_main(rs, 'F', dev_name) ||
+		    !_lib_main(rs, 'r', dev_name))
 			syslog(LOG_NOTICE, "Rebuild of RAID set %s complete",
 					dev_name);
 			
@@ -1051,18 +983,14 @@ static int _get_num_devs(char *params, char **p)
 }
 
 /* Get the stripe device(s) that caused the trigger. */
-static enum disk_state_type _process_stripe_event(struct dm_task *dmt,
+static enum disk_state_type _process_stripe_event(struct dso_raid_set *rs,
+						  struct dm_task *dmt,
 						  char *params)
 {
 	int argc, i, num_devs, ret = D_INSYNC;
 	char **args = NULL, *dev_status_str, *p;
-	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
 	struct dso_raid_dev *dev;
 
-	if (!rs)
-		return D_IGNORE;
-
 	/*
 	 * dm core parms (NOT provided in @params):	0 976783872 striped 
 	 *
@@ -1091,13 +1019,13 @@ static enum disk_state_type _process_stripe_event(struct dm_task *dmt,
 	/* Check for bad stripe devices. */
 	for (i = 0, p = dev_status_str; i < rs->num_devs; i++, p++) {
 		if (*p == 'D') {
-			_log_event(dmt, args[i], "Stripe device dead");
+			_log_event(rs, dmt, args[i], "Stripe device dead");
 
 			/* Find and remove failed striped device member. */
 			dev = _find_dso_dev(rs, BY_NUM, args[i]);
 			if (dev) {
 				/* Set device LED to fault on device. */
-				_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
+				_dev_led_one(rs, DSO_LED_FAULT, SGPIO_PORT, dev);
 
 				/* Copy last device in set; reduce num_devs. */
 				_dso_dev_copy(rs, dev);
@@ -1115,17 +1043,13 @@ err:
 }
 
 /* Get the mirror event that caused the trigger. */
-static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
+static enum disk_state_type _process_mirror_event(struct dso_raid_set *rs,
+						  struct dm_task *dmt,
 						  char *params)
 {
 	int argc, i, log_argc, num_devs, ret = D_INSYNC;
 	char **args = NULL, *dev_status_str,
 	     *log_status_str = NULL, *p, *sync_str;
-	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
-
-	if (!rs)
-		return D_IGNORE;
 
 	/*
 	 * dm core parms (NOT provided in @params):	0 409600 mirror
@@ -1183,13 +1107,13 @@ static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
 		switch (*p) {
 		/* Mirror leg dead -> remove it. */
 		case 'D': 
-			_log_event(dmt, args[i], "Mirror device failed");
+			_log_event(rs, dmt, args[i], "Mirror device failed");
 
 			/* Find and remove failed disk member. */
 			dev = _find_dso_dev(rs, BY_NUM, args[i]);
 			if (dev) {
 				/* Set device LED to fault on port. */
-				_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
+				_dev_led_one(rs, DSO_LED_FAULT, SGPIO_PORT, dev);
 	
 				/* Copy last device in set; reduce num_devs. */
 				_dso_dev_copy(rs, dev);
@@ -1199,7 +1123,7 @@ static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
 			break; 
 
 		case 'R':
-			_log_event(dmt, args[i], "Mirror device read error");
+			_log_event(rs, dmt, args[i], "Mirror device read error");
 			ret = D_FAILURE_READ;
 			break;
 
@@ -1210,7 +1134,7 @@ static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
 			break;
 
 		case 'U':
-			_log_event(dmt, args[i], "Mirror device unknown error");
+			_log_event(rs, dmt, args[i], "Mirror device unknown error");
 			ret = D_FAILURE_DISK;
 		}
 	}
@@ -1246,18 +1170,14 @@ err:
 }
 
 /* Get the raid45 device(s) that caused the trigger. */
-static enum disk_state_type _process_raid45_event(struct dm_task *dmt,
+static enum disk_state_type _process_raid45_event(struct dso_raid_set *rs,
+						  struct dm_task *dmt,
 						  char *params)
 {
 	int argc, i, num_devs, dead, ret = D_INSYNC;
 	char **args = NULL, *dev_status_str, *p;
-	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
 	struct dso_raid_dev *dev;
 
-	if (!rs)
-		return D_IGNORE;
-
 	/*
 	 * dm core parms (NOT provided in @params):  	0 976783872 raid45 
 	 *
@@ -1294,13 +1214,13 @@ static enum disk_state_type _process_raid45_event(struct dm_task *dmt,
 		if (!dead)
 			continue;
 
-		_log_event(dmt, args[i], "Raid45 device failed");
+		_log_event(rs, dmt, args[i], "Raid45 device failed");
 
 		/* Find and remove failed disk member. */
 		dev = _find_dso_dev(rs, BY_NUM, args[i]);
 		if (dev) {
 			/* Set device LED to fault on port. */
-			_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
+			_dev_led_one(rs, DSO_LED_FAULT, SGPIO_PORT, dev);
 
 			/* Copy last device in set; reduce num_devs. */
 			_dso_dev_copy(rs, dev);
@@ -1317,13 +1237,15 @@ err:
 
 
 /* Process RAID device events. */
-static void _process_event(char *target_type, struct dm_task *dmt, char *params)
+static void _process_event(struct dso_raid_set *rs, char *target_type,
+			   struct dm_task *dmt, char *params)
 {
 	const char *uuid = dm_task_get_uuid(dmt);
 	const char *rs_name = dm_task_get_name(dmt);
 	static struct {
 		const char *target_type;
-		enum disk_state_type (*f)(struct dm_task *dmt, char *params);
+		enum disk_state_type (*f)(struct dso_raid_set *rs,
+					  struct dm_task *dmt, char *params);
 		int rebuild;
 	} *proc,  process[] = {
 		{ "striped", _process_stripe_event, 0 },
@@ -1331,7 +1253,7 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 		{ "raid45",  _process_raid45_event, 1 },
 	};
 #ifdef	_LIBDMRAID_DSO_TESTING
-	struct dso_raid_set *rs;
+	struct dso_raid_set *trs;
 #endif
 
 	/*
@@ -1349,10 +1271,10 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 	if (proc >= ARRAY_END(process))
 		return;
 
-	switch (proc->f(dmt, params)) {
+	switch (proc->f(rs, dmt, params)) {
 	case D_INSYNC:
 		if (proc->rebuild) {
-			_rebuild(REBUILD_END, rs_name);
+			_rebuild(rs, REBUILD_END);
 			syslog(LOG_NOTICE, "  %s is now in-sync", rs_name);
 		} else
 			syslog(LOG_NOTICE, "  %s is functioning properly\n",
@@ -1361,7 +1283,7 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 
 	case D_FAILURE_DISK:
 		if (proc->rebuild)
-			_rebuild(REBUILD_START, rs_name);
+			_rebuild(rs, REBUILD_START);
 
 	case D_FAILURE_LOG:
 	case D_FAILURE_READ:
@@ -1378,10 +1300,10 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 
 	/* FIXME: For testing. Remove later because of memory allocations. */
 #ifdef	_LIBDMRAID_DSO_TESTING
-	rs = _create_raid_set(rs_name, LOG_NONE);
-	if (rs) {
-		_log_names_and_ports(rs);
-		_destroy_raid_set(rs);
+	trs = _create_raid_set(rs_name, LOG_NONE);
+	if (trs) {
+		_log_names_and_ports(trs);
+		_destroy_raid_set(trs);
 	}
 #endif
 }
@@ -1392,27 +1314,23 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
  * Process RAID device events.
  */
 void process_event(struct dm_task *dmt, enum dm_event_mask event,
-		   void **unused __attribute((unused)))
+		   void **user)
 {
 	void *next = NULL;
 	uint64_t start, length;
 	char *params, *target_type = NULL;
 	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs;
-
-	pthread_mutex_lock(&_register_mutex);
+	struct dso_raid_set *rs = *user;
 
-	rs = _find_raid_set(rs_name, NULL, 1);
 	if (!rs) {
-		pthread_mutex_unlock(&_register_mutex);
+		syslog(LOG_ERR, "Can't find RAID set for device \"%s\"",
+		       rs_name);
 		return;
 	}
 
 	/* Flag RAID set in use to unregistration function. */
 	rs->flags |= RS_IN_USE;
 
-	pthread_mutex_unlock(&_register_mutex);
-
 	syslog(LOG_INFO, "Processing RAID set \"%s\" for Events", rs->name);
 
 	/*
@@ -1433,7 +1351,7 @@ void process_event(struct dm_task *dmt, enum dm_event_mask event,
 		       ALL_EVENTS, start, length, target_type, params);
 #endif			  
 		if (target_type)
-			_process_event(target_type, dmt, params);
+			_process_event(rs, target_type, dmt, params);
 		else
 			syslog(LOG_INFO, "  %s mapping lost?!", rs_name);
 	} while (next);
@@ -1499,31 +1417,23 @@ out:
  * External function.
  *
  * This code block is run when a device is first registered for monitoring.
+ * The RAID set structure gets stored in dmeventd's private pointer @user
+ * of the registration; dmeventd itself refuses double registrations.
  *
  * Return 1 for success and 0 for failure.
  */ 
 int register_device(const char *rs_name_in, const char *uuid,
-		    int major, int minor,
-		    void **unused __attribute((unused)))
+		    int major, int minor, void **user)
 {
+	int sgpio;
 	char *rs_name;
-	struct dso_raid_set *rs, *rs_new;
+	struct dso_raid_set *rs_new;
 
 	/* FIXME: need to run first to get syslog() to work. */
-	_check_sgpio();
+	sgpio = _check_sgpio();
 
 	rs_name = basename((char *) rs_name_in);
 
-	/* Check for double registration attempt. */
-	pthread_mutex_lock(&_register_mutex);
-	rs = _find_raid_set(rs_name, NULL, 0);
-	pthread_mutex_unlock(&_register_mutex);
-
-	if (rs) {
-		syslog(LOG_ERR, "RAID set \"%s\" already registered.", rs_name);
-		return 0;
-	}
-
 	/* Bail out, if event registration pending. */
 	if (_event_registration_pending(uuid))
 		return 0;
@@ -1533,21 +1443,8 @@ int register_device(const char *rs_name_in, const char *uuid,
 	if (!rs_new)
 		return 0;
 
-	/* Check for double registration attempt again after allocation. */
-	pthread_mutex_lock(&_register_mutex);
-	rs = _find_raid_set(rs_name, NULL, 0);
-	if (rs) {
-		/* We lost the race. */
-		pthread_mutex_unlock(&_register_mutex);
-		syslog(LOG_ERR,
-		       "dual registration attempt for \"%s\" cancelled",
-		       rs_name);
-		_destroy_raid_set(rs_new);
-		return 0;
-	} else {
-		_add_raid_set(rs_new); /* Add our new RAID set. */
-		pthread_mutex_unlock(&_register_mutex);
-	} 
+	rs_new->sgpio = sgpio;
+	*user = rs_new;
 
 	syslog(LOG_INFO, "Monitoring RAID set \"%s\" (uuid: %s) for events",
 	       rs_name, uuid);
@@ -1568,39 +1465,33 @@ int register_device(const char *rs_name_in, const char *uuid,
  * Return 1 for success and 0 for failure.
  */ 
 int unregister_device(const char *rs_name_in, const char *uuid,
-		      int major, int minor,
-		      void **unused __attribute((unused)))
+		      int major, int minor, void **user)
 {
 	char *rs_name;
-	struct dso_raid_set *prev, *rs;
+	struct dso_raid_set *rs = *user;
 
 	rs_name = basename((char *) rs_name_in);
 
-	pthread_mutex_lock(&_register_mutex);
+	if (!rs) {
+		syslog(LOG_ERR, "Can't find RAID set for device \"%s\"",
+		       rs_name);
+		return 0;
+	}
 
-	/* Remove the dso_raid_set from the global structure. */
-	rs = _find_raid_set(rs_name, &prev, 1);
-	if (rs) {
-		/* Event being processed! */
-		if (rs->flags & RS_IN_USE)
-			syslog(LOG_ERR,
-			       "Can't unregister busy RAID set \"%s\" "
-			       "(uuid: %s)\n", rs_name, uuid);
-		else {
-			_del_raid_set(rs, prev); /* Unlink RAID set. */
-
-			pthread_mutex_unlock(&_register_mutex);
-
-			syslog(LOG_INFO,
-			       "No longer monitoring RAID set \"%s\" "
-			       "(uuid: %s) for events\n", rs->name, uuid);
-			_destroy_raid_set(rs); /* Free the raid_set struct. */
-			return 1;
-		}
+	/* Event being processed! */
+	if (rs->flags & RS_IN_USE) {
+		syslog(LOG_ERR,
+		       "Can't unregister busy RAID set \"%s\" "
+		       "(uuid: %s)\n", rs_name, uuid);
+		return 0;
 	}
 
-	pthread_mutex_unlock(&_register_mutex);
-	return 0;
+	*user = NULL;
+	syslog(LOG_INFO,
+	       "No longer monitoring RAID set \"%s\" "
+	       "(uuid: %s) for events\n", rs->name, uuid);
+	_destroy_raid_set(rs); /* Free the raid_set struct. */
+	return 1;
 }
 
 #ifdef APP_TEST
@@ -1613,6 +1504,7 @@ int main(int argc, char **argv)
 {
 	int ret;
 	char *rs_name;
+	struct dso_raid_set *rs;
 
 	if (argc != 2) {
 		printf("%s name\n", argv[0]);        
@@ -1620,12 +1512,19 @@ int main(int argc, char **argv)
 	}
 
 	rs_name = argv[1];
-	ret = _lib_main('r', rs_name);
+	rs = _create_raid_set(rs_name, LOG_OPEN_FAILURE);
+	if (!rs) {
+		printf("Can't find RAID set %s\n", rs_name);
+		return 1;
+	}
+
+	ret = _lib_main(rs, 'r', rs_name);
 	printf("Got Members: %s=%d\n", rs_name, ret);
-	ret = _lib_main('R', rs_name);
+	ret = _lib_main(rs, 'R', rs_name);
 	printf("Rebuild initiated for %s=%d\n", rs_name, ret);
-	ret = _lib_main('F', rs_name);
+	ret = _lib_main(rs, 'F', rs_name);
 	printf("Rebuild ended for %s=%d\n", rs_name, ret);
+	_destroy_raid_set(rs);
 	return 0;
 }
 #endif
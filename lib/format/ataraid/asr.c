@@ -13,6 +13,7 @@
  */
 
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #define	HANDLER	"asr"
@@ -154,8 +155,7 @@ to_cpu(void *meta, unsigned cvt)
 {
 	struct asr *asr = meta;
 	struct asr_raidtable *rt = asr->rt;
-	unsigned i, elmcnt = rt->elmcnt,
-		use_old_elmcnt = (rt->ridcode == RVALID2);
+	unsigned i, elmcnt, use_old_elmcnt;
 
 	if (cvt & ASR_BLOCK) {
 		CVT32(asr->rb.b0idcode);
@@ -170,6 +170,13 @@ to_cpu(void *meta, unsigned cvt)
 		CVT32(asr->rb.raidtbl);
 	}
 
+	/* The RAID table is read after the reserved block got converted. */
+	if (!rt)
+		return;
+
+	elmcnt = rt->elmcnt;
+	use_old_elmcnt = (rt->ridcode == RVALID2);
+
 	if (cvt & ASR_TABLE) {
 		CVT32(rt->ridcode);
 		CVT32(rt->rversion);
@@ -207,14 +214,8 @@ static unsigned
 compute_checksum(struct asr *asr)
 {
 	struct asr_raidtable *rt = asr->rt;
-	uint8_t *ptr = (uint8_t *) rt->ent;
-	unsigned checksum = 0, end = sizeof(*rt->ent) * rt->elmcnt;
 
-	/* Compute checksum. */
-	while (end--)
-		checksum += *(ptr++);
-
-	return checksum & 0xFFFF;
+	return sum8(rt->ent, sizeof(*rt->ent) * rt->elmcnt) & 0xFFFF;
 }
 
 /* (Un)truncate white space at the end of a name */
@@ -229,20 +230,57 @@ handle_white_space(uint8_t * p, enum truncate truncate)
 		p[j] = c;
 }
 
+/*
+ * The RAID table is identical on all member disks.  Look it up by its raw
+ * contents to share it between the disks, which avoids converting and
+ * checking it per disk.
+ *
+ * Returns the shared RAID table or NULL in case of error.  *parse is
+ * set, if it's not been parsed yet, in which case a reference got taken
+ * on a new, raw image.
+ */
+static struct asr_raidtable *
+find_raidtable(struct lib_context *lc, struct dev_info *di, struct asr *asr,
+	       int *parse)
+{
+	struct asr_raidtable *rt, *ret;
+	struct iovec key = { .iov_len = sizeof(*rt) };
+
+	/* Read the whole RAID table including the extended config lines. */
+	if (!(rt = alloc_private_and_read(lc, handler, sizeof(*rt), di->path,
+					  (uint64_t) asr->rb.raidtbl *
+					  ASR_DISK_BLOCK_SIZE)))
+		LOG_ERR(lc, NULL, "%s: Could not read metadata off %s",
+			handler, di->path);
+
+	key.iov_base = rt;
+	if ((ret = find_shared_meta(lc, handler, &key, 1)))
+		*parse = 0;
+	else if ((ret = share_meta(lc, handler, rt, sizeof(*rt), &key, 1))) {
+		*parse = 1;
+		return ret;
+	}
+
+	dbg_free(rt);
+	return ret;
+}
+
 /* Read extended metadata areas */
 static int
 read_extended(struct lib_context *lc, struct dev_info *di, struct asr *asr)
 {
-	unsigned remaining, i, chk;
-	struct asr_raidtable *rt = asr->rt;
+	int parse;
+	unsigned i, chk;
+	struct asr_raidtable *rt;
 
 	log_notice(lc, "%s: reading extended data on %s", handler, di->path);
 
 	/* Read the RAID table. */
-	if (!read_file(lc, handler, di->path, rt, ASR_DISK_BLOCK_SIZE,
-		       (uint64_t) asr->rb.raidtbl * ASR_DISK_BLOCK_SIZE))
-		LOG_ERR(lc, 0, "%s: Could not read metadata off %s",
-			handler, di->path);
+	if (!(rt = asr->rt = find_raidtable(lc, di, asr, &parse)))
+		return 0;
+
+	if (!parse)
+		return 1;
 
 	/* Convert it */
 	to_cpu(asr, ASR_TABLE);
@@ -263,16 +301,9 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct asr *asr)
 		LOG_ERR(lc, 0, "%s: Wrong RAID config line size on %s",
 			handler, di->path);
 
-	/* Figure out how much else we need to read. */
-	if (rt->elmcnt > ASR_TBLELMCNT) {
-		remaining = rt->elmsize * (rt->elmcnt - 7);
-		if (!read_file(lc, handler, di->path, rt->ent + 7,
-			       remaining, (uint64_t) (asr->rb.raidtbl + 1) *
-			       ASR_DISK_BLOCK_SIZE))
-			return 0;
-
+	/* Convert the extended config lines. */
+	if (rt->elmcnt > ASR_TBLELMCNT)
 		to_cpu(asr, ASR_EXTTABLE);
-	}
 
 	/* Checksum only valid for raid table version 1. */
 	if (rt->rversion < 2) {
@@ -368,11 +399,8 @@ read_metadata_areas(struct lib_context *lc, struct dev_info *di,
 	if (!(asr = alloc_private(lc, handler, sizeof(*asr))))
 		goto bad0;
 
-	if (!(asr->rt = alloc_private(lc, handler, sizeof(*asr->rt))))
-		goto bad1;
-
 	if (!read_file(lc, handler, di->path, &asr->rb, size, asr_sboffset))
-		goto bad2;
+		goto bad1;
 
 	/*
 	 * Convert metadata and read in 
@@ -380,7 +408,10 @@ read_metadata_areas(struct lib_context *lc, struct dev_info *di,
 	to_cpu(asr, ASR_BLOCK);
 
 	/* Check Signature and read optional extended metadata. */
-	if (!is_asr(lc, di, asr) || !read_extended(lc, di, asr))
+	if (!is_asr(lc, di, asr))
+		goto bad1;
+
+	if (!read_extended(lc, di, asr))
 		goto bad2;
 
 	/*
@@ -393,7 +424,8 @@ read_metadata_areas(struct lib_context *lc, struct dev_info *di,
 	goto out;
 
       bad2:
-	dbg_free(asr->rt);
+	if (asr->rt)
+		free_meta(lc, asr->rt);
       bad1:
 	asr->rt = NULL;
 	dbg_free(asr);
@@ -620,7 +652,7 @@ do_spare(struct lib_context *lc, struct raid_dev *rd)
 	rs->type = t_spare;
 
 	/* Add the disk to the set. */
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev_deferred(lc, rs, rd, dev_sort);
 	return rs;
 }
 
@@ -655,7 +687,7 @@ do_stacked(struct lib_context *lc, struct raid_dev *rd,
 	rs->type = type(fwl);
 
 	/* Add the disk to the set. */
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev_deferred(lc, rs, rd, dev_sort);
 
 	/* Find the top level set. */
 	ss = join_superset(lc, js_name, NO_CREATE, set_sort, rs, rd);
@@ -702,7 +734,7 @@ asr_group(struct lib_context *lc, struct raid_dev *rd)
 		rs->type = type(find_logical(asr));
 
 		/* Add the disk to the set. */
-		list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+		link_raid_dev_deferred(lc, rs, rd, dev_sort);
 		return rs;
 	}
 
@@ -765,9 +797,9 @@ find_newest_drive(struct raid_set *rs)
 static uint32_t
 create_drivemagic(void)
 {
+	unsigned int seed = time(NULL);
 
-	srand(time(NULL));
-	return rand() + rand();
+	return rand_r(&seed) + rand_r(&seed);
 }
 
 static int
@@ -984,11 +1016,18 @@ static int
 asr_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 {
 	struct asr *asr = META(rd, asr);
+	struct asr_raidtable *rt;
 	int elmcnt = asr->rt->elmcnt, i, ret;
 
 	/* Update the metadata if we're not erasing it. */
-	if (!erase)
+	if (!erase) {
+		/* Get a private copy of the shared RAID table to update. */
+		if (!(rt = unshare_meta(lc, rd, asr->rt, sizeof(*rt))))
+			return 0;
+
+		asr->rt = rt;
 		update_metadata(lc, rd, asr);
+	}
 
 	/* Untruncate trailing whitespace in the name. */
 	for (i = 0; i < elmcnt; i++)
@@ -1173,9 +1212,10 @@ setup_rd(struct lib_context *lc, struct raid_dev *rd,
 	if (!(ma = rd->meta_areas = alloc_meta_areas(lc, rd, handler, 2)))
 		return 0;
 
-	/* First area: raid reserved block. */
+	/* First area: raid reserved block, which points to the table. */
 	ma->offset = ASR_CONFIGOFFSET >> 9;
 	ma->size = ASR_DISK_BLOCK_SIZE;
+	ma->anchor = 1;
 	(ma++)->area = asr;
 
 	/* Second area: raid table. */
@@ -118,6 +118,38 @@ check_magic(void *meta)
 	       hpt->disk_number < 8;
 }
 
+/* Ondisk metadata layout. */
+#if	BYTE_ORDER != LITTLE_ENDIAN || defined(DMRAID_NATIVE_LOG)
+static const struct meta_field hpt37x_fields[] = {
+	MF(hpt37x, magic, MF_HEX),
+	MF(hpt37x, magic_0, MF_HEX),
+	MF(hpt37x, magic_1, MF_HEX),
+	MF(hpt37x, order, MF_DEC),
+	MF(hpt37x, raid_disks, MF_DEC),
+	MF(hpt37x, raid0_shift, MF_DEC),
+	MF(hpt37x, type, MF_DEC),
+	MF(hpt37x, disk_number, MF_DEC),
+	MF(hpt37x, total_secs, MF_DEC),
+	MF(hpt37x, disk_mode, MF_HEX),
+	MF(hpt37x, boot_mode, MF_HEX),
+	MF(hpt37x, boot_disk, MF_DEC),
+	MF(hpt37x, boot_protect, MF_DEC),
+	MF(hpt37x, error_log_entries, MF_DEC),
+	MF(hpt37x, error_log_index, MF_DEC),
+	MF_END,
+};
+
+static const struct meta_field hpt37x_errorlog_fields[] = {
+	MF(hpt37x_errorlog, timestamp, MF_DEC),
+	MF(hpt37x_errorlog, reason, MF_DEC),
+	MF(hpt37x_errorlog, disk, MF_DEC),
+	MF(hpt37x_errorlog, status, MF_DEC),
+	MF(hpt37x_errorlog, sectors, MF_DEC),
+	MF(hpt37x_errorlog, lba, MF_DEC),
+	MF_END,
+};
+#endif
+
 /*
  * Read a Highpoint 37X RAID device.
  */
@@ -130,13 +162,7 @@ to_cpu(void *meta)
 {
 	struct hpt37x *hpt = meta;
 
-	CVT32(hpt->magic);
-	CVT32(hpt->magic_0);
-	CVT32(hpt->magic_1);
-	CVT32(hpt->order);
-	CVT32(hpt->total_secs);
-	CVT32(hpt->disk_mode);
-	CVT32(hpt->boot_mode);
+	meta_to_cpu(hpt, hpt37x_fields);
 
 	/* Only convert error log entries in case we discover proper magic */
 	if (check_magic(meta)) {
@@ -144,10 +170,8 @@ to_cpu(void *meta)
 
 		for (l = hpt->errorlog;
 		     l < hpt->errorlog +
-		     min(hpt->error_log_entries, HPT37X_MAX_ERRORLOG); l++) {
-			CVT32(l->timestamp);
-			CVT32(l->lba);
-		}
+		     min(hpt->error_log_entries, HPT37X_MAX_ERRORLOG); l++)
+			meta_to_cpu(l, hpt37x_errorlog_fields);
 	}
 }
 #endif
@@ -227,7 +251,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	if (!init_raid_set(lc, rs, rd, stride(hpt), hpt->type, handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 	h = DEVS(rs) ? META(RD_RS(rs), hpt37x) : NULL;
 
 	switch (hpt->type) {
@@ -239,7 +263,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 			return mismatch(lc, rd, '0');
 
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 		break;
 
@@ -332,21 +356,7 @@ hpt37x_log(struct lib_context *lc, struct raid_dev *rd)
 	struct hpt37x_errorlog *el;
 
 	log_print(lc, "%s (%s):", rd->di->path, handler);
-	DP("magic: 0x%x", hpt, hpt->magic);
-	DP("magic_0: 0x%x", hpt, hpt->magic_0);
-	DP("magic_1: 0x%x", hpt, hpt->magic_1);
-	DP("order: %u", hpt, hpt->order);
-	DP("raid_disks: %u", hpt, hpt->raid_disks);
-	DP("raid0_shift: %u", hpt, hpt->raid0_shift);
-	DP("type: %u", hpt, hpt->type);
-	DP("disk_number: %u", hpt, hpt->disk_number);
-	DP("total_secs: %u", hpt, hpt->total_secs);
-	DP("disk_mode: 0x%x", hpt, hpt->disk_mode);
-	DP("boot_mode: 0x%x", hpt, hpt->boot_mode);
-	DP("boot_disk: %u", hpt, hpt->boot_disk);
-	DP("boot_protect: %u", hpt, hpt->boot_protect);
-	DP("error_log_entries: %u", hpt, hpt->error_log_entries);
-	DP("error_log_index: %u", hpt, hpt->error_log_index);
+	log_meta(lc, hpt, hpt, hpt37x_fields, 0);
 	if (hpt->error_log_entries)
 		log_print(lc, "error_log:");
 
@@ -354,12 +364,7 @@ hpt37x_log(struct lib_context *lc, struct raid_dev *rd)
 		if (!el->timestamp)
 			break;
 
-		DP("timestamp: %u", hpt, el->timestamp);
-		DP("reason: %u", hpt, el->reason);
-		DP("disk: %u", hpt, el->disk);
-		DP("status: %u", hpt, el->status);
-		DP("sectors: %u", hpt, el->sectors);
-		DP("lba: %u", hpt, el->lba);
+		log_meta(lc, hpt, el, hpt37x_errorlog_fields, 0);
 	};
 }
 #endif
@@ -127,14 +127,14 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 			   hpt->type, handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 
 	switch (hpt->type) {
 	case HPT45X_T_SPAN:
 	case HPT45X_T_RAID1:
 	      no_raid10:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 		break;
 
@@ -174,6 +174,27 @@ hpt45x_group(struct lib_context *lc, struct raid_dev *rd)
 	return NULL;
 }
 
+/* Ondisk metadata layout. */
+#if	BYTE_ORDER != LITTLE_ENDIAN || defined(DMRAID_NATIVE_LOG)
+static const struct meta_field hpt45x_fields[] = {
+	MF(hpt45x, magic, MF_HEX),
+	MF(hpt45x, magic_0, MF_HEX),
+	MF(hpt45x, magic_1, MF_HEX),
+	MF(hpt45x, total_secs, MF_DEC),
+	MF(hpt45x, type, MF_DEC),
+	MF(hpt45x, raid_disks, MF_DEC),
+	MF(hpt45x, disk_number, MF_DEC),
+	MF(hpt45x, raid0_shift, MF_DEC),
+	MF_ARRAY(hpt45x, dummy, MF_HEX),
+	MF(hpt45x, raid1_type, MF_DEC),
+	MF(hpt45x, raid1_raid_disks, MF_DEC),
+	MF(hpt45x, raid1_disk_number, MF_DEC),
+	MF(hpt45x, raid1_shift, MF_DEC),
+	MF_ARRAY(hpt45x, dummy1, MF_HEX),
+	MF_END,
+};
+#endif
+
 /*
  * Read a Highpoint 45X RAID device.
  */
@@ -184,12 +205,7 @@ hpt45x_group(struct lib_context *lc, struct raid_dev *rd)
 static void
 to_cpu(void *meta)
 {
-	struct hpt45x *hpt = meta;
-
-	CVT32(hpt->magic);
-	CVT32(hpt->magic_0);
-	CVT32(hpt->magic_1);
-	CVT32(hpt->total_secs);
+	meta_to_cpu(meta, hpt45x_fields);
 }
 #endif
 
@@ -277,27 +293,10 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 static void
 hpt45x_log(struct lib_context *lc, struct raid_dev *rd)
 {
-	unsigned int i;
 	struct hpt45x *hpt = META(rd, hpt45x);
 
 	log_print(lc, "%s (%s):", rd->di->path, handler);
-	DP("magic: 0x%x", hpt, hpt->magic);
-	DP("magic_0: 0x%x", hpt, hpt->magic_0);
-	DP("magic_1: 0x%x", hpt, hpt->magic_1);
-	DP("total_secs: %u", hpt, hpt->total_secs);
-	DP("type: %u", hpt, hpt->type);
-	DP("raid_disks: %u", hpt, hpt->raid_disks);
-	DP("disk_number: %u", hpt, hpt->disk_number);
-	DP("raid0_shift: %u", hpt, hpt->raid0_shift);
-	for (i = 0; i < 3; i++)
-		P2("dummy[%u]: 0x%x", hpt, i, hpt->dummy[i]);
-	DP("raid1_type: %u", hpt, hpt->raid1_type);
-	DP("raid1_raid_disks: %u", hpt, hpt->raid1_raid_disks);
-	DP("raid1_disk_number: %u", hpt, hpt->raid1_disk_number);
-	DP("raid1_shift: %u", hpt, hpt->raid1_shift);
-
-	for (i = 0; i < 3; i++)
-		P2("dummy1[%u]: 0x%x", hpt, i, hpt->dummy1[i]);
+	log_meta(lc, hpt, hpt, hpt45x_fields, 0);
 }
 #endif
 
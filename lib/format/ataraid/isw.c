@@ -25,6 +25,7 @@
 
 #include <time.h>
 #include <math.h>
+#include <sys/uio.h>
 #include "internal.h"
 #include <device/scsi.h>
 #define	FORMAT_HANDLER
@@ -104,59 +105,174 @@ is_raid10(struct isw_dev *dev)
 		       min_num_disks(ISW_T_RAID10))) : 0;
 }
 
+/* Return sector rounded size of isw metadata. */
+static size_t
+isw_size(struct isw *isw)
+{
+	return round_up(isw->mpb_size, ISW_DISK_BLOCK_SIZE);
+}
+
 /* Find a disk table slot by serial number. */
 /* FIXME: this is workaround for di->serial issues to be fixed. */
-static const char *dev_info_serial_to_isw(const char *di_serial)
+#define	ISW_SERIAL_SIZE	(MAX_RAID_SERIAL_LEN + 1)
+static const char *
+dev_info_serial_to_isw(const char *di_serial, char *isw_serial)
 {
-	int i, isw_serial_len = 0;
-	static char isw_serial[1024];
+	int i, isw_serial_len = 0, skip = 0;
 
-	for (i = 0;
-	     di_serial[i] && isw_serial_len < sizeof(isw_serial) - 1;
-	     i++) {
+	/* Only the last MAX_RAID_SERIAL_LEN characters count. */
+	for (i = 0; di_serial[i]; i++) {
 		if (!isspace(di_serial[i]))
-			/*
-			 * ':' is reserved for use in placeholder
-			 * serial numbers for missing disks.
-			 */
-			isw_serial[isw_serial_len++] =
-				(di_serial[i] == ':') ? ';' : di_serial[i];
+			skip++;
 	}
 
-	isw_serial[isw_serial_len] = 0;
+	skip = skip > MAX_RAID_SERIAL_LEN ? skip - MAX_RAID_SERIAL_LEN : 0;
+	for (i = 0; di_serial[i]; i++) {
+		if (isspace(di_serial[i]))
+			continue;
 
-	if (isw_serial_len > MAX_RAID_SERIAL_LEN)
-		memmove(isw_serial,
-			isw_serial + (isw_serial_len - MAX_RAID_SERIAL_LEN),
-			MAX_RAID_SERIAL_LEN);
+		if (skip) {
+			skip--;
+			continue;
+		}
 
+		/*
+		 * ':' is reserved for use in placeholder
+		 * serial numbers for missing disks.
+		 */
+		isw_serial[isw_serial_len++] =
+			(di_serial[i] == ':') ? ';' : di_serial[i];
+	}
+
+	isw_serial[isw_serial_len] = 0;
 	return isw_serial;
 }
 
+/*
+ * Serial number hash of the disk table.
+ *
+ * It gets built once behind the shared superblock image of
+ * all members when that's read, so that looking up disks
+ * doesn't need to scan the table.
+ */
+struct isw_disk_index {
+	uint32_t mask;		/* Hash buckets - 1. */
+	uint8_t slot[];	/* Disk table index + 1 or 0 if empty. */
+};
+
+static unsigned int
+serial_hash(const int8_t *serial)
+{
+	unsigned int i, h = 2166136261U;
+
+	for (i = 0; i < MAX_RAID_SERIAL_LEN && serial[i]; i++)
+		h = (h ^ (uint8_t) serial[i]) * 16777619U;
+
+	return h;
+}
+
+/* Size of the disk index for num_disks. */
+static size_t
+disk_index_size(unsigned int num_disks)
+{
+	unsigned int buckets = 8;
+
+	while (buckets < 2 * num_disks)
+		buckets <<= 1;
+
+	return sizeof(struct isw_disk_index) + buckets;
+}
+
+/* Build the disk index behind the superblock image of size bytes. */
+static void
+build_disk_index(struct isw *isw, size_t size)
+{
+	int i = isw->num_disks;
+	unsigned int h;
+	struct isw_disk *disk = isw->disk;
+	struct isw_disk_index *idx =
+		(struct isw_disk_index *) ((uint8_t *) isw + size);
+
+	idx->mask = disk_index_size(i) - sizeof(*idx) - 1;
+	memset(idx->slot, 0, idx->mask + 1);
+
+	/* Leave the index empty on a disk table exceeding the superblock. */
+	if ((uint8_t *) (disk + i) > (uint8_t *) isw + size)
+		return;
+
+	/* Insert backwards for the last one of duplicates to win. */
+	while (i--) {
+		for (h = serial_hash(disk[i].serial) & idx->mask;
+		     idx->slot[h]; h = (h + 1) & idx->mask) {
+			if (!strncmp((const char *) disk[idx->slot[h] - 1].serial,
+				     (const char *) disk[i].serial,
+				     MAX_RAID_SERIAL_LEN))
+				break;
+		}
+
+		if (!idx->slot[h])
+			idx->slot[h] = i + 1;
+	}
+}
+
+/* Return the disk index of isw or NULL if it has none. */
+static struct isw_disk_index *
+disk_index(struct lib_context *lc, struct isw *isw)
+{
+	size_t size = shared_meta_size(lc, isw);
+
+	return size > isw_size(isw) ?
+	       (struct isw_disk_index *) ((uint8_t *) isw + isw_size(isw)) :
+	       NULL;
+}
+
+/* Find a disk table slot by ISW serial number. */
 static struct isw_disk *
-_get_disk(struct isw *isw, struct dev_info *di)
+serial_to_disk(struct lib_context *lc, struct isw *isw, const char *serial)
 {
-	if (di->serial) {
-		int i = isw->num_disks;
-		struct isw_disk *disk = isw->disk;
-		const char *isw_serial = dev_info_serial_to_isw(di->serial);
+	int i = isw->num_disks;
+	unsigned int h;
+	struct isw_disk *disk = isw->disk;
+	struct isw_disk_index *idx = disk_index(lc, isw);
 
-		while (i--) {
-			if (!strncmp(isw_serial, (const char *) disk[i].serial,
+	if (idx) {
+		for (h = serial_hash((const int8_t *) serial) & idx->mask;
+		     idx->slot[h]; h = (h + 1) & idx->mask) {
+			if (!strncmp(serial,
+				     (const char *) disk[idx->slot[h] - 1].serial,
 				     MAX_RAID_SERIAL_LEN))
-				return disk + i;
+				return disk + idx->slot[h] - 1;
 		}
+
+		return NULL;
+	}
+
+	while (i--) {
+		if (!strncmp(serial, (const char *) disk[i].serial,
+			     MAX_RAID_SERIAL_LEN))
+			return disk + i;
 	}
 
 	return NULL;
 }
 
+static struct isw_disk *
+_get_disk(struct lib_context *lc, struct isw *isw, struct dev_info *di)
+{
+	char isw_serial[ISW_SERIAL_SIZE];
+
+	return di->serial ?
+	       serial_to_disk(lc, isw,
+			      dev_info_serial_to_isw(di->serial, isw_serial)) :
+	       NULL;
+}
+
 static struct isw_disk *
 get_disk(struct lib_context *lc, struct dev_info *di, struct isw *isw)
 {
 	struct isw_disk *disk;
 
-	if ((disk = _get_disk(isw, di)))
+	if ((disk = _get_disk(lc, isw, di)))
 		return disk;
 
 	LOG_ERR(lc, NULL, "%s: Could not find disk %s in the metadata",
@@ -210,7 +326,7 @@ name(struct lib_context *lc, struct raid_dev *rd,
 	struct isw_disk *disk = isw->disk;
 
 	if (nt == N_VOLUME && is_raid10(dev)) {
-		if ((disk = _get_disk(isw, rd->di))) {
+		if ((disk = _get_disk(lc, isw, rd->di))) {
 			int i = max_num_disks(ISW_T_RAID10);
 
 			while (i--) {
@@ -306,13 +422,7 @@ type(struct isw_dev *dev)
 static uint32_t
 _checksum(struct isw *isw)
 {
-	uint32_t end = isw->mpb_size / sizeof(end),
-		*p = (uint32_t *) isw, ret = 0;
-
-	while (end--)
-		ret += *p++;
-
-	return ret - isw->check_sum;
+	return sum32(isw, isw->mpb_size / sizeof(uint32_t)) - isw->check_sum;
 }
 
 /* Calculate next isw device offset. */
@@ -412,13 +522,6 @@ to_cpu(struct isw *isw, enum convert cvt)
 }
 #endif
 
-/* Return sector rounded size of isw metadata. */
-static size_t
-isw_size(struct isw *isw)
-{
-	return round_up(isw->mpb_size, ISW_DISK_BLOCK_SIZE);
-}
-
 /* Set metadata area size in bytes and config offset in sectors. */
 static void
 set_metadata_sizoff(struct raid_dev *rd, size_t size)
@@ -545,6 +648,63 @@ isw_read_extended(struct lib_context *lc, struct dev_info *di,
 	return *isw ? 1 : 0;
 }
 
+/*
+ * Look up the superblock read into isw by its raw contents in the images
+ * shared between member disks or turn isw into a new one after converting
+ * and checking it, with the disk index appended.  isw is consumed in any case.
+ */
+static struct isw *
+share_isw(struct lib_context *lc, struct dev_info *di,
+	  struct isw *isw, size_t size)
+{
+	struct isw *ret;
+	size_t index_size = disk_index_size(isw->num_disks);
+	struct iovec key = { .iov_base = isw, .iov_len = size };
+
+	if ((ret = find_shared_meta(lc, handler, &key, 1)) ||
+	    !(ret = dbg_realloc(isw, size + index_size))) {
+		dbg_free(isw);
+		return ret;
+	}
+
+	isw = ret;
+	key.iov_base = isw;
+	if (!(ret = share_meta(lc, handler, isw, size + index_size,
+			       &key, 1))) {
+		dbg_free(isw);
+		return NULL;
+	}
+
+	/*
+	 * Now that we made sure, that we've got all the
+	 * metadata, we can convert it completely.
+	 */
+	to_cpu(ret, LAST);
+
+	/* Superblock checksum */
+	if (ret->check_sum != _checksum(ret)) {
+		log_err(lc, "%s: extended superblock for %s "
+			"has wrong checksum", handler, di->path);
+		free_meta(lc, ret);
+		ret = NULL;
+	} else
+		build_disk_index(ret, size);
+
+	return ret;
+}
+
+/*
+ * Replace the superblock of a RAID device by a private copy
+ * before changing it, because the image is shared between
+ * the member disks (see share_isw()).
+ */
+static struct isw *
+unshare_isw(struct lib_context *lc, struct raid_dev *rd)
+{
+	return unshare_meta(lc, rd, rd->meta_areas->area,
+			    rd->meta_areas->size);
+}
+
 /* Check for RAID disk ok. */
 static int
 disk_ok(struct lib_context *lc, struct dev_info *di, struct isw *isw)
@@ -585,10 +745,11 @@ isw_try_sboffset(struct lib_context *lc, struct dev_info *di,
 	}
 
 	/*
-	 * Now that we made sure, that we've got all the
-	 * metadata, we can convert it completely.
+	 * All member disks carry the same superblock: share
+	 * one converted and checked image between them.
 	 */
-	to_cpu(isw, LAST);
+	if (!(isw = share_isw(lc, di, isw, size)))
+		goto out;
 
 	if (disk_ok(lc, di, isw)) {
 		*sz = size;
@@ -598,6 +759,10 @@ isw_try_sboffset(struct lib_context *lc, struct dev_info *di,
 		goto out;
 	}
 
+	free_meta(lc, isw);
+	isw = NULL;
+	goto out;
+
 bad:
 	dbg_free(isw);
 	isw = NULL;
@@ -663,39 +828,74 @@ isw_read(struct lib_context *lc, struct dev_info *di)
 			     isw_file_metadata, setup_rd, handler);
 }
 
+/* Retrieve and make up SCSI ID. */
+static unsigned
+get_scsiId(struct lib_context *lc, char *path)
+{
+	int fd;
+	Sg_scsi_id sg_id;
+
+	memset(&sg_id, 0, sizeof(sg_id));
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return UNKNOWN_SCSI_ID;
+
+	if (!get_scsi_id(lc, fd, &sg_id)) {
+		close(fd);
+		return UNKNOWN_SCSI_ID;
+	}
+
+	close(fd);
+	return (sg_id.host_no << 16) | (sg_id.scsi_id << 8) | sg_id.lun;
+}
+
 /*
  * Write metadata to an Intel Software RAID device.
+ *
+ * The superblock is shared between the member disks, so it's written
+ * from a copy carrying the SCSI ID of the disk and converted to disk
+ * byte order rather than in place.
  */
 static int
 isw_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 {
 	int ret;
-	struct isw *isw = META(rd, isw);
-	void *dst, *src = isw;
-	uint32_t size = isw->mpb_size;
-
-	to_disk(isw, FULL);
+	struct isw *isw;
+	struct isw_disk *disk;
+	struct meta_areas *ma = rd->meta_areas, ext[2] = {
+		{ .offset = ma->offset, .size = ma->size, },
+	};
 
-	/* Flip sectors for write_metadata() to work if extended metadata. */
-	if (size > ISW_DISK_BLOCK_SIZE) {
-		/* sunil */
-		dst = alloc_private(lc, handler, 2 * ISW_DISK_BLOCK_SIZE);
-		if (!dst)
-			return 0;
+	if (!(isw = alloc_private(lc, handler, ma->size)))
+		return 0;
 
-		memcpy(dst, src + ISW_DISK_BLOCK_SIZE, ISW_DISK_BLOCK_SIZE);
-		memcpy(dst + ISW_DISK_BLOCK_SIZE, src, ISW_DISK_BLOCK_SIZE);
-	} else
-		dst = isw;
+	memcpy(isw, ma->area, ma->size);
+	if ((disk = _get_disk(lc, isw, rd->di)))
+		disk->scsiId = get_scsiId(lc, rd->di->path);
 
-	rd->meta_areas->area = dst;
-	ret = write_metadata(lc, handler, rd, -1, erase);
-	rd->meta_areas->area = isw;
+	ext[0].area = isw;
+	rd->meta_areas = ext;
 
-	if (dst != isw)
-		dbg_free(dst);
+	/*
+	 * Extended metadata precedes the first metadata block ondisk,
+	 * which is the anchor and thus needs to be the first area.
+	 */
+	if (isw->mpb_size > ISW_DISK_BLOCK_SIZE) {
+		ext[0].offset = ma->offset + ma->size / ISW_DISK_BLOCK_SIZE - 1;
+		ext[0].size = ISW_DISK_BLOCK_SIZE;
+		ext[0].anchor = 1;
+		ext[1].offset = ma->offset;
+		ext[1].size = ma->size - ISW_DISK_BLOCK_SIZE;
+		ext[1].area = (uint8_t *) isw + ISW_DISK_BLOCK_SIZE;
+		ext[1].anchor = 0;
+		rd->areas = 2;
+	}
 
-	to_cpu(isw, FULL);
+	to_disk(isw, FULL);
+	ret = write_metadata(lc, handler, rd, -1, erase);
+	rd->meta_areas = ma;
+	rd->areas = 1;
+	dbg_free(isw);
 	return ret;
 }
 
@@ -736,17 +936,17 @@ _create_rd(struct lib_context *lc,
 	if (!(r = alloc_raid_dev(lc, handler)))
 		return NULL;
 
-	if (!(r->meta_areas = alloc_meta_areas(lc, rd, handler, 1)))
+	if (!(r->meta_areas = alloc_meta_areas(lc, r, handler, 1)))
 		goto free;
 
 	/* Configuration for spare disk. */
 	if (isw->disk[0].status & SPARE_DISK) {
 		r->meta_areas->offset = rd->meta_areas->offset;
 		r->meta_areas->size = rd->meta_areas->size;
-		r->meta_areas->area =
-			alloc_private(lc, handler, rd->meta_areas->size);
-		memcpy(r->meta_areas->area, rd->meta_areas->area,
-		       rd->meta_areas->size);
+		if (!(r->meta_areas->area =
+		      view_meta(lc, handler, rd->meta_areas->area,
+				rd->meta_areas->size, rd->meta_areas->area)))
+			goto free;
 
 		r->type = t_spare;
 		if (!(r->name = name(lc, rd, NULL, N_PATH)))
@@ -768,8 +968,10 @@ _create_rd(struct lib_context *lc,
 
 	r->meta_areas->offset = rd->meta_areas->offset;
 	r->meta_areas->size = rd->meta_areas->size;
-	r->meta_areas->area = alloc_private(lc, handler, rd->meta_areas->size);
-	memcpy(r->meta_areas->area, rd->meta_areas->area, rd->meta_areas->size);
+	if (!(r->meta_areas->area =
+	      view_meta(lc, handler, rd->meta_areas->area,
+			rd->meta_areas->size, rd->meta_areas->area)))
+		goto free;
 
 	if ((r->type = type(dev)) == t_undef) {
 		log_err(lc, "%s: RAID type %u not supported",
@@ -803,13 +1005,20 @@ create_rs(struct raid_set *rs, void *private)
 	rs->stride = ((struct isw_dev *) private)->vol.map[0].blocks_per_strip;
 }
 
+/* Context of dev_sort() handed in by the new RAID devices private pointer. */
+struct isw_sort {
+	struct lib_context *lc;
+	struct isw *isw;
+	struct isw_disk *disk;	/* Disk of the new RAID device. */
+};
+
 /* Decide about ordering sequence of RAID device. */
 static int
 dev_sort(struct list_head *pos, struct list_head *new)
 {
-	struct isw *isw = RD(new)->private.ptr;
+	struct isw_sort *sort = RD(new)->private.ptr;
 
-	return _get_disk(isw, RD(new)->di) < _get_disk(isw, RD(pos)->di);
+	return sort->disk < _get_disk(sort->lc, sort->isw, RD(pos)->di);
 }
 
 static void
@@ -835,7 +1044,11 @@ group_rd(struct lib_context *lc,
 	struct raid_dev *rd;
 	struct raid_set *rs, *ss;
 	char *ss_name = NULL;
-
+	struct isw_sort sort = {
+		.lc = lc,
+		.isw = isw,
+		.disk = _get_disk(lc, isw, rd_meta->di),
+	};
 
 	/* Configuration for spare disk. */
 	if (isw->disk[0].status & SPARE_DISK) {
@@ -854,7 +1067,9 @@ group_rd(struct lib_context *lc,
 		}
 
 		rs->status = s_ok;
-		list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+		rd->private.ptr = &sort;
+		link_raid_dev(lc, rs, rd, dev_sort);
+		rd->private.ptr = NULL;
 	} else {
 		/* Loop the device/volume table. */
 		for (d = 0; d < isw->num_raid_devs; d++) {
@@ -889,8 +1104,8 @@ group_rd(struct lib_context *lc,
 
 			/* Save and set to enable dev_sort(). */
 			private = rd->private.ptr;
-			rd->private.ptr = isw;
-			list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+			rd->private.ptr = &sort;
+			link_raid_dev(lc, rs, rd, dev_sort);
 			/* Restore. */
 			rd->private.ptr = private;
 
@@ -905,7 +1120,10 @@ static struct raid_set *
 isw_group(struct lib_context *lc, struct raid_dev *rd_meta)
 {
 	struct raid_set *rs_group = NULL;
-
+	struct isw_sort sort = {
+		.lc = lc,
+		.isw = META(rd_meta, isw),
+	};
 
 	/*
 	 * Once we get here, an Intel SW RAID disk containing a metadata area
@@ -926,8 +1144,9 @@ isw_group(struct lib_context *lc, struct raid_dev *rd_meta)
 	 * Sorting is no problem here, because RAID sets and devices will
 	 * be created for all the Volumes of an ISW set and those need sorting.
 	 */
-	rd_meta->private.ptr = rd_meta->meta_areas->area;
-	list_add_sorted(lc, &rs_group->devs, &rd_meta->devs, dev_sort);
+	sort.disk = _get_disk(lc, sort.isw, rd_meta->di);
+	rd_meta->private.ptr = &sort;
+	link_raid_dev(lc, rs_group, rd_meta, dev_sort);
 	rd_meta->private.ptr = NULL;
 
 
@@ -963,26 +1182,29 @@ adjust_length(struct isw_dev *dev, struct isw_dev *dev_rebuilt,
 static int
 rd_idx_by_name(struct isw *isw, const char *name)
 {
-	int i = isw->num_raid_devs;
+	int i, ret = -ENOENT;
+	struct isw_dev *dev = raiddev(isw, 0);
 
-	while (i--) {
-		if (strstr(name, (const char *) raiddev(isw, i)->volume))
-			return i;
+	/* Walk the table once; the last matching volume wins. */
+	for (i = 0; i < isw->num_raid_devs; i++, dev = advance_raiddev(dev)) {
+		if (strstr(name, (const char *) dev->volume))
+			ret = i;
 	}
 
-	return -ENOENT;
+	return ret;
 }
 
 /* Return RAID device for serial string. */
 static struct raid_dev *
 rd_by_serial(struct raid_set *rs, const char *serial)
 {
+	char isw_serial[ISW_SERIAL_SIZE];
 	struct raid_dev *rd;
 
 	list_for_each_entry(rd, &rs->devs, devs) {
 		if (rd->di &&
-		    !strncmp(dev_info_serial_to_isw(rd->di->serial), serial,
-						    MAX_RAID_SERIAL_LEN))
+		    !strncmp(dev_info_serial_to_isw(rd->di->serial, isw_serial),
+			     serial, MAX_RAID_SERIAL_LEN))
 			return rd;
 	}
 
@@ -993,7 +1215,7 @@ static struct isw *
 update_metadata_after_rebuild(struct lib_context *lc, struct raid_set *rs)
 {
 	struct raid_dev *rd = list_entry(rs->devs.next, struct raid_dev, devs);
-	struct isw *old_isw = META(rd, isw), *new_isw;
+	struct isw *old_isw, *new_isw;
 	struct isw_dev *old_vol0 = NULL, *old_vol1 = NULL, *vol_rebuilt = NULL;
 	int vol_rebuilt_idx;
 	int remove_disk;
@@ -1001,6 +1223,9 @@ update_metadata_after_rebuild(struct lib_context *lc, struct raid_set *rs)
 	unsigned old_isw_offs, new_isw_offs;
 	unsigned i;
 
+	/* The volume being rebuilt gets changed below. */
+	if (!(old_isw = unshare_isw(lc, rd)))
+		return NULL;
 
 	old_vol0 = raiddev(old_isw, 0);
 	if (old_isw->num_raid_devs > 1)
@@ -1156,7 +1381,7 @@ number_disks_status(struct lib_context *lc, struct raid_set *rs)
 			}
 		}
 
-		rd->status = status;
+		set_rd_status(lc, rd, status);
 	}
 
 	return status;
@@ -1199,13 +1424,13 @@ get_rs_status(struct lib_context *lc, struct raid_set *rs)
 		if ((dev->vol.migr_state == 1) &&
 		    (dev->vol.migr_type == 1)) {
 			nosync_qan++;
-			check_rd->status = s_nosync;
+			set_rd_status(lc, check_rd, s_nosync);
 		} else if (dev->vol.map[0].map_state == ISW_T_STATE_DEGRADED) {
 			/* If array is marked as degraded. */
 			inconsist_qan++;
-			check_rd->status = s_inconsistent;
+			set_rd_status(lc, check_rd, s_inconsistent);
 		} else /* if everything is ok. */
-			check_rd->status = s_ok;
+			set_rd_status(lc, check_rd, s_ok);
 	}
 
 	/* Set status of whole raid set. */
@@ -1290,26 +1515,15 @@ get_number_of_devices(struct lib_context *lc, struct raid_set *rs)
 static int
 get_device_idx(struct lib_context *lc, struct raid_dev *rd)
 {
-	int i;
 	struct isw *isw;
-	const char *serial;
+	struct isw_disk *disk;
 
 	if (!rd)
 		return -1;
 
-	isw = META(rd, isw);
-	serial = dev_info_serial_to_isw(rd->di->serial);
-
-	/* Find the index of the disk. */
-	for (i = 0; i < isw->num_disks; i++) {
-		/* Check if the disk is listed. */
-		if (!strncmp(serial, (const char *) isw->disk[i].serial,
-			     MAX_RAID_SERIAL_LEN))
-			return i;
-	}
-
 	/* Zero based device index. */
-	return -1;
+	isw = META(rd, isw);
+	return (disk = _get_disk(lc, isw, rd->di)) ? disk - isw->disk : -1;
 }
 
 /* isw metadata handler routine. */
@@ -1332,9 +1546,14 @@ isw_metadata_handler(struct lib_context *lc, enum handler_commands command,
 
 		/* Embed the new metadata on disks. */
 		list_for_each_entry(rd, &rs->devs, devs) {
+			if (!(isw = alloc_private(lc, handler,
+						  isw_size(new_isw))))
+				return 0;
+
+			memcpy(isw, new_isw, new_isw->mpb_size);
+			free_meta(lc, rd->meta_areas->area);
+			rd->meta_areas->area = isw;
 			set_metadata_sizoff(rd, isw_size(new_isw));
-			memcpy(rd->meta_areas->area, new_isw,
-			       new_isw->mpb_size);
 
 			/* FIXME: use fmt->write from metadata.c instead ? */
 			/* FIXME: log update. */
@@ -1522,7 +1741,7 @@ check_capability(struct raid_set *rs)
 }
 
 static int
-match_hd_array(struct raid_set *rs, struct isw *isw)
+match_hd_array(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 {
 	int broken = 0, found = 0; // , i = isw->num_disks;
 //	struct isw_disk *disk = isw->disk;
@@ -1536,7 +1755,7 @@ match_hd_array(struct raid_set *rs, struct isw *isw)
 */
 
 	list_for_each_entry(rd, &rs->devs, devs) {
-		if (_get_disk(isw, rd->di))
+		if (_get_disk(lc, isw, rd->di))
 			found++;
 	}
 
@@ -1552,44 +1771,24 @@ is_hd_array_available(struct lib_context *lc, struct raid_set *rs)
 		list_for_each_entry(rd2, LC_RD(lc), list) {
 			if (!strcmp(rd1->di->path, rd2->di->path) &&
 			    rd1->fmt == rd2->fmt)
-				return match_hd_array(rs, META(rd2, isw));
+				return match_hd_array(lc, rs, META(rd2, isw));
 		}
 	}
 
 	return 0;
 }
 
-/* Retrieve and make up SCSI ID. */
-static unsigned
-get_scsiId(struct lib_context *lc, char *path)
-{
-	int fd;
-	Sg_scsi_id sg_id;
-
-	memset(&sg_id, 0, sizeof(sg_id));
-
-	if ((fd = open(path, O_RDONLY)) == -1)
-		return UNKNOWN_SCSI_ID;
-
-	if (!get_scsi_id(lc, fd, &sg_id)) {
-		close(fd);
-		return UNKNOWN_SCSI_ID;
-	}
-
-	close(fd);
-	return (sg_id.host_no << 16) | (sg_id.scsi_id << 8) | sg_id.lun;
-}
-
 static int
 isw_config_disks(struct lib_context *lc, struct isw_disk *disk,
 		 struct raid_set *rs)
 {
 	int i = 0;
+	char isw_serial[ISW_SERIAL_SIZE];
 	struct raid_dev *rd;
 
 	list_for_each_entry(rd, &rs->devs, devs) {
-		strncpy((char *) disk[i].serial, 
-			dev_info_serial_to_isw(rd->di->serial),
+		strncpy((char *) disk[i].serial,
+			dev_info_serial_to_isw(rd->di->serial, isw_serial),
 			MAX_RAID_SERIAL_LEN);
 		disk[i].totalBlocks = rd->di->sectors;
 
@@ -1808,7 +2007,8 @@ isw_config_dev(struct lib_context *lc, struct raid_set *rs,
 }
 
 static void
-display_new_volume(struct raid_set *rs, struct isw *isw, struct isw_dev *dev)
+display_new_volume(struct lib_context *lc, struct raid_set *rs,
+		   struct isw *isw, struct isw_dev *dev)
 {
 	enum type rt;
 	const char *type_name = NULL;
@@ -1855,7 +2055,7 @@ display_new_volume(struct raid_set *rs, struct isw *isw, struct isw_dev *dev)
 	}
 
 	list_for_each_entry(r, &rs->devs, devs) {
-		if (_get_disk(isw, r->di))
+		if (_get_disk(lc, isw, r->di))
 			printf("%s%s ", r->di->path,
 			       rs->type == ISW_T_SPARE ? "" : ",");
 	}
@@ -1905,7 +2105,7 @@ _isw_create_first_volume(struct lib_context *lc, struct raid_set *rs)
 				    (isw->num_disks - 1);
 	}
 
-	display_new_volume(rs, isw, dev);
+	display_new_volume(lc, rs, isw, dev);
 
 	strncpy((char *) isw->sig, MPB_SIGNATURE, MPB_SIGNATURE_SIZE);
 	sig_version = _isw_get_version(lc, rs);
@@ -2006,7 +2206,7 @@ _isw_create_second_volume(struct lib_context *lc, struct raid_set *rs)
 			    sizeof(dev2->vol.map[0].disk_ord_tbl) *
 			    (isw->num_disks - 1);
 
-	display_new_volume(rs, isw, dev2);
+	display_new_volume(lc, rs, isw, dev2);
 
 	/* If new signature version is higher than the old one, replace it */
 	sig_version = _isw_get_version(lc, rs);
@@ -2055,7 +2255,7 @@ update_raidset(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 	list_for_each_entry(rd, &rs->devs, devs) {
 		if (rd->meta_areas) {
 			if (rd->meta_areas->area)
-				dbg_free(rd->meta_areas->area);
+				free_meta(lc, rd->meta_areas->area);
 
 			dbg_free(rd->meta_areas);
 		}
@@ -2079,14 +2279,20 @@ update_raidset(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 			return 0;
 	}
 
+	/* Members changed type. */
+	invalidate_geometry(lc);
+
 	if (rs->type != ISW_T_SPARE) {
+		char *n;
+
 		if (!(dev = get_raiddev(isw, rs->name)))
 			return 0;
 
-		dbg_free(rs->name);
 		rd = list_entry(rs->devs.next, struct raid_dev, devs);
-		if (!(rs->name = name(lc, rd, dev, N_VOLUME)))
+		if (!(n = name(lc, rd, dev, N_VOLUME)))
 			return 0;
+
+		rename_raid_set(lc, rs, n);
 	}
 
 	return 1;
@@ -2178,6 +2384,9 @@ isw_create(struct lib_context *lc, struct raid_set *rs)
 		raid_type = rs->type;
 		ret = _isw_create_raidset(lc, rs);
 		rs->type = raid_type;
+
+		/* Supersets may have cached sizes for the ISW type. */
+		invalidate_geometry(lc);
 	} else if (rs->status == s_nosync)
 		ret = update_metadata(lc, rs);
 
@@ -2379,6 +2588,7 @@ isw_erase_metadata(struct lib_context *lc, struct raid_set *rs)
 static int
 isw_write_all(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 {
+	int ret = 1;
 	struct raid_dev *rd, *r;
 	struct meta_areas ma = {
 		.size = isw_size(isw),
@@ -2392,15 +2602,18 @@ isw_write_all(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 	rd->type = t_raid0;	//dummy code
 	rd->areas = 1;
 
+	/* Update all members at once. */
+	queue_writes(lc);
 	list_for_each_entry(r, &rs->devs, devs) {
 		rd->di = r->di;
 		set_metadata_sizoff(rd, ma.size);
 		rd->fmt = r->fmt;
-		isw_write(lc, rd, 0);
+		if (!isw_write(lc, rd, 0))
+			ret = 0;
 	}
 
-	dbg_free(rd);
-	return 1;
+	arena_free(lc, rd, sizeof(*rd));
+	return ret ? flush_writes(lc) : cancel_writes(lc);
 }
 
 /* Remove an isw device. */
@@ -2690,10 +2903,23 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	struct raid_dev *rd = list_entry(rs->devs.next, struct raid_dev, devs);
 	struct raid_set *sub_rs = NULL;
 	struct dev_info *di = NULL;
-	struct isw *isw = META(rd, isw), *new_isw = NULL;
-	struct isw_disk *disk = isw->disk, *new_disk = NULL;
+	struct isw *isw, *new_isw = NULL;
+	struct isw_disk *disk, *new_disk = NULL, *d;
 	struct isw_dev *new_dev = NULL;
+	char isw_serial[ISW_SERIAL_SIZE];
+	uint8_t listed[UINT8_MAX + 1];
 
+	/* The failed disk gets marked below. */
+	if (!(isw = unshare_isw(lc, rd)))
+		return 0;
+
+	disk = isw->disk;
+	/* Mark the disks found in the system. */
+	memset(listed, 0, sizeof(listed));
+	list_for_each_entry(di, LC_DI(lc), list) {
+		if ((d = _get_disk(lc, isw, di)))
+			listed[d - disk] = 1;
+	}
 
 	/*
 	 * Find the index of the failed disk -
@@ -2702,12 +2928,8 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	i = isw->num_disks;
 	while (i--) {
 		/* Check if the disk is listed. */
-		list_for_each_entry(di, LC_DI(lc), list) {
-			if (!strncmp(dev_info_serial_to_isw(di->serial),
-				     (const char *) disk[i].serial,
-				     MAX_RAID_SERIAL_LEN))
-				goto goon;
-		}
+		if (listed[i])
+			continue;
 
 		/* Disk not found in system, i.e. it's the failed one. */
 		failed_disk_idx = i;
@@ -2717,8 +2939,6 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 		disk[i].scsiId = UNKNOWN_SCSI_ID;
 		disk[i].status &= ~USABLE_DISK;
 		disk[i].status |= FAILED_DISK;
-	      goon:
-		;
 	}
 
 	/* We must have one failed disk */
@@ -2806,7 +3026,8 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	new_disk->status = CONFIG_ON_DISK |
 		DISK_SMART_EVENT_SUPPORTED |
 		CLAIMED_DISK | DETECTED_DISK | USABLE_DISK | CONFIGURED_DISK;
-	strncpy((char *) new_disk->serial, dev_info_serial_to_isw(di->serial),
+	strncpy((char *) new_disk->serial,
+		dev_info_serial_to_isw(di->serial, isw_serial),
 		MAX_RAID_SERIAL_LEN);
 
 	/* build new isw_disk array */
@@ -2856,7 +3077,7 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	list_for_each_entry(rd, &sub_rs->devs, devs) {
 		if (rd->meta_areas && rd->meta_areas->area) {
 
-			dbg_free(rd->meta_areas->area);
+			free_meta(lc, rd->meta_areas->area);
 		}
 
 		if (!rd->meta_areas || rd->status == s_init) {
@@ -2888,7 +3109,7 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 		set_metadata_sizoff(rd, isw_size(new_isw));
 
 		if (rd->status == s_init) {
-			rd->status = s_ok;
+			set_rd_status(lc, rd, s_ok);
 			if (rd->name)
 				dbg_free(rd->name);
 
@@ -2896,16 +3117,16 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 				goto bad_free_new_disk;
 		}
 
-		rd->status = s_ok;
+		set_rd_status(lc, rd, s_ok);
 	}
 
 	list_for_each_entry(rd, &rs->devs, devs) {
 		if (rd->meta_areas && rd->meta_areas->area)
-			dbg_free(rd->meta_areas->area);
+			free_meta(lc, rd->meta_areas->area);
 
 		if (!rd->meta_areas || rd->status == s_init) {
 			if (rd->meta_areas && rd->meta_areas->area)
-				dbg_free(rd->meta_areas->area);
+				free_meta(lc, rd->meta_areas->area);
 
 			rd->meta_areas = alloc_meta_areas(lc, rd, handler, 1);
 			if (!rd->meta_areas)
@@ -2937,13 +3158,15 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 			 */
 		}
 
-		rd->status = s_ok;
+		set_rd_status(lc, rd, s_ok);
 	}
 
 	/* FIXME: code commented out
 	   change_set_name(lc, LC_RS(lc), rs->name, new_name);
 	 */
 
+	/* Members got resized. */
+	invalidate_geometry(lc);
 	ret = 1;
 bad_free_new_disk:
 	dbg_free(new_disk);
@@ -2973,17 +3196,14 @@ setup_rd(struct lib_context *lc, struct raid_dev *rd,
 	struct isw *isw = meta;
 	struct isw_disk *disk;
 
-
-	/* Superblock checksum */
-	if (isw->check_sum != _checksum(isw))
-		LOG_ERR(lc, 0, "%s: extended superblock for %s "
-			"has wrong checksum", handler, di->path);
-
+	/* Superblock checksum got checked when the image got shared. */
 	if (!(rd->meta_areas = alloc_meta_areas(lc, rd, handler, 1)))
 		return 0;
 
-	rd->meta_areas->offset = info->u64 >> 9;
+	/* Extended metadata sits ahead of the first block found. */
 	rd->meta_areas->size = isw_size(isw);
+	rd->meta_areas->offset = (info->u64 >> 9) -
+				 rd->meta_areas->size / ISW_DISK_BLOCK_SIZE + 1;
 	rd->meta_areas->area = isw;
 
 	rd->di = di;
@@ -3002,6 +3222,5 @@ setup_rd(struct lib_context *lc, struct raid_dev *rd,
 	else
 		rd->type = t_group;
 
-	disk->scsiId = get_scsiId(lc, di->path);
 	return (rd->name = name(lc, rd, NULL, N_NUMBER)) ? 1 : 0;
 }
@@ -83,11 +83,7 @@ type(struct jm *jm)
 static int
 checksum(struct jm *jm)
 {
-	int count = 64;
-	uint16_t *p = (uint16_t *) jm, sum = 0;
-
-	while (count--)
-		sum += *p++;
+	uint16_t sum = sum16(jm, 64);
 
 	/* FIXME: shouldn't this be one value only ? */
 	return !sum || sum == 1;
@@ -159,14 +155,14 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	if (!init_raid_set(lc, rs, rd, stride(jm->block), jm->mode, handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 
 	switch (jm->mode) {
 	case JM_T_JBOD:
 	case JM_T_RAID0:
 	case JM_T_RAID1:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 		break;
 
 	case JM_T_RAID01:
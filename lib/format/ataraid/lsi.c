@@ -199,13 +199,13 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	if (!init_raid_set(lc, rs, rd, lsi->stride, type(lsi), handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 
 	switch (lsi->type) {
 	case LSI_T_RAID0:
 	case LSI_T_RAID1:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 		break;
 
 	case LSI_T_RAID10:
@@ -184,14 +184,12 @@ to_cpu(void *meta)
 static int
 checksum(struct nv *nv)
 {
-	uint32_t sum = 0;
-	unsigned int s = nv->size;
+	uint32_t sum;
 
-	if (s != sizeof(*nv) / sizeof(sum))
+	if (nv->size != sizeof(*nv) / sizeof(sum))
 		return 0;
 
-	while (s--)
-		sum += ((uint32_t *) nv)[s];
+	sum = sum32(nv, nv->size);
 
 	/* Ignore chksum member itself. */
 	return nv->chksum - sum == nv->chksum;
@@ -256,7 +254,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 			   NV_RAIDLEVEL(nv), handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev_deferred(lc, rs, rd, dev_sort);
 
 	switch (NV_RAIDLEVEL(nv)) {
 	case NV_LEVEL_JBOD:
@@ -264,7 +262,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	case NV_LEVEL_1:
 	case NV_LEVEL_5_SYM:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 		break;
 
 	case NV_LEVEL_1_0:
@@ -104,16 +104,54 @@ type(struct pdc *pdc)
 static uint32_t
 checksum(struct pdc *pdc)
 {
-	unsigned i = 511, sum = 0;
-	uint32_t *p = (uint32_t *) pdc;
-
-	while (i--)
-		sum += *p++;
+	return sum32(pdc, 511) == pdc->checksum;
+}
+
+/* Ondisk metadata layout. */
+#if	BYTE_ORDER != LITTLE_ENDIAN || defined(DMRAID_NATIVE_LOG)
+static const struct meta_field pdc_fields[] = {
+	MF(pdc, promise_id, MF_STR),
+	MF(pdc, unknown_0, MF_HEXDEC),
+	MF(pdc, magic_0, MF_HEX),
+	MF(pdc, unknown_1, MF_HEXDEC),
+	MF(pdc, magic_1, MF_HEX),
+	MF(pdc, unknown_2, MF_HEXDEC),
+	MF(pdc, raid.flags, MF_HEX),
+	MF(pdc, raid.unknown_0, MF_HEXDEC),
+	MF(pdc, raid.disk_number, MF_DEC),
+	MF(pdc, raid.channel, MF_DEC),
+	MF(pdc, raid.device, MF_DEC),
+	MF(pdc, raid.magic_0, MF_HEX),
+	MF(pdc, raid.unknown_1, MF_HEXDEC),
+	MF(pdc, raid.start, MF_HEXDEC),
+	MF(pdc, raid.disk_secs, MF_DEC),
+	MF(pdc, raid.unknown_3, MF_HEXDEC),
+	MF(pdc, raid.unknown_4, MF_HEXDEC),
+	MF(pdc, raid.status, MF_HEX),
+	MF(pdc, raid.type, MF_HEX),
+	MF(pdc, raid.total_disks, MF_DEC),
+	MF(pdc, raid.raid0_shift, MF_DEC),
+	MF(pdc, raid.raid0_disks, MF_DEC),
+	MF(pdc, raid.array_number, MF_DEC),
+	MF(pdc, raid.total_secs, MF_DEC),
+	MF(pdc, raid.cylinders, MF_DEC),
+	MF(pdc, raid.heads, MF_DEC),
+	MF(pdc, raid.sectors, MF_DEC),
+	MF(pdc, raid.magic_1, MF_HEX),
+	MF(pdc, raid.unknown_5, MF_HEXDEC),
+	MF_END,
+};
 
-	return sum == pdc->checksum;
-}
+static const struct meta_field pdc_disk_fields[] = {
+	MF_NAMED("raid.disk[%u].unknown_0", pdc_disk, unknown_0, MF_HEX),
+	MF_NAMED("raid.disk[%u].channel", pdc_disk, channel, MF_DEC),
+	MF_NAMED("raid.disk[%u].device", pdc_disk, device, MF_DEC),
+	MF_NAMED("raid.disk[%u].magic_0", pdc_disk, magic_0, MF_HEX),
+	MF_NAMED("raid.disk[%u].disk_number", pdc_disk, disk_number, MF_DEC),
+	MF_END,
+};
+#endif
 
-/* Calculate metadata offset. */
 /*
  * Read a Promise FastTrak RAID device
  */
@@ -127,20 +165,11 @@ to_cpu(void *meta)
 	struct pdc *pdc = meta;
 	struct pdc_disk *disk;
 
-	CVT32(pdc->magic_0);
-	CVT32(pdc->magic_1);
-	CVT32(pdc->raid.flags);
-	CVT32(pdc->raid.magic_0);
-	CVT32(pdc->raid.disk_secs);
-	CVT32(pdc->raid.total_secs);
-	CVT16(pdc->raid.cylinders);
-	CVT32(pdc->raid.magic_1);
+	meta_to_cpu(pdc, pdc_fields);
 
 	for (disk = pdc->raid.disk;
-	     disk < pdc->raid.disk + pdc->raid.total_disks; disk++) {
-		CVT32(disk->magic_0);
-		CVT32(disk->disk_number);
-	}
+	     disk < pdc->raid.disk + pdc->raid.total_disks; disk++)
+		meta_to_cpu(disk, pdc_disk_fields);
 }
 #endif
 
@@ -352,12 +381,12 @@ _create_rd(struct lib_context *lc, struct raid_dev *rd,
 	if (!(r->meta_areas = alloc_meta_areas(lc, r, handler, 1)))
 		goto bad_free;
 
-	/* Allocate private metadata area so that free_raid_dev() succeeds. */
-	r->meta_areas->area = alloc_private(lc, handler, sizeof(*pdc));
+	/* View into the parents metadata areas so that free_raid_dev() works. */
+	r->meta_areas->area = view_meta(lc, handler, rd->meta_areas->area,
+					PDC_MAX_META_AREAS * sizeof(*pdc), pdc);
 	if (!r->meta_areas->area)
 		goto bad_free;
 
-	memcpy(r->meta_areas->area, pdc, sizeof(*pdc));
 	r->meta_areas->size = sizeof(*pdc);
 	r->meta_areas->offset = rd->meta_areas->offset + idx * PDC_META_OFFSET;
 
@@ -391,14 +420,14 @@ _group_rd(struct lib_context *lc, struct raid_set *rs,
 	if (!init_raid_set(lc, rs, rd, stride(pdc), pdc->raid.type, handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev_deferred(lc, rs, rd, dev_sort);
 
 	switch (pdc->raid.type) {
 	case PDC_T_SPAN:
 	case PDC_T_RAID0:
 	case PDC_T_RAID1:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 		break;
 
@@ -550,53 +579,10 @@ _pdc_log(struct lib_context *lc, struct dev_info *di, struct pdc *pdc)
 
 	while (ma) {
 		log_print(lc, "%s (%s):", di->path, handler);
-		DP("promise_id: \"%s\"", pdc, pdc->promise_id);
-		P("unknown_0: 0x%x %u",
-		  pdc, pdc->unknown_0, pdc->unknown_0, pdc->unknown_0);
-		DP("magic_0: 0x%x", pdc, pdc->magic_0);
-		P("unknown_1: 0x%x %u",
-		  pdc, pdc->unknown_1, pdc->unknown_1, pdc->unknown_1);
-		DP("magic_1: 0x%x", pdc, pdc->magic_1);
-		P("unknown_2: 0x%x %u",
-		  pdc, pdc->unknown_2, pdc->unknown_2, pdc->unknown_2);
-		DP("raid.flags: 0x%x", pdc, pdc->raid.flags);
-		P("raid.unknown_0: 0x%x %d",
-		  pdc, pdc->raid.unknown_0, pdc->raid.unknown_0, pdc->raid.unknown_0);
-		DP("raid.disk_number: %u", pdc, pdc->raid.disk_number);
-		DP("raid.channel: %u", pdc, pdc->raid.channel);
-		DP("raid.device: %u", pdc, pdc->raid.device);
-		DP("raid.magic_0: 0x%x", pdc, pdc->raid.magic_0);
-		P("raid.unknown_1: 0x%x %u",
-		  pdc, pdc->raid.unknown_1, pdc->raid.unknown_1, pdc->raid.unknown_1);
-		P("raid.start: 0x%x %u",
-		  pdc, pdc->raid.start, pdc->raid.start, pdc->raid.start);
-		DP("raid.disk_secs: %u", pdc, pdc->raid.disk_secs);
-		P("raid.unknown_3: 0x%x %u",
-		  pdc, pdc->raid.unknown_3, pdc->raid.unknown_3, pdc->raid.unknown_3);
-		P("raid.unknown_4: 0x%x %u",
-		  pdc, pdc->raid.unknown_4, pdc->raid.unknown_4, pdc->raid.unknown_4);
-		DP("raid.status: 0x%x", pdc, pdc->raid.status);
-		DP("raid.type: 0x%x", pdc, pdc->raid.type);
-		DP("raid.total_disks: %u", pdc, pdc->raid.total_disks);
-		DP("raid.raid0_shift: %u", pdc, pdc->raid.raid0_shift);
-		DP("raid.raid0_disks: %u", pdc, pdc->raid.raid0_disks);
-		DP("raid.array_number: %u", pdc, pdc->raid.array_number);
-		DP("raid.total_secs: %u", pdc, pdc->raid.total_secs);
-		DP("raid.cylinders: %u", pdc, pdc->raid.cylinders);
-		DP("raid.heads: %u", pdc, pdc->raid.heads);
-		DP("raid.sectors: %u", pdc, pdc->raid.sectors);
-		DP("raid.magic_1: 0x%x", pdc, pdc->raid.magic_1);
-		P("raid.unknown_5: 0x%x %u",
-		  pdc, pdc->raid.unknown_5, pdc->raid.unknown_5, pdc->raid.unknown_5);
-
+		log_meta(lc, pdc, pdc, pdc_fields, 0);
 		for (disk = pdc->raid.disk, i = 0;
-		     i < pdc->raid.total_disks; disk++, i++) {
-			P2("raid.disk[%d].unknown_0: 0x%x", pdc, i, disk->unknown_0);
-			P2("raid.disk[%d].channel: %u", pdc, i, disk->channel);
-			P2("raid.disk[%d].device: %u", pdc, i, disk->device);
-			P2("raid.disk[%d].magic_0: 0x%x", pdc, i, disk->magic_0);
-			P2("raid.disk[%d].disk_number: %u", pdc, i, disk->disk_number);
-		}
+		     i < pdc->raid.total_disks; disk++, i++)
+			log_meta(lc, pdc, disk, pdc_disk_fields, i);
 
 		P("checksum: 0x%x %s", pdc, pdc->checksum, pdc->checksum,
 		  checksum(pdc) ? "Ok" : "BAD");
@@ -92,12 +92,7 @@ type(struct sil *sil)
 static int
 checksum(struct sil *sil)
 {
-	int sum = 0;
-	unsigned short count = struct_offset(sil, checksum1) / 2;
-	uint16_t *p = (uint16_t *) sil;
-
-	while (count--)
-		sum += *p++;
+	uint16_t sum = sum16(sil, struct_offset(sil, checksum1) / 2);
 
 	return (-sum & 0xFFFF) == sil->checksum1;
 }
@@ -337,7 +332,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	if (!init_raid_set(lc, rs, rd, sil->raid0_stride, sil->type, handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 
 	switch (sil->type) {
 	case SIL_T_JBOD:
@@ -345,7 +340,7 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 	case SIL_T_RAID1:
 	case SIL_T_RAID5:
 		if (!(find_set(lc, NULL, rs->name, FIND_TOP)))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 		break;
 
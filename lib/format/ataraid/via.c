@@ -145,12 +145,7 @@ to_cpu(void *meta)
 static uint8_t
 checksum(struct via *via)
 {
-	uint8_t i = 50, sum = 0;
-
-	while (i--)
-		sum += ((uint8_t *) via)[i];
-
-	return sum == via->checksum;
+	return (uint8_t) sum8(via, 50) == via->checksum;
 }
 
 static int
@@ -223,14 +218,14 @@ group_rd(struct lib_context *lc, struct raid_set *rs,
 			   VIA_RAID_TYPE(via), handler))
 		return 0;
 
-	list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+	link_raid_dev(lc, rs, rd, dev_sort);
 
 	switch (VIA_RAID_TYPE(via)) {
 	case VIA_T_SPAN:
 	case VIA_T_RAID0:
 	case VIA_T_RAID1:
 		if (!find_set(lc, NULL, rs->name, FIND_TOP))
-			list_add_tail(&rs->list, LC_RS(lc));
+			link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 		break;
 
@@ -10,6 +10,7 @@
  * See file LICENSE at the top of this source tree for license information.
  */
 
+#include <sys/uio.h>
 #include "internal.h"
 
 #define	FORMAT_HANDLER
@@ -55,38 +56,254 @@ disk_status(struct ddf1_phys_drive *disk)
 	return disk ? rd_status(states, disk->state, AND) : s_undef;
 }
 
+/*
+ * Lookup index built once per shared image of the global sections (see
+ * parse_global()), after they have been converted to CPU format, to avoid
+ * scanning the PD, VD and config record tables on every lookup.
+ *
+ * The PD and VD hashes are open addressed and keep table index + 1
+ * with 0 marking an empty slot.  cfg_refs keeps the config record/element
+ * pairs each PD table entry is part of in config record order; the ones
+ * of PD table entry i are cfg_refs[cfg_start[i]] to cfg_refs[cfg_start[i+1]].
+ */
+struct ddf1_cfg_ref {
+	unsigned int cr;	/* Config record index */
+	unsigned int element;	/* Element index within the config record */
+};
+
+struct ddf1_index {
+	unsigned int pds, vds;		/* PD/VD table entries indexed */
+	unsigned int pd_mask, vd_mask;
+	unsigned int *pd_hash, *vd_hash;
+	unsigned int *cfg_start;
+	struct ddf1_cfg_ref *cfg_refs;
+};
+
+static inline unsigned int
+hash_reference(uint32_t reference)
+{
+	reference ^= reference >> 16;
+	reference *= 0x45d9f3b;
+	return reference ^ (reference >> 16);
+}
+
 /*
  * Compare two GUIDs.  For some reason, Adaptec sometimes writes 0xFFFFFFFF
  * as the last four bytes (ala DDF2) and sometimes writes real data.
  * For now we'll compare the first twenty and only the last four if
  * both GUIDs don't have 0xFFFFFFFF in bytes 20-23.  Gross.
+ *
+ * Hence only the first twenty bytes are hashed.
  */
-/* Find this drive's physical data */
-static struct ddf1_phys_drive *
-get_phys_drive(struct ddf1 *ddf1)
+static inline unsigned int
+hash_guid(uint8_t *guid)
+{
+	unsigned int i, h = 2166136261U;
+
+	for (i = 0; i < DDF1_GUID_LENGTH - 4; i++)
+		h = (h ^ guid[i]) * 16777619U;
+
+	return h;
+}
+
+/* Hash size for n entries: power of 2 at least twice n. */
+static unsigned int
+hash_size(unsigned int n)
+{
+	unsigned int r = 8;
+
+	while (r < 2 * n)
+		r <<= 1;
+
+	return r;
+}
+
+static void
+hash_insert(unsigned int *hash, unsigned int mask, unsigned int h,
+	    unsigned int i)
+{
+	while (hash[h & mask])
+		h++;
+
+	hash[h & mask] = i + 1;
+}
+
+/*
+ * Find a PD table entry by reference.
+ *
+ * Like the table scans this replaces, the highest matching
+ * table index wins in case of duplicates.
+ */
+static int
+find_phys_drive(struct ddf1 *ddf1, uint32_t reference)
+{
+	struct ddf1_index *idx = ddf1->index;
+	unsigned int h = hash_reference(reference), i;
+	int ret = -ENOENT;
+
+	while ((i = idx->pd_hash[h++ & idx->pd_mask])) {
+		if (ddf1->pds[i - 1].reference == reference &&
+		    (int) i - 1 > ret)
+			ret = i - 1;
+	}
+
+	return ret;
+}
+
+/* Number of table entries in a section with header hdr of len sectors. */
+static unsigned int
+table_entries(uint32_t len, size_t hdr, size_t entry, unsigned int n)
+{
+	uint64_t size = to_bytes(len);
+
+	return size < hdr ? 0 : min(n, (size - hdr) / entry);
+}
+
+/* Return the number of config record elements of a VD config record. */
+static inline unsigned int
+cr_elements(struct ddf1 *ddf1, struct ddf1_config_record *cr)
+{
+	return cr->signature == DDF1_VD_CONFIG_REC ?
+		min(cr->primary_element_count,
+		    ddf1_cr_off_maxpds_helper(ddf1)) : 0;
+}
+
+/* Return the size of the lookup index and its table sizes. */
+static size_t
+index_size(struct ddf1 *ddf1, unsigned int *pds, unsigned int *vds,
+	   unsigned int *elements)
+{
+	unsigned int i = NUM_CONFIG_ENTRIES(ddf1);
+
+	*pds = table_entries(ddf1->primary->phys_drive_len,
+			     sizeof(*ddf1->pd_header), sizeof(*ddf1->pds),
+			     ddf1->pd_header->max_drives);
+	*vds = table_entries(ddf1->primary->virt_drive_len,
+			     sizeof(*ddf1->vd_header), sizeof(*ddf1->vds),
+			     ddf1->vd_header->num_drives);
+
+	/* Upper bound for the config record references. */
+	*elements = 0;
+	while (i--)
+		*elements += cr_elements(ddf1, CR(ddf1, i));
+
+	return sizeof(struct ddf1_index) +
+		(hash_size(*pds) + hash_size(*vds) + *pds + 1) *
+		sizeof(unsigned int) +
+		*elements * sizeof(struct ddf1_cfg_ref);
+}
+
+/* Build the lookup index in idx, which got sized by index_size(). */
+static void
+build_index(struct ddf1 *ddf1, struct ddf1_index *idx)
 {
-	unsigned int i = ddf1->pd_header->max_drives;
+	int p;
+	unsigned int cfgs = NUM_CONFIG_ENTRIES(ddf1), i, j, n, elements,
+		     pds, vds;
+	uint32_t *ids;
+	struct ddf1_config_record *cr;
 
-	while (i--) {
-		if (ddf1->pds[i].reference == ddf1->disk_data->reference)
-			return ddf1->pds + i;
+	index_size(ddf1, &pds, &vds, &elements);
+	idx->pds = pds;
+	idx->vds = vds;
+	idx->pd_mask = hash_size(pds) - 1;
+	idx->vd_mask = hash_size(vds) - 1;
+	idx->cfg_refs = (struct ddf1_cfg_ref *) (idx + 1);
+	idx->pd_hash = (unsigned int *) (idx->cfg_refs + elements);
+	idx->vd_hash = idx->pd_hash + idx->pd_mask + 1;
+	idx->cfg_start = idx->vd_hash + idx->vd_mask + 1;
+	ddf1->index = idx;
+
+	for (i = 0; i < pds; i++)
+		hash_insert(idx->pd_hash, idx->pd_mask,
+			    hash_reference(ddf1->pds[i].reference), i);
+
+	for (i = 0; i < vds; i++)
+		hash_insert(idx->vd_hash, idx->vd_mask,
+			    hash_guid(ddf1->vds[i].guid), i);
+
+	/*
+	 * Count config record references per PD table entry,
+	 * turn the counts into start indexes and fill the references in.
+	 * Filling moves each start index to the next one's,
+	 * which gets shifted back afterwards.
+	 */
+	for (i = 0; i < cfgs; i++) {
+		cr = CR(ddf1, i);
+		ids = CR_IDS(ddf1, cr);
+		for (j = 0, n = cr_elements(ddf1, cr); j < n; j++) {
+			if ((p = find_phys_drive(ddf1, ids[j])) > -1)
+				idx->cfg_start[p + 1]++;
+		}
 	}
 
-	return NULL;
+	for (i = 0; i < pds; i++)
+		idx->cfg_start[i + 1] += idx->cfg_start[i];
+
+	for (i = 0; i < cfgs; i++) {
+		cr = CR(ddf1, i);
+		ids = CR_IDS(ddf1, cr);
+		for (j = 0, n = cr_elements(ddf1, cr); j < n; j++) {
+			if ((p = find_phys_drive(ddf1, ids[j])) > -1) {
+				idx->cfg_refs[idx->cfg_start[p]].cr = i;
+				idx->cfg_refs[idx->cfg_start[p]++].element = j;
+			}
+		}
+	}
+
+	for (i = pds; i; i--)
+		idx->cfg_start[i] = idx->cfg_start[i - 1];
+
+	idx->cfg_start[0] = 0;
+}
+
+/* Find this drive's physical data */
+static void
+find_this_drive(struct ddf1 *ddf1)
+{
+	int p = find_phys_drive(ddf1, ddf1->disk_data->reference);
+
+	ddf1->pd = p < 0 ? NULL : ddf1->pds + p;
+}
+
+/* Return this drive's physical data */
+static inline struct ddf1_phys_drive *
+get_phys_drive(struct ddf1 *ddf1)
+{
+	return ddf1->pd;
 }
 
 /* Find the virtual drive that goes with this config record */
 static struct ddf1_virt_drive *
 get_virt_drive(struct ddf1 *ddf1, struct ddf1_config_record *cr)
 {
-	int i = ddf1->vd_header->num_drives;
+	struct ddf1_index *idx = ddf1->index;
+	unsigned int h = hash_guid(cr->guid), i;
+	int ret = -ENOENT;
+
+	while ((i = idx->vd_hash[h++ & idx->vd_mask])) {
+		if (!guidcmp(ddf1->vds[i - 1].guid, cr->guid) &&
+		    (int) i - 1 > ret)
+			ret = i - 1;
+	}
+
+	return ret < 0 ? NULL : ddf1->vds + ret;
+}
+
+/* Return the config record references of a PD table entry. */
+static struct ddf1_cfg_ref *
+get_cfg_refs(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int *n)
+{
+	struct ddf1_index *idx = ddf1->index;
+	unsigned int i = pd - ddf1->pds;
 
-	while (i--) {
-		if (!guidcmp(ddf1->vds[i].guid, cr->guid))
-			return ddf1->vds + i;
+	if (i >= idx->pds) {
+		*n = 0;
+		return NULL;
 	}
 
-	return NULL;
+	*n = idx->cfg_start[i + 1] - idx->cfg_start[i];
+	return idx->cfg_refs + idx->cfg_start[i];
 }
 
 /*
@@ -96,22 +313,12 @@ static int
 get_config_byoffset(struct ddf1 *ddf1, struct ddf1_phys_drive *pd,
 		    uint64_t offset)
 {
-	int cfgs = NUM_CONFIG_ENTRIES(ddf1), i;
-	uint32_t *cfg_drive_ids, j;
-	uint64_t *cfg_drive_offsets;
-	struct ddf1_config_record *cfg;
+	unsigned int n;
+	struct ddf1_cfg_ref *r = get_cfg_refs(ddf1, pd, &n);
 
-	for (i = 0; i < cfgs; i++) {
-		cfg = CR(ddf1, i);
-		if (cfg->signature == DDF1_VD_CONFIG_REC) {
-			cfg_drive_ids = CR_IDS(ddf1, cfg);
-			cfg_drive_offsets = CR_OFF(ddf1, cfg);
-			for (j = 0; j < cfg->primary_element_count; j++) {
-				if (cfg_drive_ids[j] == pd->reference &&
-				    cfg_drive_offsets[j] == offset)
-					return i;
-			}
-		}
+	for (; n--; r++) {
+		if (CR_OFF(ddf1, CR(ddf1, r->cr))[r->element] == offset)
+			return r->cr;
 	}
 
 	return -ENOENT;
@@ -119,25 +326,12 @@ get_config_byoffset(struct ddf1 *ddf1, struct ddf1_phys_drive *pd,
 
 /* Find the index of the nth VD config record for this physical drive. */
 static int
-get_config_index(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int *n)
+get_config_index(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int n)
 {
-	int cfgs = NUM_CONFIG_ENTRIES(ddf1), i, j, nn = *n;
-	uint32_t *ids;
-	struct ddf1_config_record *cr;
-
-	for (i = 0; i < cfgs; i++) {
-		cr = CR(ddf1, i);
-		if (cr->signature == DDF1_VD_CONFIG_REC) {
-			ids = CR_IDS(ddf1, cr);
-			for (j = 0; j < cr->primary_element_count; j++) {
-				if (ids[j] == pd->reference && !nn--)
-					return i;
-			}
-		}
-	}
+	unsigned int count;
+	struct ddf1_cfg_ref *r = get_cfg_refs(ddf1, pd, &count);
 
-	*n -= nn;
-	return nn < 0 ? -ENOENT : 0;
+	return n < count ? (int) r[n].cr : -ENOENT;
 }
 
 /*
@@ -146,7 +340,7 @@ get_config_index(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int *n)
 static inline struct ddf1_config_record *
 get_config(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int n)
 {
-	int i = get_config_index(ddf1, pd, &n);
+	int i = get_config_index(ddf1, pd, n);
 
 	return i < 0 ? NULL : CR(ddf1, i);
 }
@@ -155,10 +349,9 @@ get_config(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int n)
 static inline struct ddf1_config_record *
 get_this_config(struct ddf1 *ddf1, uint64_t offset)
 {
-	struct ddf1_phys_drive *pd = get_phys_drive(ddf1);
-	int i = get_config_byoffset(ddf1, pd, offset);
+	int i = get_config_byoffset(ddf1, get_phys_drive(ddf1), offset);
 
-	return i < 0 ? NULL : get_config(ddf1, pd, i);
+	return i < 0 ? NULL : CR(ddf1, i);
 }
 
 /* Find the config record disk/offset entry for this config/drive. */
@@ -166,14 +359,15 @@ static int
 get_offset_entry(struct ddf1 *ddf1, struct ddf1_config_record *cr,
 		 struct ddf1_phys_drive *pd)
 {
-	int i;
-	uint32_t *ids;
+	unsigned int i, n;
+	struct ddf1_cfg_ref *r;
 
 	if (cr) {
-		ids = CR_IDS(ddf1, cr);
-		for (i = 0; i < ddf1->primary->max_phys_drives; i++) {
-			if (ids[i] == pd->reference)
-				return i;
+		i = ((uint8_t *) cr - (uint8_t *) ddf1->cfg) /
+		    to_bytes(ddf1->primary->vd_config_record_len);
+		for (r = get_cfg_refs(ddf1, pd, &n); n--; r++) {
+			if (r->cr == i)
+				return r->element;
 		}
 	}
 
@@ -288,130 +482,278 @@ err_virt_drive(struct lib_context *lc, struct dev_info *di)
 }
 
 /*
- * Read a DDF1 RAID device.  Fields are little endian, so
- * need to convert them if we're on a BE machine (ppc, etc).
+ * Read a DDF header at lba and convert it.
+ *
+ * Returns NULL on a bad signature; *crc_ok tells
+ * if the header checksum matched its contents.
  */
-static int
-read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
+static struct ddf1_header *
+read_header(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1,
+	    uint64_t lba, const char *what, int *crc_ok)
 {
-	int i;
-	uint64_t where;
+	struct ddf1_header *h;
+
+	*crc_ok = 0;
+	if (lba == DDF1_NO_LBA ||
+	    !(h = alloc_private_and_read(lc, handler, sizeof(*h),
+					 di->path, to_bytes(lba))))
+		return NULL;
+
+	*crc_ok = ddf1_header_crc_ok(lc, ddf1, h);
+	ddf1_cvt_header(ddf1, h);
+	if (h->signature == DDF1_HEADER) {
+		if (!*crc_ok)
+			log_warn(lc, "%s: bad %s header CRC on %s",
+				 handler, what, di->path);
+
+		return h;
+	}
+
+	if (h->signature)
+		log_warn(lc, "%s: incorrect %s header signature %x on %s",
+			 handler, what, h->signature, di->path);
+
+	dbg_free(h);
+	return NULL;
+}
+
+/*
+ * Metadata section described by the header to be loaded.
+ *
+ * Sections are read in LBA order, adjacent ones
+ * merged into a single vectored read.
+ */
+struct ddf1_section {
+	uint64_t lba;
 	size_t size;
-	struct ddf1_header *pri, *sec;
-	struct ddf1_adapter *adap;
-	struct ddf1_disk_data *ddata;
-	struct ddf1_phys_drives *pd;
-	struct ddf1_virt_drives *vd;
+	void **ptr;
+};
 
+/* Maximum gap in sectors to read over when merging sections. */
+#define	DDF1_MERGE_GAP	8
 
-	/* Read the primary DDF header */
-	where = to_bytes(ddf1->anchor.primary_table_lba);
-	if (!(pri = ddf1->primary =
-	      alloc_private_and_read(lc, handler, sizeof(*pri),
-				     di->path, where)))
-		goto bad;
+/* Add a section starting at offset sectors into the table area. */
+static struct ddf1_section *
+add_section(struct ddf1_section *s, uint64_t base, uint32_t offset,
+	    size_t size, void **ptr)
+{
+	*ptr = NULL;
+	if (offset == DDF1_INVALID || !size)
+		return s;
+
+	s->lba = base + offset;
+	s->size = size;
+	s->ptr = ptr;
+	return s + 1;
+}
 
-	/* Read the secondary header. */
-	ddf1_cvt_header(ddf1, pri);
-	if (!(sec = ddf1->secondary = alloc_private(lc, handler, sizeof(*sec))))
-		goto bad;
+/* Sort sections by LBA (there's only a handful). */
+static void
+sort_sections(struct ddf1_section *s, unsigned int n)
+{
+	unsigned int i, j;
+	struct ddf1_section tmp;
 
-	where = to_bytes(ddf1->anchor.secondary_table_lba);
-	if (ddf1->anchor.secondary_table_lba != 0xFFFFFFFFFFFFFFFFULL &&
-	    !read_file(lc, handler, di->path, sec, sizeof(*sec), where))
-		goto bad;
+	for (i = 1; i < n; i++) {
+		for (tmp = s[i], j = i; j && s[j - 1].lba > tmp.lba; j--)
+			s[j] = s[j - 1];
 
-	ddf1_cvt_header(ddf1, sec);
-	if (pri->signature != DDF1_HEADER) {
-		log_warn(lc, "%s: incorrect primary header signature %x on",
-			 handler, pri->signature, di->path);
-		cond_free(ddf1->primary);
-		ddf1->primary = NULL;
-	};
+		s[j] = tmp;
+	}
+}
 
-	if (sec->signature == DDF1_HEADER) {
-		/* If we encounter an error, we use the secondary table */
-		if (!ddf1->primary) {
-			log_warn(lc, "%s: using secondary header on %s",
-				 handler, di->path);
-			ddf1->primary = ddf1->secondary;
-			ddf1->secondary = NULL;
+/* Allocate and read sections, merging adjacent ones into one I/O. */
+static int
+read_sections(struct lib_context *lc, struct dev_info *di,
+	      struct ddf1_section *s, unsigned int n)
+{
+	int ret = 0;
+	unsigned int i, iovcnt;
+	uint64_t end;
+	uint8_t *gap;
+	struct iovec iov[2 * DDF1_SECTIONS];
+	struct ddf1_section *run, *sec;
+
+	if (!(gap = alloc_private(lc, handler, to_bytes(DDF1_MERGE_GAP))))
+		return 0;
+
+	sort_sections(s, n);
+	for (i = 0; i < n; i++) {
+		if (s[i].lba + (s[i].size + DDF1_BLKSIZE - 1) / DDF1_BLKSIZE >
+		    di->sectors) {
+			log_err(lc, "%s: metadata section at %" PRIu64
+				" beyond end of %s", handler, s[i].lba,
+				di->path);
+			goto out;
 		}
-	} else {
-		if (sec->signature)
-			log_warn(lc, "%s: bad secondary header signature %x "
-				 "on %s", handler, sec->signature, di->path);
 
-		dbg_free(sec);
-		ddf1->secondary = NULL;
+		if (!(*s[i].ptr = alloc_private(lc, handler, s[i].size)))
+			goto out;
 	}
 
-	if (!ddf1->primary) {
-		log_error(lc, "%s: both header signatures bad on %s",
-			  handler, di->path);
-		goto bad;
-	}
+	for (run = s; run < s + n; run = sec) {
+		iovcnt = 0;
+		end = run->lba;
+		for (sec = run; sec < s + n; sec++) {
+			/* Never merge overlapping sections or big gaps. */
+			if (sec->lba < end ||
+			    sec->lba - end > DDF1_MERGE_GAP)
+				break;
+
+			if (sec->lba > end) {
+				iov[iovcnt].iov_base = gap;
+				iov[iovcnt++].iov_len = to_bytes(sec->lba - end);
+			}
 
-	/* Read the adapter data */
-	if (!(adap = ddf1->adapter = alloc_private(lc, handler, sizeof(*adap))))
-		goto bad;
+			iov[iovcnt].iov_base = *sec->ptr;
+			iov[iovcnt++].iov_len = sec->size;
+			end = sec->lba + sec->size / DDF1_BLKSIZE;
 
-	where = to_bytes(pri->primary_table_lba + pri->adapter_data_offset);
-	if (pri->adapter_data_offset != 0xFFFFFFFF &&
-	    !read_file(lc, handler, di->path, adap, sizeof(*adap), where))
-		goto bad;
+			/* Partial trailing sector ends the run. */
+			if (sec->size % DDF1_BLKSIZE) {
+				sec++;
+				break;
+			}
+		}
 
-	ddf1_cvt_adapter(ddf1, ddf1->adapter);
-	if (ddf1->adapter->signature != DDF1_ADAPTER_DATA) {
-		if (ddf1->adapter->signature)
-			log_warn(lc, "%s: incorrect adapter data signature %x "
-				 "on %s",
-				 handler, ddf1->adapter->signature, di->path);
-		dbg_free(ddf1->adapter);
-		ddf1->adapter = NULL;
+		if (!read_file_vec(lc, handler, di->path, iov, iovcnt,
+				   to_bytes(run->lba)))
+			goto out;
 	}
 
-	if (ddf1->adapter &&
-	    ddf1->adapter->pci_vendor == PCI_VENDOR_ID_ADAPTEC2) {
-		log_notice(lc, "%s: Adaptec mode discovered on %s",
-			   handler, di->path);
-		ddf1->adaptec_mode = 1;
+	ret = 1;
+
+out:
+	dbg_free(gap);
+	if (!ret) {
+		for (i = 0; i < n; i++) {
+			cond_free(*s[i].ptr);
+			*s[i].ptr = NULL;
+		}
 	}
 
-	/* Read physical drive characteristic data */
-	where = to_bytes(pri->primary_table_lba + pri->disk_data_offset);
-	if (!(ddata = ddf1->disk_data =
-	      alloc_private_and_read(lc, handler, sizeof(*ddata),
-				     di->path, where)))
-		goto bad;
+	return ret;
+}
 
-	/*
-	 * This table isn't technically required, but for now we rely
-	 * on it to give us a key into the physical drive table.
-	 */
-	ddf1_cvt_disk_data(ddf1, ddata);
-	if (ddata->signature != DDF1_FORCED_PD_GUID) {
-		log_warn(lc, "%s: incorrect disk data signature %x on %s",
-			 handler, ddata->signature, di->path);
-		goto bad;
-	}
+/*
+ * The PD and VD tables and the config records are global to a container
+ * and thus identical on all its member disks.  Share them between disks
+ * by looking them up by their raw contents plus the header fields they
+ * get interpreted by, so that they get converted, checked and indexed
+ * once.  A shared image holds the PD, VD and config sections followed
+ * by the lookup index.
+ */
+#define	DDF1_GLOBAL_KEYS	4
+struct ddf1_global_key {
+	int disk_format;
+	int adaptec_mode;
+	uint32_t phys_drive_len;
+	uint32_t virt_drive_len;
+	uint32_t config_record_len;
+	uint16_t vd_config_record_len;
+	uint16_t max_primary_elements;
+	uint16_t max_phys_drives;
+};
 
-	/* Read physical drive data header */
-	where = to_bytes(pri->primary_table_lba + pri->phys_drive_offset);
-	size = to_bytes(pri->phys_drive_len);
-	if (!(pd = ddf1->pd_header =
-	      alloc_private_and_read(lc, handler, size, di->path, where)))
-		goto bad;
+/* Set up the shared image key out of the raw global sections. */
+static size_t
+global_key(struct ddf1 *ddf1, struct ddf1_global_key *k, struct iovec *key)
+{
+	struct ddf1_header *h = ddf1->primary;
+
+	memset(k, 0, sizeof(*k));
+	k->disk_format = ddf1->disk_format;
+	k->adaptec_mode = ddf1->adaptec_mode;
+	k->phys_drive_len = h->phys_drive_len;
+	k->virt_drive_len = h->virt_drive_len;
+	k->config_record_len = h->config_record_len;
+	k->vd_config_record_len = h->vd_config_record_len;
+	k->max_primary_elements = h->max_primary_elements;
+	k->max_phys_drives = h->max_phys_drives;
+
+	key[0].iov_base = k;
+	key[0].iov_len = sizeof(*k);
+	key[1].iov_base = ddf1->pd_header;
+	key[1].iov_len = to_bytes(h->phys_drive_len);
+	key[2].iov_base = ddf1->vd_header;
+	key[2].iov_len = to_bytes(h->virt_drive_len);
+	key[3].iov_base = ddf1->cfg;
+	key[3].iov_len = to_bytes(h->config_record_len);
+
+	return key[0].iov_len + key[1].iov_len +
+	       key[2].iov_len + key[3].iov_len;
+}
+
+/* Point the global sections into a shared image. */
+static void
+set_global(struct ddf1 *ddf1, uint8_t *image)
+{
+	struct ddf1_header *h = ddf1->primary;
+
+	ddf1->pd_header = (struct ddf1_phys_drives *) image;
+	ddf1->pds = (struct ddf1_phys_drive *) (image +
+						sizeof(*ddf1->pd_header));
+	image += to_bytes(h->phys_drive_len);
+	ddf1->vd_header = (struct ddf1_virt_drives *) image;
+	ddf1->vds = (struct ddf1_virt_drive *) (image +
+						sizeof(*ddf1->pd_header));
+	image += to_bytes(h->virt_drive_len);
+	ddf1->cfg = (struct ddf1_config_record *) image;
+	ddf1->index = (struct ddf1_index *) (image +
+					     to_bytes(h->config_record_len));
+}
+
+/* Use the global sections of another member disk if identical. */
+static int
+find_global(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
+{
+	uint8_t *image;
+	struct ddf1_global_key k;
+	struct iovec key[DDF1_GLOBAL_KEYS];
+
+	global_key(ddf1, &k, key);
+	if (!(image = find_shared_meta(lc, handler, key, DDF1_GLOBAL_KEYS)))
+		return 0;
 
+	log_dbg(lc, "%s: sharing global metadata on %s", handler, di->path);
+	dbg_free(ddf1->pd_header);
+	dbg_free(ddf1->vd_header);
+	dbg_free(ddf1->cfg);
+	set_global(ddf1, image);
+	return 1;
+}
+
+/* Convert, check and index the global sections into a shared image. */
+static int
+parse_global(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
+{
+	int i, ret = 0;
+	unsigned int pds, vds, elements;
+	size_t key_size, size;
+	uint8_t *image, *p;
+	struct ddf1_phys_drives *pd = ddf1->pd_header;
+	struct ddf1_virt_drives *vd = ddf1->vd_header;
+	struct ddf1_global_key k;
+	struct iovec key[DDF1_GLOBAL_KEYS], raw;
+
+	/* Keep the raw sections to register the image under. */
+	key_size = global_key(ddf1, &k, key);
+	if (!(raw.iov_base = p = alloc_private(lc, handler, key_size)))
+		return 0;
+
+	raw.iov_len = key_size;
+	for (i = 0; i < DDF1_GLOBAL_KEYS; p += key[i++].iov_len)
+		memcpy(p, key[i].iov_base, key[i].iov_len);
+
+	/* Physical drive data header */
 	ddf1_cvt_phys_drive_header(ddf1, pd);
 	if (pd->signature != DDF1_PHYS_DRIVE_REC) {
 		err_phys_drive(lc, di);
-		goto bad;
+		goto out;
 	}
 
-	/* Now read the physical drive data */
-	ddf1->pds = (struct ddf1_phys_drive *) (((uint8_t *) ddf1->pd_header) +
-						sizeof(*pd));
+	/* Now convert the physical drive data */
+	ddf1->pds = (struct ddf1_phys_drive *) (((uint8_t *) pd) + sizeof(*pd));
 	for (i = 0; i < pd->num_drives; i++) {
 		ddf1_cvt_phys_drive(ddf1, &ddf1->pds[i]);
 		/*
@@ -422,59 +764,167 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 			ddf1->pds[i].size &= 0xFFFFFFFF;
 	}
 
-	/* Read virtual drive data header */
-	where = to_bytes(pri->primary_table_lba + pri->virt_drive_offset);
-	size = to_bytes(pri->phys_drive_len);
-	if (!(vd = ddf1->vd_header =
-	      alloc_private_and_read(lc, handler, size, di->path, where)))
-		goto bad;
-
+	/* Virtual drive data header */
 	ddf1_cvt_virt_drive_header(ddf1, vd);
 	if (vd->signature != DDF1_VIRT_DRIVE_REC) {
 		err_virt_drive(lc, di);
-		goto bad;
+		goto out;
 	}
 
-	/* Now read the virtual drive data */
+	/* Now convert the virtual drive data */
 	ddf1->vds = (struct ddf1_virt_drive *) (((uint8_t *) vd) + sizeof(*pd));
 	for (i = 0; i < vd->num_drives; i++)
 		ddf1_cvt_virt_drive(ddf1, &ddf1->vds[i]);
 
-	/* Read config data */
-	where = to_bytes(pri->primary_table_lba + pri->config_record_offset);
-	size = to_bytes(pri->config_record_len);
-	if (!(ddf1->cfg = alloc_private_and_read(lc, handler, size,
-						 di->path, where)))
-		goto bad;
-
 	/*
 	 * Ensure each record is: a config table for VDs; a config table for
 	 * spare disks; or vendor-specifc data of some sort.
 	 */
 	ddf1_cvt_records(lc, di, ddf1, 1);
 
+	/* FIXME: We should verify the checksums for all modes */
+	if (ddf1->adaptec_mode && !(ddf1_check_global_crcs(lc, di, ddf1)))
+		goto out;
+
+	size = key_size - sizeof(k);
+	if (!(image = alloc_shared_meta(lc, handler,
+					size + index_size(ddf1, &pds, &vds,
+							  &elements),
+					&raw, 1)))
+		goto out;
+
+	for (i = 1, p = image; i < DDF1_GLOBAL_KEYS; p += key[i++].iov_len)
+		memcpy(p, key[i].iov_base, key[i].iov_len);
+
+	dbg_free(ddf1->pd_header);
+	dbg_free(ddf1->vd_header);
+	dbg_free(ddf1->cfg);
+	set_global(ddf1, image);
+	build_index(ddf1, ddf1->index);
+	ret = 1;
+
+out:
+	dbg_free(raw.iov_base);
+	return ret;
+}
+
+/*
+ * Read a DDF1 RAID device.  Fields are little endian, so
+ * need to convert them if we're on a BE machine (ppc, etc).
+ *
+ * Only the sections the header describes get read. The
+ * secondary copy is only looked at if the primary is bad.
+ */
+static int
+read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
+{
+	int pri_crc, sec_crc;
+	uint64_t base;
+	struct ddf1_header *pri, *sec;
+	struct ddf1_disk_data *ddata;
+	struct ddf1_section sections[DDF1_SECTIONS], *s = sections;
+
+	/* Read the primary DDF header */
+	base = ddf1->anchor.primary_table_lba;
+	pri = read_header(lc, di, ddf1, base, "primary", &pri_crc);
+	if (!pri || !pri_crc) {
+		sec = read_header(lc, di, ddf1, ddf1->anchor.secondary_table_lba,
+				  "secondary", &sec_crc);
+
+		/* If we encounter an error, we use the secondary table */
+		if (sec && (sec_crc || !pri)) {
+			log_warn(lc, "%s: using secondary header on %s",
+				 handler, di->path);
+			cond_free(pri);
+			pri = sec;
+			base = ddf1->anchor.secondary_table_lba;
+		} else
+			cond_free(sec);
+	}
+
+	if (!(ddf1->primary = pri)) {
+		log_error(lc, "%s: both header signatures bad on %s",
+			  handler, di->path);
+		goto bad;
+	}
+
+	/* Read the adapter data, disk data, PD/VD tables and config data */
+	s = add_section(s, base, pri->adapter_data_offset,
+			max(sizeof(*ddf1->adapter),
+			    to_bytes(pri->adapter_data_len)),
+			(void **) &ddf1->adapter);
+	s = add_section(s, base, pri->disk_data_offset,
+			max(sizeof(*ddf1->disk_data),
+			    to_bytes(pri->disk_data_len)),
+			(void **) &ddf1->disk_data);
+	s = add_section(s, base, pri->phys_drive_offset,
+			to_bytes(pri->phys_drive_len),
+			(void **) &ddf1->pd_header);
+	s = add_section(s, base, pri->virt_drive_offset,
+			to_bytes(pri->virt_drive_len),
+			(void **) &ddf1->vd_header);
+	s = add_section(s, base, pri->config_record_offset,
+			to_bytes(pri->config_record_len),
+			(void **) &ddf1->cfg);
+	if (!read_sections(lc, di, sections, s - sections))
+		goto bad;
+
+	if (ddf1->adapter) {
+		ddf1_cvt_adapter(ddf1, ddf1->adapter);
+		if (ddf1->adapter->signature != DDF1_ADAPTER_DATA) {
+			if (ddf1->adapter->signature)
+				log_warn(lc, "%s: incorrect adapter data "
+					 "signature %x on %s", handler,
+					 ddf1->adapter->signature, di->path);
+			dbg_free(ddf1->adapter);
+			ddf1->adapter = NULL;
+		}
+	}
+
+	if (ddf1->adapter &&
+	    ddf1->adapter->pci_vendor == PCI_VENDOR_ID_ADAPTEC2) {
+		log_notice(lc, "%s: Adaptec mode discovered on %s",
+			   handler, di->path);
+		ddf1->adaptec_mode = 1;
+	}
+
 	/*
-	 * FIXME: We don't pick up diagnostic logs, vendor specific logs,
-	 * bad block data, etc.  That shouldn't cause a problem with reading
-	 * or writing metadata, but at some point we might want to do something
-	 * with them.
+	 * This table isn't technically required, but for now we rely
+	 * on it to give us a key into the physical drive table.
 	 */
-	ddf1->in_cpu_format = 1;
+	if (!(ddata = ddf1->disk_data))
+		goto bad;
+
+	ddf1_cvt_disk_data(ddf1, ddata);
+	if (ddata->signature != DDF1_FORCED_PD_GUID) {
+		log_warn(lc, "%s: incorrect disk data signature %x on %s",
+			 handler, ddata->signature, di->path);
+		goto bad;
+	}
 
 	/* FIXME: We should verify the checksums for all modes */
-	if (ddf1->adaptec_mode && !(ddf1_check_all_crcs(lc, di, ddf1)))
+	if (ddf1->adaptec_mode && !(ddf1_check_disk_crcs(lc, di, ddf1)))
 		goto bad;
 
+	if (!ddf1->pd_header || !ddf1->vd_header || !ddf1->cfg)
+		goto bad;
+
+	/* Use the global sections of another member disk if identical. */
+	if (!find_global(lc, di, ddf1) && !parse_global(lc, di, ddf1))
+		goto bad;
+
+	find_this_drive(ddf1);
+	ddf1->in_cpu_format = 1;
 	return 1;
 
 bad:
 	ddf1->vds = NULL;
 	ddf1->pds = NULL;
 	cond_free(ddf1->cfg);
+	cond_free(ddf1->vd_header);
 	cond_free(ddf1->pd_header);
 	cond_free(ddf1->disk_data);
 	cond_free(ddf1->adapter);
-	cond_free(ddf1->secondary);
 	cond_free(ddf1->primary);
 	return 0;
 }
@@ -483,10 +933,9 @@ bad:
 static unsigned int
 num_devs(struct lib_context *lc, void *meta)
 {
-	struct ddf1 *ddf1 = meta;
-	unsigned int num_drives = ~0;
+	unsigned int num_drives;
 
-	get_config_index(ddf1, get_phys_drive(ddf1), &num_drives);
+	get_cfg_refs(meta, get_phys_drive(meta), &num_drives);
 	return num_drives;
 }
 
@@ -574,6 +1023,10 @@ file_metadata_areas(struct lib_context *lc, struct dev_info *di, void *meta)
 	uint8_t *buf;
 	uint64_t start = ddf1_beginning(meta);
 
+	/* Avoid reading up to the end of the device unless dumping. */
+	if (!OPT_DUMP(lc))
+		return;
+
 	if ((buf = read_metadata_chunk(lc, di, start))) {
 		/* Record metadata. */
 		file_metadata(lc, handler, di->path, buf,
@@ -604,7 +1057,7 @@ compose_id(struct ddf1 *ddf1, struct raid_dev *rd)
 	struct ddf1_phys_drive *pd = get_phys_drive(ddf1);
 	int i = get_config_byoffset(ddf1, pd, rd->offset);
 
-	return i < 0 ? -1 : get_offset_entry(ddf1, get_config(ddf1, pd, i), pd);
+	return i < 0 ? -1 : get_offset_entry(ddf1, CR(ddf1, i), pd);
 }
 
 /* No sort. */
@@ -674,13 +1127,12 @@ name(struct lib_context *lc, struct ddf1 *ddf1, struct raid_dev *rd)
 	if (!(pd = get_phys_drive(ddf1)))
 		return err_phys_drive(lc, rd->di);
 
-	i = get_config_byoffset(ddf1, pd, rd->offset);
-	cr = get_config(ddf1, pd, i);
-	if (i < 0 || !cr) {
+	if ((i = get_config_byoffset(ddf1, pd, rd->offset)) < 0) {
 		sprintf(buf, DDF1_SPARES);
 		goto out;
 	}
 
+	cr = CR(ddf1, i);
 	if (!(vd = get_virt_drive(ddf1, cr)))
 		return err_virt_drive(lc, rd->di);
 
@@ -803,7 +1255,7 @@ group_rd(struct lib_context *lc,
 		rs->status = s_ok;
 
 		/* Sort device into subset */
-		list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
+		link_raid_dev_deferred(lc, rs, rd, dev_sort);
 	}
 
 	return rs_group;
@@ -842,7 +1294,7 @@ ddf1_group(struct lib_context *lc, struct raid_dev *rd)
 		return NULL;
 
 	rs->type = t_group;
-	list_add_sorted(lc, &rs->devs, &rd->devs, no_sort);
+	link_raid_dev_deferred(lc, rs, rd, no_sort);
 
 	/* Go deal with the real arrays. */
 	return group_rd(lc, rs, rd);
@@ -950,7 +1402,6 @@ setup_rd(struct lib_context *lc, struct raid_dev *rd,
 
 	/* We need multiple metadata areas */
 	ma_count += ddf1->adapter ? 1 : 0;
-	ma_count += ddf1->secondary ? 1 : 0;
 	ma_count += ddf1->disk_data ? 1 : 0;
 	/* FIXME: metadata area for workspace_lba */
 
@@ -968,9 +1419,6 @@ setup_rd(struct lib_context *lc, struct raid_dev *rd,
 
 	(ma++)->area = ddf1->primary;
 
-	if (ddf1->secondary)
-		(ma++)->offset = ddf1->primary->secondary_table_lba;
-
 	if (ddf1->adapter) {
 		ma->offset += ddf1->primary->adapter_data_offset;
 		ma->size = to_bytes(ddf1->primary->adapter_data_len);
@@ -86,6 +86,12 @@
 #define DDF1_BAD_BLOCKS		0xABADB10C
 #define DDF1_INVALID		0xFFFFFFFF
 
+/* Unused LBA in headers */
+#define DDF1_NO_LBA		0xFFFFFFFFFFFFFFFFULL
+
+/* Number of table sections following a header we load */
+#define DDF1_SECTIONS		5
+
 /* DDF1 version string */
 #define DDF1_VER_STRING		"01.00.00"
 
@@ -252,7 +258,7 @@ struct ddf1 {
 	struct ddf1_header anchor;
 	uint64_t anchor_offset;
 
-	struct ddf1_header *primary, *secondary;
+	struct ddf1_header *primary;
 	struct ddf1_adapter *adapter;
 	struct ddf1_disk_data *disk_data;
 	struct ddf1_phys_drives *pd_header;
@@ -260,6 +266,8 @@ struct ddf1 {
 	struct ddf1_virt_drives *vd_header;
 	struct ddf1_virt_drive *vds;
 	struct ddf1_config_record *cfg;
+	struct ddf1_index *index;	/* Lookup index (see ddf1.c) */
+	struct ddf1_phys_drive *pd;	/* This drive's physical data */
 
 	int disk_format;
 	int in_cpu_format;
@@ -20,49 +20,6 @@
 #define DM_BYTEORDER_SWAB
 #include <datastruct/byteorder.h>
 
-/*
- * CRC table code to avoid linking to zlib, because Ubuntu has
- * problems with that plus this additionally saves space.
- */
-
-/* Make the table for a fast CRC. */
-#define	CRC_TABLE_SIZE	256
-static inline void
-crc_table_init(uint32_t * crc_table)
-{
-	static int new = 1;	/* Flag for table not yet computed. */
-
-	if (new) {
-		uint32_t c, n, k;
-
-		for (new = n = 0; n < CRC_TABLE_SIZE; *(crc_table++) = c, n++) {
-			for (c = n, k = 0; k < 8; k++)
-				c = (c & 1) ? (c >> 1) ^ 0xEDB88320L : c >> 1;
-		}
-	}
-}
-
-/*
- * Update a running CRC with the bytes buf[0..len-1] -- the CRC
- * should be initialized to all 1's, and the transmitted value
- * is the 1's complement of the final running CRC (see the
- * crc() routine below).
- */
-/* Return the CRC of the bytes buf[0..len-1]. */
-static uint32_t
-crc(uint32_t crc, unsigned char *buf, int len)
-{
-	int n;
-	static uint32_t crc_table[CRC_TABLE_SIZE];	/* CRCs of 8-bit messages. */
-
-	crc_table_init(crc_table);
-	for (n = 0; n < len; n++)
-		crc = crc_table[(crc ^ buf[n]) & (CRC_TABLE_SIZE - 1)] ^
-			(crc >> 8);
-
-	return crc ^ 0xFFFFFFFFL;
-}
-
 /* CRC info for various functions below */
 struct crc_info {
 	void *p;
@@ -78,11 +35,29 @@ do_crc32(struct lib_context *lc, struct crc_info *ci)
 	uint32_t old_csum = *ci->crc, ret = 0xFFFFFFFF;
 
 	*ci->crc = ret;
-	ret = crc(ret, ci->p, ci->size);
+	ret = crc32_ieee(ret, ci->p, ci->size);
 	*ci->crc = old_csum;
 	return ret;
 }
 
+/* Check the CRC of a header which is still in disk format. */
+int
+ddf1_header_crc_ok(struct lib_context *lc, struct ddf1 *ddf1,
+		   struct ddf1_header *h)
+{
+	uint32_t crc32 = h->crc;
+	struct crc_info ci = {
+		.p = h,
+		.crc = &h->crc,
+		.size = sizeof(*h),
+	};
+
+	if (BYTE_ORDER != ddf1->disk_format)
+		CVT32(crc32);
+
+	return do_crc32(lc, &ci) == crc32;
+}
+
 /* Return VD record size. */
 static inline size_t
 record_size(struct ddf1 *ddf1)
@@ -172,19 +147,18 @@ check_cfg_crc(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 
 /* Processes all of the DDF1 information for having their CRCs updated*/
 enum all_type { CHECK, UPDATE };
+enum crc_sections { CRC_DISK = 0x1, CRC_GLOBAL = 0x2 };
 static int
 all_crcs(struct lib_context *lc, struct dev_info *di,
-	 struct ddf1 *ddf1, enum all_type type)
+	 struct ddf1 *ddf1, enum all_type type, enum crc_sections sections)
 {
 	int ret = 1;
 	uint32_t crc;
+	/* Tables private to the disk followed by the global ones. */
 	struct crc_info crcs[] = {
 		{ddf1->primary, &ddf1->primary->crc,
 		 sizeof(*ddf1->primary), "primary header"}
 		,
-		{ddf1->secondary, &ddf1->secondary->crc,
-		 sizeof(*ddf1->secondary), "secondary header"}
-		,
 		{ddf1->adapter, &ddf1->adapter->crc,
 		 ddf1->primary->adapter_data_len * DDF1_BLKSIZE, "adapter"}
 		,
@@ -200,9 +174,10 @@ all_crcs(struct lib_context *lc, struct dev_info *di,
 		 "virtual drives"}
 		,
 	}
-	, *c = ARRAY_END(crcs);
+	, *c = sections & CRC_GLOBAL ? ARRAY_END(crcs) : crcs + 3,
+	  *first = sections & CRC_DISK ? crcs : crcs + 3;
 
-	while (c-- > crcs) {
+	while (c-- > first) {
 		if (c->p) {
 			if (type == CHECK)
 				ret &= check_crc(lc, di, c);
@@ -213,16 +188,27 @@ all_crcs(struct lib_context *lc, struct dev_info *di,
 		}
 	}
 
+	if (!(sections & CRC_GLOBAL))
+		return ret;
+
 	return type == CHECK ? (ret & check_cfg_crc(lc, di, ddf1)) :
 		update_cfg_crc(lc, di, ddf1);
 }
 
-/* Processes the tables to check their CRCs */
+/* Processes the tables private to a disk to check their CRCs */
+int
+ddf1_check_disk_crcs(struct lib_context *lc, struct dev_info *di,
+		     struct ddf1 *ddf1)
+{
+	return all_crcs(lc, di, ddf1, CHECK, CRC_DISK);
+}
+
+/* Processes the tables global to all disks to check their CRCs */
 int
-ddf1_check_all_crcs(struct lib_context *lc, struct dev_info *di,
-		    struct ddf1 *ddf1)
+ddf1_check_global_crcs(struct lib_context *lc, struct dev_info *di,
+		       struct ddf1 *ddf1)
 {
-	return all_crcs(lc, di, ddf1, CHECK);
+	return all_crcs(lc, di, ddf1, CHECK, CRC_GLOBAL);
 }
 
 /* Processes all of the DDF1 information for having their CRCs updated */
@@ -230,5 +216,5 @@ void
 ddf1_update_all_crcs(struct lib_context *lc, struct dev_info *di,
 		     struct ddf1 *ddf1)
 {
-	all_crcs(lc, di, ddf1, UPDATE);
+	all_crcs(lc, di, ddf1, UPDATE, CRC_DISK | CRC_GLOBAL);
 }
@@ -15,8 +15,12 @@
 #ifndef	_DDF1_CRC_H_
 #define	_DDF1_CRC_H_
 
-int ddf1_check_all_crcs(struct lib_context *lc, struct dev_info *di,
-			struct ddf1 *ddf1);
+int ddf1_header_crc_ok(struct lib_context *lc, struct ddf1 *ddf1,
+		       struct ddf1_header *h);
+int ddf1_check_disk_crcs(struct lib_context *lc, struct dev_info *di,
+			 struct ddf1 *ddf1);
+int ddf1_check_global_crcs(struct lib_context *lc, struct dev_info *di,
+			   struct ddf1 *ddf1);
 void ddf1_update_all_crcs(struct lib_context *lc, struct dev_info *di,
 			  struct ddf1 *ddf1);
 
@@ -233,9 +233,6 @@ ddf1_cvt_all(struct lib_context *lc, struct ddf1 *ddf1, struct dev_info *di)
 	if (!ddf1->in_cpu_format)
 		ddf1_cvt_records(lc, di, ddf1, ddf1->in_cpu_format);
 
-	if (ddf1->secondary)
-		ddf1_cvt_header(ddf1, ddf1->secondary);
-
 	if (ddf1->adapter)
 		ddf1_cvt_adapter(ddf1, ddf1->adapter);
 
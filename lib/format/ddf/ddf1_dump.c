@@ -276,7 +276,6 @@ ddf1_dump_all(struct lib_context *lc, struct dev_info *di,
 	dump_top(lc, di, ddf1, handler);
 	dump_header(lc, &ddf1->anchor);
 	dump_header(lc, ddf1->primary);
-	dump_header(lc, ddf1->secondary);
 	dump_adapter(lc, ddf1->adapter);
 	dump_disk_data(lc, ddf1->disk_data);
 	dump_phys_drive_header(lc, ddf1->pd_header);
@@ -9,9 +9,15 @@
  * See file LICENSE at the top of this source tree for license information.
  */
 
+#include <sys/uio.h>
 #include "internal.h"
 #include "ondisk.h"
 
+#if	BYTE_ORDER != LITTLE_ENDIAN
+#  define	DM_BYTEORDER_SWAB
+#  include	<datastruct/byteorder.h>
+#endif
+
 /*
  * Metadata format handler registry.
  */
@@ -197,6 +203,335 @@ alloc_private_and_read(struct lib_context *lc, const char *who,
 	return ret;
 }
 
+/*
+ * Metadata shared between RAID devices.
+ *
+ * Member disks of a container usually carry identical copies of the
+ * global metadata.  Format handlers look those up by key (the raw on-disk
+ * bytes plus whatever else the handler needs to tell images apart) in
+ * order to parse and keep them once, with each RAID device holding one
+ * reference to the image no matter how many pointers into it it has.
+ *
+ * RAID devices derived from another one (eg. per volume or subset)
+ * get read-only views into their parents metadata the same way rather
+ * than copies of it.  Handlers about to change an image have to take a
+ * private copy with unshare_meta() first.
+ *
+ * Images are hashed by the address granules they span, so that finding
+ * the image any pointer points into doesn't depend on their number.
+ *
+ * Format handlers group RAID devices in parallel (see metadata.c),
+ * hence the registry and reference counts are changed under lock_sets().
+ */
+#define	META_GRAIN_SHIFT	12
+
+struct meta_grain {
+	struct list_head chain;	/* lc->meta_index hash chain. */
+	unsigned long grain;	/* Address >> META_GRAIN_SHIFT. */
+	struct shared_meta *sm;
+};
+
+struct shared_meta {
+	struct list_head list;
+	const char *who;	/* Format handler owning the image. */
+	unsigned int count;	/* RAID device references. */
+	size_t size;		/* Image size. */
+	size_t key_size;	/* 0 for views, which are never looked up. */
+	uint8_t *key;
+	uint8_t *ptr;		/* Image, allocated with this or adopted. */
+	unsigned int grains;
+	struct meta_grain grain[];	/* Granules spanned by the image. */
+};
+
+/* Maximum number of granules an image of size bytes spans. */
+static unsigned int
+meta_grains(size_t size)
+{
+	return (size >> META_GRAIN_SHIFT) + 2;
+}
+
+static struct list_head *
+meta_chain(struct lib_context *lc, unsigned long grain)
+{
+	return lc->meta_index + (grain & (META_INDEX_SIZE - 1));
+}
+
+/* Hash an image by the granules it spans. */
+static void
+index_meta(struct lib_context *lc, struct shared_meta *sm)
+{
+	unsigned long g = (unsigned long) sm->ptr >> META_GRAIN_SHIFT,
+		      last = ((unsigned long) sm->ptr +
+			      max(sm->size, 1) - 1) >> META_GRAIN_SHIFT;
+	struct meta_grain *mg = sm->grain;
+
+	for (; g <= last; g++, mg++) {
+		mg->grain = g;
+		mg->sm = sm;
+		list_add_tail(&mg->chain, meta_chain(lc, g));
+	}
+
+	sm->grains = mg - sm->grain;
+}
+
+static void
+unindex_meta(struct shared_meta *sm)
+{
+	while (sm->grains--)
+		list_del(&sm->grain[sm->grains].chain);
+}
+
+static size_t
+iov_size(const struct iovec *iov, int n)
+{
+	size_t ret = 0;
+
+	while (n--)
+		ret += (iov++)->iov_len;
+
+	return ret;
+}
+
+/* Compare a key in pieces with the one of a shared image. */
+static int
+key_match(struct shared_meta *sm, const char *who,
+	  const struct iovec *key, int n)
+{
+	uint8_t *k = sm->key;
+
+	if (sm->who != who || !sm->key_size ||
+	    sm->key_size != iov_size(key, n))
+		return 0;
+
+	for (; n--; k += key++->iov_len) {
+		if (memcmp(k, key->iov_base, key->iov_len))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Register a shared image of size bytes under key, either
+ * adopting the caller's allocation at ptr or allocating it.
+ */
+static struct shared_meta *
+_share_meta(struct lib_context *lc, const char *who, void *ptr, size_t size,
+	    const struct iovec *key, int n)
+{
+	uint8_t *k;
+	struct shared_meta *sm;
+	size_t key_size = iov_size(key, n);
+
+	if (!(sm = alloc_private(lc, who, sizeof(*sm) +
+				 meta_grains(size) * sizeof(*sm->grain) +
+				 key_size + (ptr ? 0 : size))))
+		return NULL;
+
+	lock_sets(lc);
+	sm->who = who;
+	sm->count = 1;
+	sm->size = size;
+	sm->key = (uint8_t *) (sm->grain + meta_grains(size));
+	sm->key_size = key_size;
+	sm->ptr = ptr ? ptr : sm->key + key_size;
+
+	for (k = sm->key; n--; k += key++->iov_len)
+		memcpy(k, key->iov_base, key->iov_len);
+
+	list_add_tail(&sm->list, LC_SHARED(lc));
+	index_meta(lc, sm);
+	unlock_sets(lc);
+	return sm;
+}
+
+/*
+ * Allocate a zeroed, shared image of size bytes, registered under key.
+ *
+ * The caller holds the first reference.
+ */
+void *
+alloc_shared_meta(struct lib_context *lc, const char *who, size_t size,
+		  const struct iovec *key, int n)
+{
+	struct shared_meta *sm = _share_meta(lc, who, NULL, size, key, n);
+
+	return sm ? sm->ptr : NULL;
+}
+
+/*
+ * Register the metadata read into buf as a shared image under key
+ * without copying it.  On success, buf is owned by the image and the
+ * caller holds the first reference; on failure buf is left alone.
+ */
+void *
+share_meta(struct lib_context *lc, const char *who, void *buf, size_t size,
+	   const struct iovec *key, int n)
+{
+	return _share_meta(lc, who, buf, size, key, n) ? buf : NULL;
+}
+
+/* Find a shared image by key and take a reference on it. */
+void *
+find_shared_meta(struct lib_context *lc, const char *who,
+		 const struct iovec *key, int n)
+{
+	void *ret = NULL;
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	list_for_each_entry(sm, LC_SHARED(lc), list) {
+		if (key_match(sm, who, key, n)) {
+			sm->count++;
+			ret = sm->ptr;
+			break;
+		}
+	}
+
+	unlock_sets(lc);
+	return ret;
+}
+
+/* Return the shared image ptr points into or NULL. */
+static struct shared_meta *
+shared_meta(struct lib_context *lc, void *ptr)
+{
+	unsigned long g = (unsigned long) ptr >> META_GRAIN_SHIFT;
+	struct meta_grain *mg;
+
+	list_for_each_entry(mg, meta_chain(lc, g), chain) {
+		if (mg->grain == g && (uint8_t *) ptr >= mg->sm->ptr &&
+		    (uint8_t *) ptr < mg->sm->ptr + mg->sm->size)
+			return mg->sm;
+	}
+
+	return NULL;
+}
+
+/*
+ * Return the start of the shared image ptr points
+ * into or ptr itself in case it's not shared.
+ */
+void *
+shared_meta_base(struct lib_context *lc, void *ptr)
+{
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	if ((sm = shared_meta(lc, ptr)))
+		ptr = sm->ptr;
+
+	unlock_sets(lc);
+	return ptr;
+}
+
+/*
+ * Return the size of the shared image starting at ptr or 0 in case
+ * it's not shared, which allows handlers to keep in core data behind
+ * the metadata proper.
+ */
+size_t
+shared_meta_size(struct lib_context *lc, void *ptr)
+{
+	size_t ret;
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	sm = shared_meta(lc, ptr);
+	ret = sm && sm->ptr == ptr ? sm->size : 0;
+	unlock_sets(lc);
+	return ret;
+}
+
+/*
+ * Return a read-only view of the metadata at ptr, which lies within
+ * the allocation of size bytes at base, taking a reference on it.
+ *
+ * base becomes a shared image unless it is one already,
+ * so it must only be freed with free_meta() from now on.
+ */
+void *
+view_meta(struct lib_context *lc, const char *who, void *base, size_t size,
+	  void *ptr)
+{
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	if ((sm = shared_meta(lc, base)) ||
+	    (sm = _share_meta(lc, who, base, size, NULL, 0)))
+		sm->count++;
+	else
+		ptr = NULL;
+
+	unlock_sets(lc);
+	return ptr;
+}
+
+/*
+ * Drop a reference on the shared image ptr points into,
+ * freeing it with the last one, or free ptr if it's not shared.
+ */
+void
+free_meta(struct lib_context *lc, void *ptr)
+{
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	if (!(sm = shared_meta(lc, ptr)))
+		dbg_free(ptr);
+	else if (!--sm->count) {
+		list_del(&sm->list);
+		unindex_meta(sm);
+		if (sm->ptr != sm->key + sm->key_size)
+			dbg_free(sm->ptr);
+
+		dbg_free(sm);
+	}
+
+	unlock_sets(lc);
+}
+
+/*
+ * Replace a RAID devices metadata area pointing into a
+ * shared image by a private copy before it gets changed.
+ */
+void *
+unshare_meta(struct lib_context *lc, struct raid_dev *rd, void *ptr,
+	     size_t size)
+{
+	unsigned int i;
+	void *ret;
+	struct shared_meta *sm;
+
+	lock_sets(lc);
+	if (!(sm = shared_meta(lc, ptr))) {
+		ret = ptr;
+		goto out;
+	}
+
+	if (!(ret = alloc_private(lc, sm->who, size)))
+		goto out;
+
+	memcpy(ret, ptr, size);
+	for (i = 0; i < rd->areas; i++) {
+		if (rd->meta_areas[i].area == ptr)
+			rd->meta_areas[i].area = ret;
+	}
+
+	/* Drop the reference unless there's other pointers into the image. */
+	for (i = 0; i < rd->areas; i++) {
+		if (shared_meta(lc, rd->meta_areas[i].area) == sm)
+			goto out;
+	}
+
+	if (shared_meta(lc, rd->private.ptr) != sm)
+		free_meta(lc, ptr);
+
+out:
+	unlock_sets(lc);
+	return ret;
+}
+
 
 /* Allocate metadata sector array in format handlers. */
 void *
@@ -211,39 +546,47 @@ alloc_meta_areas(struct lib_context *lc, struct raid_dev *rd,
 	return ret;
 }
 
-/* Simple metadata write function for format handlers. */
+/*
+ * Simple metadata write function for format handlers.
+ *
+ * Areas format handlers flag as anchor, which the other ones are
+ * found by, get written last and erased first when writes are queued.
+ */
 static int
 _write_metadata(struct lib_context *lc, const char *handler,
 		struct raid_dev *rd, int idx, int erase)
 {
 	int ret = 0;
-	void *p, *tmp;
+	struct meta_areas *ma = rd->meta_areas + idx;
 
 	if (idx >= rd->areas)
 		goto out;
 
-	p = tmp = rd->meta_areas[idx].area;
-	if (erase &&
-	    !(p = alloc_private(lc, handler, rd->meta_areas[idx].size)))
-		goto out;
-
-	ret = write_file(lc, handler, rd->di->path, (void *) p,
-			 rd->meta_areas[idx].size,
-			 rd->meta_areas[idx].offset << 9);
+	if (erase)
+		ret = erase_file(lc, handler, rd->di->path, ma->size,
+				 ma->offset << 9,
+				 ma->anchor ? WRITE_FIRST : WRITE_LAST);
+	else
+		ret = (ma->anchor ? write_file : write_file_body)
+			(lc, handler, rd->di->path, ma->area, ma->size,
+			 ma->offset << 9);
 
 	log_level(lc, ret ? _PLOG_DEBUG : _PLOG_ERR,
-		  "writing metadata to %s, offset %" PRIu64 " sectors, "
-		  "size %zu bytes returned %d",
-		  rd->di->path, rd->meta_areas[idx].offset,
-		  rd->meta_areas[idx].size, ret);
-
-	if (p != tmp)
-		dbg_free(p);
+		  "%s metadata %s %s, offset %" PRIu64 " sectors, "
+		  "size %zu bytes returned %d", erase ? "erasing" : "writing",
+		  erase ? "on" : "to", rd->di->path, ma->offset, ma->size, ret);
 
       out:
 	return ret;
 }
 
+/*
+ * Write (or erase) one or all metadata areas of a RAID device.
+ *
+ * All areas are queued so that they get written through
+ * one descriptor with adjacent ones in a single pwritev().
+ * None get written in case queueing any of them fails.
+ */
 int
 write_metadata(struct lib_context *lc, const char *handler,
 	       struct raid_dev *rd, int idx, int erase)
@@ -253,12 +596,13 @@ write_metadata(struct lib_context *lc, const char *handler,
 	if (idx > -1)
 		return _write_metadata(lc, handler, rd, idx, erase);
 
+	queue_writes(lc);
 	for (i = 0; i < rd->areas; i++) {
 		if (!_write_metadata(lc, handler, rd, i, erase))
-			return 0;
+			return cancel_writes(lc);
 	}
 
-	return 1;
+	return flush_writes(lc);
 }
 
 
@@ -376,27 +720,26 @@ _check_raid_set(struct lib_context *lc, struct raid_set *rs,
  * and make the above decision at the device level.
  */
 static void
-_set_rs_status(struct lib_context *lc, struct raid_set *rs,
-	       unsigned int i, unsigned int operational, 
-	       unsigned int inconsist, unsigned int subsets_raid1001,
-	       unsigned int nosync)
+_set_rs_status(struct lib_context *lc, struct raid_set *rs)
 {
-	if (subsets_raid1001) {
-		if (subsets_raid1001 == 1)
+	struct set_members *m = &rs->members;
+
+	if (m->raid1001) {
+		if (m->raid1001 == 1)
 			rs->status = s_broken;
-		else if (subsets_raid1001 == 2)
+		else if (m->raid1001 == 2)
 			rs->status = s_ok;
 
 		return;
 	}
 
-	if (operational == i)
+	if (m->operational == m->total)
 		rs->status = s_ok;
-	else if (operational)
+	else if (m->operational)
 		rs->status = s_inconsistent;
-	else if (inconsist)
+	else if (m->inconsistent)
 		rs->status = s_inconsistent;
-	else if (nosync)
+	else if (m->nosync)
 		rs->status = s_nosync;
 	else
 		rs->status = s_broken;
@@ -404,44 +747,114 @@ _set_rs_status(struct lib_context *lc, struct raid_set *rs,
 	log_dbg(lc, "set status of set \"%s\" to %u", rs->name, rs->status);
 }
 
-static int
-set_rs_status(struct lib_context *lc, struct raid_set *rs)
+/* Return the counter a member status is accounted in or NULL if broken. */
+static unsigned int *
+status_counter(struct set_members *m, enum status status, int subset)
+{
+	if (subset)
+		return (S_OK(status) || S_INCONSISTENT(status)) ?
+		       &m->operational : NULL;
+
+	if (S_OK(status))
+		return &m->operational; /* Count disks in "ok" raid*/
+	else if (S_INCONSISTENT(status))
+		return &m->inconsistent; /* Count disks in degraded raid*/
+	else if (S_NOSYNC(status))
+		return &m->nosync;
+
+	return NULL;
+}
+
+/* Count the status of the subsets and devices of a set. */
+static void
+count_status(struct lib_context *lc, struct raid_set *rs)
 {
-	unsigned int i = 0, operational = 0, subsets_raid1001 = 0,
-		     inconsist = 0, nosync = 0;
+	unsigned int *c;
+	struct set_members *m = &rs->members;
 	struct raid_set *r;
 	struct raid_dev *rd;
 
+	memset(m, 0, sizeof(*m));
+	m->gen = geometry_gen(lc);
+
 	/* Set status of subsets. */
 	list_for_each_entry(r, &rs->sets, list) {
 		/* Check subsets to set status of superset. */
 		if ((rs->type == t_raid0 && r->type == t_raid1) ||
 		     (rs->type == t_raid1 && r->type == t_raid0))
-			subsets_raid1001++; /* Count subsets for raid 10/01 */
-
-		i++; /* Count subsets*/
+			m->raid1001++; /* Count subsets for raid 10/01 */
 
-		if (S_OK(r->status) || S_INCONSISTENT(r->status))
-			operational++; /* Count operational subsets. */
+		m->total++; /* Count subsets*/
+		if ((c = status_counter(m, r->status, 1)))
+			(*c)++;
 	}
 
 	/* Check status of devices... */
 	list_for_each_entry(rd, &rs->devs, devs) {
-		i++; /* Count disks*/
-
-		if (S_OK(rd->status))
-			operational++; /* Count disks in "ok" raid*/
-        	else if (S_INCONSISTENT(rd->status))
-			inconsist++; /* Count disks in degraded raid*/
-        	else if (S_NOSYNC(rd->status))
-			nosync++;
+		m->total++; /* Count disks*/
+		if ((c = status_counter(m, rd->status, 0)))
+			(*c)++;
 	}
 
-	_set_rs_status(lc, rs, i, operational, inconsist,
-		       subsets_raid1001, nosync);
+	m->type = rs->type;
+}
+
+static int
+set_rs_status(struct lib_context *lc, struct raid_set *rs)
+{
+	count_status(lc, rs);
+	_set_rs_status(lc, rs);
 	return S_BROKEN(rs->status) ? 0 : 1;
 }
 
+/*
+ * Account for a member of @rs changing status from @old to @new
+ * and carry a resulting change of the set status on to its superset.
+ *
+ * Only the sets on the path up to the top level set get touched;
+ * counters gone stale with the hierarchy are recounted for that set.
+ */
+static void
+propagate_status(struct lib_context *lc, struct raid_set *rs,
+		 enum status old, enum status new, int subset)
+{
+	unsigned int *c;
+	struct set_members *m;
+
+	for (; rs; rs = rs->parent, subset = 1) {
+		m = &rs->members;
+		if (!m->total || m->gen != geometry_gen(lc) ||
+		    m->type != rs->type)
+			count_status(lc, rs);
+		else {
+			if ((c = status_counter(m, old, subset)))
+				(*c)--;
+
+			if ((c = status_counter(m, new, subset)))
+				(*c)++;
+		}
+
+		old = rs->status;
+		_set_rs_status(lc, rs);
+		if ((new = rs->status) == old)
+			break;
+	}
+}
+
+/*
+ * Change the status of a RAID device, updating
+ * the status of the sets it is stacked into.
+ */
+void
+set_rd_status(struct lib_context *lc, struct raid_dev *rd, enum status status)
+{
+	enum status old = rd->status;
+
+	rd->status = status;
+	if (old != status && rd->owner)
+		propagate_status(lc, rd->owner, old, status, 0);
+}
+
 /*
  * Check stack of RAID sets.
  *
@@ -650,7 +1063,7 @@ join_superset(struct lib_context *lc,
 		if ((ret = find_or_alloc_raid_set(lc, n, FIND_TOP, NO_RD,
 						  LC_RS(lc), f_create, rd)) &&
 		    !find_set(lc, &ret->sets, rs->name, FIND_TOP))
-			list_add_sorted(lc, &ret->sets, &rs->list, f_set_sort);
+			link_raid_set(lc, rs, &ret->sets, f_set_sort);
 
 		dbg_free(n);
 	}
@@ -664,3 +1077,157 @@ log_zero_sectors(struct lib_context *lc, char *path, const char *handler)
 {
 	LOG_ERR(lc, 0, "%s: zero sectors on %s", handler, path);
 }
+
+/*
+ * Ondisk metadata layout descriptor support.
+ */
+#if	BYTE_ORDER != LITTLE_ENDIAN
+/* Convert a run of n fields of size bytes each stride bytes apart. */
+static void
+cvt_run(uint8_t *p, unsigned int size, unsigned int stride, unsigned int n)
+{
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+
+	switch (size) {
+	case 2:
+		for (; n--; p += stride) {
+			memcpy(&u16, p, sizeof(u16));
+			CVT16(u16);
+			memcpy(p, &u16, sizeof(u16));
+		}
+		break;
+
+	case 4:
+		for (; n--; p += stride) {
+			memcpy(&u32, p, sizeof(u32));
+			CVT32(u32);
+			memcpy(p, &u32, sizeof(u32));
+		}
+		break;
+
+	case 8:
+		for (; n--; p += stride) {
+			memcpy(&u64, p, sizeof(u64));
+			CVT64(u64);
+			memcpy(p, &u64, sizeof(u64));
+		}
+	}
+}
+#endif
+
+/*
+ * Convert the fields described by a layout table
+ * from ondisk little endian to CPU byte order (and back).
+ *
+ * Table entries of the same width which are adjacent
+ * on disk get folded into one run of conversions.
+ */
+void
+meta_to_cpu(void *meta, const struct meta_field *f)
+{
+#if	BYTE_ORDER != LITTLE_ENDIAN
+	unsigned int n, offset, end;
+
+	for (; f->name; f++) {
+		if (f->size < 2 || f->fmt == MF_STR)
+			continue;
+
+		n = f->count;
+		offset = f->offset;
+		if (n > 1 && f->stride != f->size) {
+			cvt_run((uint8_t *) meta + offset, f->size, f->stride, n);
+			continue;
+		}
+
+		for (end = offset + n * f->size;
+		     f[1].name && f[1].offset == end &&
+		     f[1].size == f->size && f[1].fmt != MF_STR &&
+		     (f[1].count == 1 || f[1].stride == f[1].size); f++) {
+			n += f[1].count;
+			end += f[1].count * f[1].size;
+		}
+
+		cvt_run((uint8_t *) meta + offset, f->size, f->size, n);
+	}
+#endif
+}
+
+#ifdef	DMRAID_NATIVE_LOG
+/* Return the CPU byte order value of a field. */
+static uint64_t
+field_value(const uint8_t *p, unsigned int size)
+{
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+
+	switch (size) {
+	case 1:
+		return *p;
+
+	case 2:
+		memcpy(&u16, p, sizeof(u16));
+		return u16;
+
+	case 4:
+		memcpy(&u32, p, sizeof(u32));
+		return u32;
+
+	case 8:
+		memcpy(&u64, p, sizeof(u64));
+		return u64;
+	}
+
+	return 0;
+}
+
+/*
+ * Log the fields described by a layout table.
+ *
+ * Offsets are displayed relative to base; idx is handed to the
+ * field names of single fields, arrays use their element index.
+ */
+void
+log_meta(struct lib_context *lc, const void *base, const void *meta,
+	 const struct meta_field *f, unsigned int idx)
+{
+	unsigned int i;
+	uint64_t v;
+	const uint8_t *p;
+	char name[64];
+
+	for (; f->name; f++) {
+		if (f->fmt == MF_NOLOG)
+			continue;
+
+		for (i = 0; i < f->count; i++) {
+			p = (const uint8_t *) meta + f->offset + i * f->stride;
+			snprintf(name, sizeof(name), f->name,
+				 f->count > 1 ? i : idx);
+
+			if (f->fmt == MF_STR) {
+				P("%s: \"%.*s\"", base, *p, name,
+				  (int) f->size, p);
+				continue;
+			}
+
+			v = field_value(p, f->size);
+			switch (f->fmt) {
+			case MF_DEC:
+				P("%s: %" PRIu64, base, *p, name, v);
+				break;
+
+			case MF_HEX:
+				P("%s: 0x%" PRIx64, base, *p, name, v);
+				break;
+
+			case MF_HEXDEC:
+				P("%s: 0x%" PRIx64 " %" PRIu64,
+				  base, *p, name, v, v);
+			}
+		}
+	}
+}
+#endif
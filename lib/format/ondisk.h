@@ -22,5 +22,6 @@
 #include "ddf/ddf1.h"
 
 #include "partition/dos.h"
+#include "partition/gpt.h"
 
 #endif
@@ -148,7 +148,7 @@ _alloc_raid_set(struct lib_context *lc, struct raid_dev *rd)
 	rs->type = rd->type;
 
 	if (!(rs->name = dbg_strdup(rd->name))) {
-		dbg_free(rs);
+		arena_free(lc, rs, sizeof(*rs));
 		rs = NULL;
 		log_alloc_err(lc, handler);
 	}
@@ -203,8 +203,8 @@ _create_rs_and_rd(struct lib_context *lc, struct raid_dev *rd,
 	    !(rs = _alloc_raid_set(lc, r)))
 		goto free_di;
 
-	list_add_tail(&r->devs, &rs->devs);
-	list_add_tail(&rs->list, LC_RS(lc));
+	link_raid_dev(lc, rs, r, NULL);
+	link_raid_set(lc, rs, LC_RS(lc), NULL);
 
 	return 1;
 
@@ -232,72 +232,113 @@ is_partition(struct dos_partition *p, uint64_t start_sector)
 	return p->type != PARTITION_EMPTY && p->length && p->start;
 }
 
+/*
+ * Logical partition table chain walk: number of sectors read ahead
+ * at each logical partition table and maximum chain length.
+ */
+#define	EBR_WINDOW	64
+#define	EBR_MAX		256
+
+/*
+ * Walk the chain of logical partition tables in an extended partition.
+ *
+ * Logical partition tables tend to be close to each other, so one buffer
+ * holding a window of sectors read ahead of the present table is reused
+ * while the chain is walked.  Loops and overlong chains get caught.
+ */
 static int
 group_rd_extended(struct lib_context *lc, struct raid_dev *rd,
-		  uint64_t start_sector, uint64_t * extended_root,
-		  unsigned int part)
+		  uint64_t start_sector, unsigned int part)
 {
 	int ret = 0;
-	uint64_t new_start_sector;
-	struct dos *dos;
+	unsigned int i, n = 0, window = 0;
+	uint64_t buf_start = 0, extended_root = start_sector, seen[EBR_MAX];
+	struct dos *buf, *dos;
 	struct dos_partition *p1, *p2;
 
-	/* Allocate and read a logical partition table. */
-	if (!(dos = alloc_private_and_read(lc, handler, sizeof(*dos),
-					   rd->di->path, start_sector << 9)))
+	if (!(buf = alloc_private(lc, handler, EBR_WINDOW * sizeof(*buf))))
 		return 0;
 
-	/* Weird: empty extended partitions are filled with 0xF6 by PM. */
+	while (1) {
+		for (i = 0; i < n; i++) {
+			if (seen[i] == start_sector) {
+				log_err(lc, "%s: logical partition table loop "
+					"at sector %" PRIu64 " on %s",
+					handler, start_sector, rd->di->path);
+				goto done;
+			}
+		}
+
+		if (n == EBR_MAX) {
+			log_err(lc, "%s: more than %u logical partitions on %s",
+				handler, EBR_MAX, rd->di->path);
+			goto done;
+		}
+
+		seen[n++] = start_sector;
+
+		/* Read a window of sectors unless we've got it already. */
+		if (start_sector < buf_start ||
+		    start_sector >= buf_start + window) {
+			window = EBR_WINDOW;
+			if (start_sector + window > rd->di->sectors)
+				window = start_sector < rd->di->sectors ?
+					 rd->di->sectors - start_sector : 1;
+
+			if (!read_file(lc, handler, rd->di->path, buf,
+				       window * sizeof(*buf),
+				       start_sector << 9))
+				goto out;
+
+			buf_start = start_sector;
+		}
+
+		dos = buf + (start_sector - buf_start);
+
+		/* Weird: empty extended partitions are filled with 0xF6 by PM. */
 #if	BYTE_ORDER != LITTLE_ENDIAN
-	to_cpu(dos);
+		to_cpu(dos);
 #endif
-	if (dos->magic == PARTITION_MAGIC_MAGIC)
-		goto out;
+		if (dos->magic == PARTITION_MAGIC_MAGIC)
+			goto out;
 
-	/* Check magic to see if this is a real partition table. */
-	if (dos->magic != DOS_MAGIC)
-		goto out;
+		/* Check magic to see if this is a real partition table. */
+		if (dos->magic != DOS_MAGIC)
+			goto out;
 
-	/*
-	 * Logical partition tables only have two entries,
-	 * one for the partition and one for the next partition table.
-	 */
+		/*
+		 * Logical partition tables only have two entries,
+		 * one for the partition and one for the next partition table.
+		 */
 
-	/*
-	 * An entry pointing to the present logical partition.
-	 * It is an offset from the present partition table location.
-	 */
-	p1 = dos->partitions;
+		/*
+		 * An entry pointing to the present logical partition.
+		 * It is an offset from the present partition table location.
+		 */
+		p1 = dos->partitions;
 
-	/*
-	 * An entry pointing to the next logical partition table.
-	 * It is an offset from the main extended partition start.
-	 */
-	p2 = dos->partitions + 1;
+		/*
+		 * An entry pointing to the next logical partition table.
+		 * It is an offset from the main extended partition start.
+		 */
+		p2 = dos->partitions + 1;
 
-	/* If it is a partition, add it to the set */
-	if (is_partition(p1, start_sector) &&
-	    !_create_rs_and_rd(lc, rd, p1, start_sector, part++))
-		goto out;
+		/* If it is a partition, add it to the set */
+		if (is_partition(p1, start_sector) &&
+		    !_create_rs_and_rd(lc, rd, p1, start_sector, part++))
+			goto out;
 
-	/*
-	 * Recurse into the logical partition chain.
-	 * Save start of main extended partition since
-	 * logical partition tables in the extended partition
-	 * are at offsets from this.
-	 */
-	if (!*extended_root)
-		*extended_root = start_sector;
-	new_start_sector = get_part_start(p2, *extended_root);
+		/* End of the logical partition chain ? */
+		if (!is_partition(p2, start_sector))
+			break;
 
-	if (is_partition(p2, start_sector) &&
-	    !group_rd_extended(lc, rd, new_start_sector, extended_root, part))
-		goto out;
+		start_sector = get_part_start(p2, extended_root);
+	}
 
+done:
 	ret = 1;
-
 out:
-	dbg_free(dos);
+	dbg_free(buf);
 	return ret;
 }
 
@@ -306,8 +347,7 @@ static int
 group_rd(struct lib_context *lc, struct raid_dev *rd, uint64_t start_sector)
 {
 	unsigned int i;
-	uint64_t part_start, part_end,
-		extended_part_start = 0, extended_root = 0;
+	uint64_t part_start, part_end, extended_part_start = 0;
 	struct dos *dos = META(rd, dos);
 	struct dos_partition *raw_table_entry;
 
@@ -355,8 +395,7 @@ group_rd(struct lib_context *lc, struct raid_dev *rd, uint64_t start_sector)
 	 * It always starts with partition 5.
 	 */
 	return extended_part_start ?
-		group_rd_extended(lc, rd, extended_part_start,
-				  &extended_root, 5) : 1;
+		group_rd_extended(lc, rd, extended_part_start, 5) : 1;
 }
 
 /* Add a DOS RAID device to a set */
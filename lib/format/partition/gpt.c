@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * GUID partition table (GPT) format handler.
+ *
+ * Like the DOS handler, this creates a RAID set with a linear
+ * RAID device per partition on partitioned software RAID sets.
+ */
+#define	HANDLER	"gpt"
+
+#include "internal.h"
+#define	FORMAT_HANDLER
+#include "gpt.h"
+
+static const char *handler = HANDLER;
+
+/* Make up RAID device name. */
+static size_t
+_name(struct lib_context *lc, struct raid_dev *rd,
+      unsigned int partition, char *str, size_t len, unsigned char type)
+{
+	const char *base = get_basename(lc, rd->di->path);
+
+	if (!type)
+		return snprintf(str, len, "%s", base);
+
+	if (isdigit(base[strlen(base) - 1]))
+		return snprintf(str, len, "%s%s%u", base,
+				OPT_STR_PARTCHAR(lc), partition);
+
+	return snprintf(str, len, "%s%u", base, partition);
+}
+
+static char *
+name(struct lib_context *lc, struct raid_dev *rd,
+     unsigned int part, unsigned char type)
+{
+	size_t len;
+	char *ret;
+
+	if ((ret = dbg_malloc((len = _name(lc, rd, part, NULL, 0, type) + 1))))
+		_name(lc, rd, part, ret, len, type);
+	else
+		log_alloc_err(lc, handler);
+
+	return ret;
+}
+
+/* Ondisk metadata layout. */
+static const struct meta_field gpt_header_fields[] = {
+	MF(gpt_header, signature, MF_NOLOG),
+	MF(gpt_header, revision, MF_NOLOG),
+	MF(gpt_header, header_size, MF_NOLOG),
+	MF(gpt_header, header_crc32, MF_NOLOG),
+	MF(gpt_header, reserved, MF_NOLOG),
+	MF(gpt_header, my_lba, MF_NOLOG),
+	MF(gpt_header, alternate_lba, MF_NOLOG),
+	MF(gpt_header, first_usable_lba, MF_NOLOG),
+	MF(gpt_header, last_usable_lba, MF_NOLOG),
+	MF(gpt_header, partition_entry_lba, MF_NOLOG),
+	MF(gpt_header, num_partition_entries, MF_NOLOG),
+	MF(gpt_header, sizeof_partition_entry, MF_NOLOG),
+	MF(gpt_header, partition_entry_array_crc32, MF_NOLOG),
+	MF_END,
+};
+
+#if	BYTE_ORDER != LITTLE_ENDIAN
+static const struct meta_field gpt_entry_fields[] = {
+	MF(gpt_entry, starting_lba, MF_NOLOG),
+	MF(gpt_entry, ending_lba, MF_NOLOG),
+	MF(gpt_entry, attributes, MF_NOLOG),
+	MF_ARRAY(gpt_entry, partition_name, MF_NOLOG),
+	MF_END,
+};
+#endif
+
+/* Return partition entry i. */
+static struct gpt_entry *
+entry(struct gpt *gpt, unsigned int i)
+{
+	return (struct gpt_entry *)
+	       (gpt->entries + i * gpt->header.sizeof_partition_entry);
+}
+
+/*
+ * Read a GPT partition table.
+ */
+/* Endianess conversion. */
+#if	BYTE_ORDER == LITTLE_ENDIAN
+#  define	to_cpu	NULL
+#else
+static void
+to_cpu(void *meta)
+{
+	unsigned int i;
+	struct gpt *gpt = meta;
+
+	meta_to_cpu(&gpt->header, gpt_header_fields);
+	for (i = 0; i < gpt->header.num_partition_entries; i++)
+		meta_to_cpu(entry(gpt, i), gpt_entry_fields);
+}
+#endif
+
+/* Check for a protective (or hybrid) MBR. */
+static int
+is_protective_mbr(struct gpt *gpt)
+{
+	const uint8_t *magic = (const uint8_t *) &gpt->magic;
+	struct gpt_mbr_partition *part;
+
+	/* Still in disk format. */
+	if ((magic[0] | (magic[1] << 8)) != GPT_MBR_MAGIC)
+		return 0;
+
+	for (part = gpt->partitions; part < gpt->partitions + 4; part++) {
+		if (part->type == GPT_MBR_TYPE)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Check a header still in disk format, which is supposed to be at
+ * sector lba, and return a CPU format copy of it in h.
+ */
+static int
+header_ok(struct dev_info *di, struct gpt_header *raw,
+	  struct gpt_header *h, uint64_t lba)
+{
+	int ret;
+	uint32_t crc = raw->header_crc32;
+
+	*h = *raw;
+	meta_to_cpu(h, gpt_header_fields);
+
+	if (memcmp(&h->signature, GPT_SIGNATURE, sizeof(h->signature)) ||
+	    h->header_size < GPT_HEADER_SIZE_MIN ||
+	    h->header_size > sizeof(*h))
+		return 0;
+
+	/* The header CRC is calculated with the CRC field zeroed. */
+	raw->header_crc32 = 0;
+	ret = crc32_ieee(0xFFFFFFFF, raw, h->header_size) == h->header_crc32;
+	raw->header_crc32 = crc;
+
+	return ret &&
+	       h->my_lba == lba &&
+	       h->first_usable_lba <= h->last_usable_lba &&
+	       h->last_usable_lba < di->sectors &&
+	       h->sizeof_partition_entry >= GPT_ENTRY_SIZE_MIN &&
+	       !(h->sizeof_partition_entry % 8) &&
+	       h->num_partition_entries <=
+	       GPT_MAX_ENTRIES_SIZE / h->sizeof_partition_entry &&
+	       h->partition_entry_lba +
+	       div_up(h->num_partition_entries * h->sizeof_partition_entry,
+		      512) <= di->sectors;
+}
+
+/*
+ * Make sure the partition entry array described by h is in place
+ * behind the header and check its CRC.  The head read already got
+ * it in the usual case of the primary array following the header.
+ *
+ * *gpt may get reallocated; it is NULL on allocation failure.
+ */
+static int
+entries_ok(struct lib_context *lc, struct dev_info *di, struct gpt **gpt,
+	   size_t *size, struct gpt_header *h)
+{
+	size_t entries_size = h->num_partition_entries *
+			      h->sizeof_partition_entry,
+	       need = sizeof(**gpt) + entries_size;
+	struct gpt *tmp;
+
+	if (h->partition_entry_lba != GPT_PRIMARY_ENTRIES_LBA ||
+	    need > *size) {
+		if (need > *size) {
+			if (!(tmp = dbg_realloc(*gpt, need))) {
+				dbg_free(*gpt);
+				*gpt = NULL;
+				log_alloc_err(lc, handler);
+				return 0;
+			}
+
+			*gpt = tmp;
+			*size = need;
+		}
+
+		if (!read_file(lc, handler, di->path, (*gpt)->entries,
+			       entries_size, h->partition_entry_lba << 9))
+			return 0;
+	}
+
+	return crc32_ieee(0xFFFFFFFF, (*gpt)->entries, entries_size) ==
+	       h->partition_entry_array_crc32;
+}
+
+/*
+ * Read the protective MBR, the primary header and its partition
+ * entries with one read.  The backup header at the end of the device
+ * is only read in case the primary one or its entries are invalid.
+ */
+static void *
+gpt_read_metadata(struct lib_context *lc, struct dev_info *di,
+		  size_t *size, uint64_t *offset, union read_info *info)
+{
+	struct gpt *gpt;
+	struct gpt_header h;
+
+	if (di->sectors < 2 * GPT_HEAD_SECTORS)
+		return NULL;
+
+	*size = GPT_HEAD_SECTORS << 9;
+	*offset = GPT_CONFIGOFFSET;
+	if (!(gpt = alloc_private_and_read(lc, handler, *size,
+					   di->path, *offset)))
+		return NULL;
+
+	if (!is_protective_mbr(gpt))
+		goto bad;
+
+	if (header_ok(di, &gpt->header, &h, 1) &&
+	    entries_ok(lc, di, &gpt, size, &h))
+		return gpt;
+
+	if (!gpt)
+		return NULL;
+
+	/* Primary header or entries invalid -> try the backup. */
+	log_notice(lc, "%s: trying backup header on %s", handler, di->path);
+	if (read_file(lc, handler, di->path, &gpt->header,
+		      sizeof(gpt->header), (di->sectors - 1) << 9) &&
+	    header_ok(di, &gpt->header, &h, di->sectors - 1) &&
+	    entries_ok(lc, di, &gpt, size, &h))
+		return gpt;
+
+	log_err(lc, "%s: no valid partition table on %s", handler, di->path);
+
+bad:
+	dbg_free(gpt);
+	return NULL;
+}
+
+static void
+gpt_file_metadata(struct lib_context *lc, struct dev_info *di, void *meta)
+{
+	if (OPT_DUMP(lc))
+		log_print(lc, "%s: filing metadata not supported (use parted "
+			  "and friends)", handler);
+}
+
+static int setup_rd(struct lib_context *lc, struct raid_dev *rd,
+		    struct dev_info *di, void *meta, union read_info *info);
+static struct raid_dev *
+gpt_read(struct lib_context *lc, struct dev_info *di)
+{
+	return read_raid_dev(lc, di, gpt_read_metadata, 0, 0,
+			     to_cpu, NULL, gpt_file_metadata,
+			     setup_rd, handler);
+}
+
+/* RAID set allocation support function. */
+static struct raid_set *
+_alloc_raid_set(struct lib_context *lc, struct raid_dev *rd)
+{
+	struct raid_set *rs;
+
+	if ((rs = find_set(lc, NULL, rd->name, FIND_TOP)))
+		LOG_ERR(lc, NULL, "%s: RAID set %s already exists",
+			handler, rs->name);
+
+	if (!(rs = alloc_raid_set(lc, handler)))
+		return NULL;
+
+	rs->status = rd->status;
+	rs->type = rd->type;
+
+	if (!(rs->name = dbg_strdup(rd->name))) {
+		arena_free(lc, rs, sizeof(*rs));
+		rs = NULL;
+		log_alloc_err(lc, handler);
+	}
+
+	return rs;
+}
+
+/*
+ * Allocate a GPT RAID device and a set.
+ * Set the device up and add it to the set.
+ */
+static int
+_create_rs_and_rd(struct lib_context *lc, struct raid_dev *rd,
+		  struct gpt_entry *e, unsigned int part)
+{
+	struct raid_dev *r;
+	struct raid_set *rs;
+
+	if (e->ending_lba >= rd->di->sectors)
+		LOG_ERR(lc, 1, "%s: partition address past end of RAID device",
+			handler);
+
+	if (!(r = alloc_raid_dev(lc, handler)))
+		return 0;
+
+	if (!(r->di = alloc_dev_info(lc, rd->di->path)))
+		goto free_raid_dev;
+
+	if (!(r->name = name(lc, rd, part, 1)))
+		goto free_di;
+
+	r->fmt = rd->fmt;
+	r->status = rd->status;
+	r->type = rd->type;
+	r->offset = e->starting_lba;
+	r->sectors = e->ending_lba - e->starting_lba + 1;
+
+	if (!(rs = _alloc_raid_set(lc, r)))
+		goto free_di;
+
+	link_raid_dev(lc, rs, r, NULL);
+	link_raid_set(lc, rs, LC_RS(lc), NULL);
+
+	return 1;
+
+free_di:
+	free_dev_info(lc, r->di);
+free_raid_dev:
+	free_raid_dev(lc, &r);
+
+	return 0;
+}
+
+/* Check for a used partition entry. */
+static int
+is_partition(struct gpt_entry *e)
+{
+	static const uint8_t unused[sizeof(e->partition_type_guid)];
+
+	return memcmp(e->partition_type_guid, unused, sizeof(unused)) &&
+	       e->starting_lba && e->starting_lba <= e->ending_lba;
+}
+
+/*
+ * RAID set grouping.
+ *
+ * Like with DOS partitions, create a RAID set per partition and
+ * a RAID device hanging off it mapping the partition linearly.
+ * Partitions are numbered by their partition entry.
+ */
+static struct raid_set *
+gpt_group(struct lib_context *lc, struct raid_dev *rd)
+{
+	unsigned int i;
+	struct gpt *gpt = META(rd, gpt);
+	struct gpt_entry *e;
+
+	for (i = 0; i < gpt->header.num_partition_entries; i++) {
+		e = entry(gpt, i);
+		if (is_partition(e) && !_create_rs_and_rd(lc, rd, e, i + 1))
+			return NULL;
+	}
+
+	return (struct raid_set *) 1;
+}
+
+/*
+ * Check integrity of a GPT RAID set.
+ */
+static int
+gpt_check(struct lib_context *lc, struct raid_set *rs)
+{
+	return 1;
+}
+
+static struct dmraid_format gpt_format = {
+	.name = HANDLER,
+	.descr = "GPT partitions on SW RAIDs",
+	.caps = NULL,		/* Not supported */
+	.format = FMT_PARTITION,
+	.read = gpt_read,
+	.write = NULL,		/* Not supported */
+	.group = gpt_group,
+	.check = gpt_check,
+#ifdef DMRAID_NATIVE_LOG
+	.log = NULL,		/* Not supported; use parted and friends */
+#endif
+};
+
+/* Register this format handler with the format core. */
+int
+register_gpt(struct lib_context *lc)
+{
+	return register_format_handler(lc, &gpt_format);
+}
+
+/*
+ * Set the RAID device contents up derived from the GPT ones.
+ *
+ * Save the partition table and let gpt_group() do the rest.
+ */
+static int
+setup_rd(struct lib_context *lc, struct raid_dev *rd,
+	 struct dev_info *di, void *meta, union read_info *info)
+{
+	struct gpt *gpt = meta;
+
+	if (!(rd->meta_areas = alloc_meta_areas(lc, rd, handler, 1)))
+		return 0;
+
+	rd->meta_areas->offset = GPT_CONFIGOFFSET >> 9;
+	rd->meta_areas->size = sizeof(*gpt) +
+			       gpt->header.num_partition_entries *
+			       gpt->header.sizeof_partition_entry;
+	rd->meta_areas->area = (void *) gpt;
+
+	rd->di = di;
+	rd->fmt = &gpt_format;
+
+	rd->status = s_ok;
+	rd->type = t_partition;
+
+	rd->offset = GPT_DATAOFFSET;
+	rd->sectors = di->sectors;
+
+	return (rd->name = name(lc, rd, 0, 0)) ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * GUID partition table (GPT) definition.
+ */
+
+#ifndef	_GPT_H_
+#define	_GPT_H_
+
+#ifdef	FORMAT_HANDLER
+#undef	FORMAT_HANDLER
+
+#include <stdint.h>
+
+#define	GPT_CONFIGOFFSET	0
+#define	GPT_DATAOFFSET		0
+
+/*
+ * Sectors read in one go: protective MBR, primary
+ * header and the usual 128 entry partition array.
+ */
+#define	GPT_HEAD_SECTORS	34
+
+/* Sector of the primary partition entry array. */
+#define	GPT_PRIMARY_ENTRIES_LBA	2
+
+/* Upper limit for the size of the partition entry array. */
+#define	GPT_MAX_ENTRIES_SIZE	(1024 * 1024)
+
+struct gpt_header {
+	uint64_t	signature;		/* 0x00 */
+#define	GPT_SIGNATURE	"EFI PART"
+	uint32_t	revision;		/* 0x08 */
+	uint32_t	header_size;		/* 0x0C */
+#define	GPT_HEADER_SIZE_MIN	92
+	uint32_t	header_crc32;		/* 0x10 */
+	uint32_t	reserved;		/* 0x14 */
+	uint64_t	my_lba;			/* 0x18 */
+	uint64_t	alternate_lba;		/* 0x20 */
+	uint64_t	first_usable_lba;	/* 0x28 */
+	uint64_t	last_usable_lba;	/* 0x30 */
+	uint8_t		disk_guid[16];		/* 0x38 */
+	uint64_t	partition_entry_lba;	/* 0x48 */
+	uint32_t	num_partition_entries;	/* 0x50 */
+	uint32_t	sizeof_partition_entry;	/* 0x54 */
+#define	GPT_ENTRY_SIZE_MIN	128
+	uint32_t	partition_entry_array_crc32;	/* 0x58 */
+	uint8_t		reserved2[420];		/* 0x5C - 0x1FF */
+} __attribute__ ((packed));
+
+struct gpt_entry {
+	uint8_t		partition_type_guid[16];	/* 0x00 */
+	uint8_t		unique_partition_guid[16];	/* 0x10 */
+	uint64_t	starting_lba;			/* 0x20 */
+	uint64_t	ending_lba;			/* 0x28 */
+	uint64_t	attributes;			/* 0x30 */
+	uint16_t	partition_name[36];		/* 0x38 - 0x7F */
+} __attribute__ ((packed));
+
+struct gpt_mbr_partition {
+	uint8_t		boot_ind;
+	uint8_t		chs_start[3];
+	uint8_t		type;
+#define	GPT_MBR_TYPE	0xee
+	uint8_t		chs_end[3];
+	uint32_t	start;
+	uint32_t	length;
+} __attribute__ ((packed));
+
+/*
+ * In core layout: protective MBR, the header in use (primary
+ * or backup) and the partition entry array following it.
+ */
+struct gpt {
+	uint8_t				boot_code[446];
+	struct gpt_mbr_partition	partitions[4];
+	uint16_t			magic;
+#define	GPT_MBR_MAGIC	0xAA55
+	struct gpt_header		header;
+	uint8_t				entries[];
+} __attribute__ ((packed));
+
+#endif /* FORMAT_HANDLER */
+
+/* Prototype of the register function for this metadata format handler */
+int register_gpt(struct lib_context *lc);
+
+#endif
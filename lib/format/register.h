@@ -27,8 +27,9 @@
 	xx(sil)
 	xx(via)
 
-	/* DOS partition type handler. */
+	/* DOS and GPT partition type handlers. */
 	xx(dos)
+	xx(gpt)
 
 #undef	xx
 #endif
@@ -29,6 +29,7 @@
 #include <dmraid/locking.h>
 #include "log/log.h"
 #include "mm/dbg_malloc.h"
+#include "mm/arena.h"
 #include <dmraid/misc.h>
 #include <dmraid/display.h>
 #include "device/dev-io.h"
@@ -11,25 +11,25 @@
 
 #include "internal.h"
 
-/* File locking private data. */
+/* File locking private data; the descriptor lives in the library context. */
 static const char *lock_file = "/var/lock/dmraid/.lock";
-static int lf = -1;
 
 /* flock file. */
 static int
 lock(struct lib_context *lc, struct resource *res)
 {
 	/* Already locked. */
-	if (lf > -1)
+	if (lc->lock_fd > -1)
 		return 1;
 
 	log_warn(lc, "locking %s", lock_file);
-	if ((lf = open(lock_file, O_CREAT | O_APPEND | O_RDWR, 0777)) < 0)
+	if ((lc->lock_fd = open(lock_file, O_CREAT | O_APPEND | O_RDWR,
+				0777)) < 0)
 		LOG_ERR(lc, 0, "opening lockfile %s", lock_file);
 
-	if (flock(lf, LOCK_EX)) {
-		close(lf);
-		lf = -1;
+	if (flock(lc->lock_fd, LOCK_EX)) {
+		close(lc->lock_fd);
+		lc->lock_fd = -1;
 		LOG_ERR(lc, 0, "flock lockfile %s", lock_file);
 	}
 
@@ -41,18 +41,18 @@ static void
 unlock(struct lib_context *lc, struct resource *res)
 {
 	/* Not locked! */
-	if (lf == -1)
+	if (lc->lock_fd == -1)
 		return;
 
 	log_warn(lc, "unlocking %s", lock_file);
 	unlink(lock_file);
-	if (flock(lf, LOCK_NB | LOCK_UN))
+	if (flock(lc->lock_fd, LOCK_NB | LOCK_UN))
 		log_err(lc, "flock lockfile %s", lock_file);
 
-	if (close(lf))
+	if (close(lc->lock_fd))
 		log_err(lc, "close lockfile %s", lock_file);
 
-	lf = -1;
+	lc->lock_fd = -1;
 }
 
 /* File base locking interface. */
@@ -78,6 +78,7 @@ init_file_locking(struct lib_context *lc)
 	if (access(dir, R_OK | W_OK) && errno == EROFS)
 		goto out;
 
+	lc->lock_fd = -1;
 	lc->lock = &file_locking;
 	ret = 1;
 
@@ -43,6 +43,9 @@ plog(struct lib_context *lc, int level, int lf, const char *file,
 	else if (lc && lc_opt(lc, o) < l)
 		return;
 
+	if (lc && lc->workers)
+		f = worker_log(lc, f);
+
 	if (_prefix(level))
 		fprintf(f, "%s: ", _prefix(level));
 
@@ -54,6 +57,65 @@ plog(struct lib_context *lc, int level, int lf, const char *file,
 		fputc('\n', f);
 }
 
+/* Return the stream buffering output to @f, opening it on first use. */
+FILE *
+log_buffer_stream(struct log_buffer *lb, FILE *f)
+{
+#ifndef __KLIBC__
+	size_t size;
+	struct log_segment *seg;
+
+	if (!lb->f && !(lb->f = open_memstream(&lb->buf, &lb->size)))
+		return f;
+
+	/* Start a new segment where output switches streams. */
+	if (!lb->segs || lb->seg[lb->segs - 1].f != f) {
+		size = (lb->segs + 1) * sizeof(*seg);
+		if (!(seg = dbg_realloc(lb->seg, size)))
+			return f;
+
+		fflush(lb->f);
+		lb->seg = seg;
+		seg += lb->segs++;
+		seg->f = f;
+		seg->start = lb->size;
+	}
+
+	return lb->f;
+#else
+	/* No memory streams with klibc; it doesn't run workers anyway. */
+	return f;
+#endif
+}
+
+/* Print the output buffered in order and release the buffer. */
+void
+release_log_buffer(struct log_buffer *lb)
+{
+#ifndef __KLIBC__
+	unsigned int i;
+	size_t end;
+
+	if (!lb->f)
+		return;
+
+	fclose(lb->f);
+	for (i = 0; i < lb->segs; i++) {
+		end = i + 1 < lb->segs ? lb->seg[i + 1].start : lb->size;
+		fwrite(lb->buf + lb->seg[i].start, 1,
+		       end - lb->seg[i].start, lb->seg[i].f);
+	}
+
+	free(lb->buf);
+	if (lb->seg)
+		dbg_free(lb->seg);
+
+	lb->f = NULL;
+	lb->seg = NULL;
+	lb->segs = 0;
+#endif
+}
+
 /* This is used so often in the metadata format handlers and elsewhere. */
 int
 log_alloc_err(struct lib_context *lc, const char *who)
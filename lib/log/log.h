@@ -26,6 +26,30 @@ void plog(struct lib_context *lc, int level, int lf, const char *file,
 	  int line, const char *format, ...);
 int log_alloc_err(struct lib_context *lc, const char *who);
 
+/*
+ * Messages logged by a worker thread get buffered per job
+ * and printed in job order once all workers are done.
+ *
+ * stdout and stderr output share one buffer, which gets split
+ * into segments where output switches streams to keep their order.
+ */
+struct log_segment {
+	FILE *f;		/* Stream to print the segment to. */
+	size_t start;		/* Offset of the segment in the buffer. */
+};
+
+struct log_buffer {
+	FILE *f;		/* Stream buffering the output. */
+	char *buf;
+	size_t size;
+	struct log_segment *seg;
+	unsigned int segs;
+};
+
+FILE *log_buffer_stream(struct log_buffer *lb, FILE *f);
+void release_log_buffer(struct log_buffer *lb);
+FILE *worker_log(struct lib_context *lc, FILE *f);
+
 #define _log_info(lc, lf, x...) plog(lc, _PLOG_INFO, lf, __FILE__, __LINE__, x)
 #define log_info(lc, x...) _log_info(lc, 1, x)
 #define log_info_nnl(lc, x...) _log_info(lc, 0, x)
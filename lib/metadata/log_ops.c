@@ -38,7 +38,7 @@ revert_log(struct lib_context *lc, struct list_head *log)
 		if (entry->type == ADD_TO_SET) {
 			rd = entry->rd;
 			rd->type = t_spare;
-			list_del_init(&entry->rd->devs);
+			unlink_raid_dev(lc, rd);
 		}
 		else if (entry->type == WRITE_METADATA) {
 			writes_started = 1;
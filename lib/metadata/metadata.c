@@ -9,6 +9,9 @@
  */
 
 #include <getopt.h>
+#ifndef __KLIBC__
+#include <pthread.h>
+#endif
 #include "internal.h"
 #include "activate/devmapper.h"
 
@@ -199,8 +202,8 @@ count_subsets(struct lib_context *lc, struct raid_set *rs)
 }
 
 /* Calculate total sectors of a (hierarchical) RAID set. */
-uint64_t
-total_sectors(struct lib_context * lc, struct raid_set * rs)
+static uint64_t
+_total_sectors(struct lib_context * lc, struct raid_set * rs)
 {
 	uint64_t sectors = 0;
 	struct raid_dev *rd;
@@ -256,9 +259,9 @@ _count_dev(struct raid_dev *rd, enum count_type type)
 }
 
 /* Count devices in a set recursively. */
-unsigned int
-count_devs(struct lib_context *lc, struct raid_set *rs,
-	   enum count_type count_type)
+static unsigned int
+_count_devs(struct lib_context *lc, struct raid_set *rs,
+	    enum count_type count_type)
 {
 	unsigned int ret = 0;
 	struct raid_set *r;
@@ -275,6 +278,218 @@ count_devs(struct lib_context *lc, struct raid_set *rs,
 	return ret;
 }
 
+/*
+ * RAID set geometry cache.
+ *
+ * Size, device counts and the sorted sizes of the members of a set get
+ * computed once and reused until the set hierarchy changes (see
+ * invalidate_geometry()) or the type, flags or stride of the set do.
+ * Changing the size or type of a device or the type of a subset once
+ * linked needs to invalidate the geometry as well.
+ */
+struct set_geometry {
+	unsigned int gen;	/* lc->geometry_gen computed in. */
+	enum type type;		/* Set attributes computed for. */
+	enum flags flags;
+	unsigned int stride;
+
+	uint64_t sectors;	/* total_sectors() */
+	unsigned int devs[ct_spare + 1];	/* count_devs() */
+	unsigned int members;	/* Subsets and devices, spares excluded. */
+	unsigned int spare_sets;
+	uint64_t sizes[];	/* Member, then spare subset sizes, sorted. */
+};
+
+/* Invalidate the cached geometry of all RAID sets. */
+void
+invalidate_geometry(struct lib_context *lc)
+{
+	lock_sets(lc);
+	lc->geometry_gen++;
+	unlock_sets(lc);
+}
+
+/* Return the geometry generation, which set workers may change. */
+unsigned int
+geometry_gen(struct lib_context *lc)
+{
+	unsigned int ret;
+
+	lock_sets(lc);
+	ret = lc->geometry_gen;
+	unlock_sets(lc);
+	return ret;
+}
+
+static int
+cmp_sectors(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Return the cached geometry of a set, (re)computing it if needed. */
+static struct set_geometry *
+set_geometry(struct lib_context *lc, struct raid_set *rs)
+{
+	unsigned int i = 0, j, members = 0, spare_sets = 0;
+	unsigned int gen = geometry_gen(lc);
+	struct set_geometry *g = rs->geometry;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	if (g && g->gen == gen && g->type == rs->type &&
+	    g->flags == rs->flags && g->stride == rs->stride)
+		return g;
+
+	list_for_each_entry(r, &rs->sets, list) {
+		if (T_SPARE(r))
+			spare_sets++;
+		else
+			members++;
+	}
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!T_SPARE(rd))
+			members++;
+	}
+
+	if (g)
+		dbg_free(g);
+
+	rs->geometry = g = dbg_malloc(sizeof(*g) +
+				      (members + spare_sets) * sizeof(*g->sizes));
+	if (!g) {
+		log_alloc_err(lc, __func__);
+		return NULL;
+	}
+
+	j = members;
+	list_for_each_entry(r, &rs->sets, list)
+		g->sizes[T_SPARE(r) ? j++ : i++] = total_sectors(lc, r);
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!T_SPARE(rd))
+			g->sizes[i++] = rd->sectors;
+	}
+
+	qsort(g->sizes, members, sizeof(*g->sizes), cmp_sectors);
+	qsort(g->sizes + members, spare_sets, sizeof(*g->sizes), cmp_sectors);
+	g->members = members;
+	g->spare_sets = spare_sets;
+
+	for (i = 0; i < ARRAY_SIZE(g->devs); i++)
+		g->devs[i] = _count_devs(lc, rs, i);
+
+	/*
+	 * Valid from here on, because the size needs the device count.
+	 * Store the generation read up front, so that an invalidation
+	 * while computing makes it get computed again.
+	 */
+	g->gen = gen;
+	g->type = rs->type;
+	g->flags = rs->flags;
+	g->stride = rs->stride;
+	g->sectors = _total_sectors(lc, rs);
+
+	return g;
+}
+
+uint64_t
+total_sectors(struct lib_context *lc, struct raid_set *rs)
+{
+	struct set_geometry *g = set_geometry(lc, rs);
+
+	return g ? g->sectors : _total_sectors(lc, rs);
+}
+
+unsigned int
+count_devs(struct lib_context *lc, struct raid_set *rs,
+	   enum count_type count_type)
+{
+	struct set_geometry *g = set_geometry(lc, rs);
+
+	return g ? g->devs[count_type] : _count_devs(lc, rs, count_type);
+}
+
+/* Return the index of the first of n sorted sizes above min. */
+static unsigned int
+sizes_above(const uint64_t *sizes, unsigned int n, uint64_t min)
+{
+	unsigned int lo = 0, mid;
+
+	while (lo < n) {
+		mid = lo + (n - lo) / 2;
+		if (sizes[mid] > min)
+			n = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/*
+ * Return the size of the smallest subset or non-spare
+ * device of a set larger than min or 0 if there's none.
+ */
+uint64_t
+smallest_member(struct lib_context *lc, struct raid_set *rs, uint64_t min)
+{
+	uint64_t ret = ~0;
+	unsigned int i;
+	struct set_geometry *g;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	if ((g = set_geometry(lc, rs))) {
+		if ((i = sizes_above(g->sizes, g->members, min)) < g->members)
+			ret = g->sizes[i];
+
+		i = sizes_above(g->sizes + g->members, g->spare_sets, min);
+		if (i < g->spare_sets)
+			ret = min(ret, g->sizes[g->members + i]);
+	} else {
+		list_for_each_entry(r, &rs->sets, list) {
+			if (total_sectors(lc, r) > min)
+				ret = min(ret, total_sectors(lc, r));
+		}
+
+		list_for_each_entry(rd, &rs->devs, devs) {
+			if (!T_SPARE(rd) && rd->sectors > min)
+				ret = min(ret, rd->sectors);
+		}
+	}
+
+	return ret == (uint64_t) ~0 ? 0 : ret;
+}
+
+/* Count non-spare subsets and devices of a set larger than min. */
+unsigned int
+count_members(struct lib_context *lc, struct raid_set *rs, uint64_t min)
+{
+	unsigned int ret = 0;
+	struct set_geometry *g;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	if ((g = set_geometry(lc, rs)))
+		return g->members - sizes_above(g->sizes, g->members, min);
+
+	list_for_each_entry(r, &rs->sets, list) {
+		if (!T_SPARE(r) && total_sectors(lc, r) > min)
+			ret++;
+	}
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!T_SPARE(rd) && rd->sectors > min)
+			ret++;
+	}
+
+	return ret;
+}
+
 /*
  * Create list of unique memory pointers of a RAID device and free them.
  *
@@ -298,18 +513,23 @@ _free_dev_pointers(struct lib_context *lc, struct raid_dev *rd)
 
 	/* Add private pointer to list. */
 	if (rd->private.ptr)
-		p[idx++] = rd->private.ptr;
+		p[idx++] = shared_meta_base(lc, rd->private.ptr);
 
 	/* Add metadata area pointers to list. */
 	for (area = 0; area < rd->areas; area++) {
-		/* Handle multiple pointers to the same memory. */
+		void *ptr = shared_meta_base(lc, rd->meta_areas[area].area);
+
+		/*
+		 * Handle multiple pointers to the same memory
+		 * or into the same shared metadata image.
+		 */
 		for (i = 0; i < idx; i++) {
-			if (p[i] == rd->meta_areas[area].area)
+			if (p[i] == ptr)
 				break;
 		}
 
 		if (i == idx)
-			p[idx++] = rd->meta_areas[area].area;
+			p[idx++] = ptr;
 	}
 
 	if (rd->meta_areas)
@@ -317,7 +537,7 @@ _free_dev_pointers(struct lib_context *lc, struct raid_dev *rd)
 
 	/* Free all RAID device pointers. */
 	while (idx--)
-		dbg_free(p[idx]);
+		free_meta(lc, p[idx]);
 
 	dbg_free(p);
 }
@@ -326,13 +546,16 @@ _free_dev_pointers(struct lib_context *lc, struct raid_dev *rd)
 struct dev_info *
 alloc_dev_info(struct lib_context *lc, char *path)
 {
+	unsigned int i;
 	struct dev_info *di;
 
-	if ((di = dbg_malloc(sizeof(*di)))) {
-		if ((di->path = dbg_strdup(path)))
+	if ((di = arena_alloc(lc, sizeof(*di)))) {
+		if ((di->path = (char *) intern_str(lc, path))) {
 			INIT_LIST_HEAD(&di->list);
-		else {
-			dbg_free(di);
+			for (i = 0; i < DI_INDEXES; i++)
+				INIT_LIST_HEAD(di->index + i);
+		} else {
+			arena_free(lc, di, sizeof(*di));
 			di = NULL;
 			log_alloc_err(lc, __func__);
 		}
@@ -345,11 +568,16 @@ alloc_dev_info(struct lib_context *lc, char *path)
 static void
 _free_dev_info(struct lib_context *lc, struct dev_info *di)
 {
+	unsigned int i;
+
+	for (i = 0; i < DI_INDEXES; i++)
+		list_del(di->index + i);
+
 	if (di->serial)
 		dbg_free(di->serial);
 
-	dbg_free(di->path);
-	dbg_free(di);
+	release_interned(lc, di->path);
+	arena_free(lc, di, sizeof(*di));
 }
 
 static inline void
@@ -376,13 +604,87 @@ free_dev_info(struct lib_context *lc, struct dev_info *di)
 	di ? _free_dev_info(lc, di) : _free_dev_infos(lc);
 }
 
+/*
+ * Index of discovered block devices.
+ *
+ * Devices on the global list are chained by (interned) path, by basename
+ * and by device number into one hash table, each key seeded with its
+ * type, so that find_disk() doesn't need to walk all of them.
+ */
+static struct list_head *
+disk_chain(struct lib_context *lc, enum disk_index type, const char *key,
+	   dev_t dev)
+{
+	uint32_t h = HASH_INIT ^ type;
+
+	if (type == DI_PATH)
+		h ^= interned_hash(key);
+	else if (type == DI_NAME)
+		h = hash_str(h, key);
+	else
+		h = (h ^ (uint32_t) (dev ^ ((uint64_t) dev >> 32))) * 16777619U;
+
+	return lc->disk_index + (h & (DISK_INDEX_SIZE - 1));
+}
+
+/* Link a dev_info to the global list of discovered devices. */
+void
+link_dev_info(struct lib_context *lc, struct dev_info *di)
+{
+	list_add(&di->list, LC_DI(lc));
+	list_add_tail(di->index + DI_PATH,
+		      disk_chain(lc, DI_PATH, di->path, 0));
+	list_add_tail(di->index + DI_NAME,
+		      disk_chain(lc, DI_NAME, get_basename(lc, di->path), 0));
+	if (di->dev)
+		list_add_tail(di->index + DI_DEV,
+			      disk_chain(lc, DI_DEV, NULL, di->dev));
+}
+
+static struct dev_info *
+find_indexed_disk(struct lib_context *lc, enum disk_index type,
+		  const char *key)
+{
+	struct list_head *pos;
+	struct dev_info *di;
+
+	/* Paths are interned: no copy, no such device. */
+	if (type == DI_PATH && !(key = find_interned(lc, key)))
+		return NULL;
+
+	list_for_each(pos, disk_chain(lc, type, key, 0)) {
+		di = list_entry(pos, struct dev_info, index[type]);
+		if (type == DI_PATH ? di->path == key :
+		    !strcmp(get_basename(lc, di->path), key))
+			return di;
+	}
+
+	return NULL;
+}
+
+/* Find a discovered device by its device number. */
+struct dev_info *
+find_disk_by_dev(struct lib_context *lc, dev_t dev)
+{
+	struct list_head *pos;
+	struct dev_info *di;
+
+	list_for_each(pos, disk_chain(lc, DI_DEV, NULL, dev)) {
+		di = list_entry(pos, struct dev_info, index[DI_DEV]);
+		if (di->dev == dev)
+			return di;
+	}
+
+	return NULL;
+}
+
 /* Allocate/Free RAID device (member of a RAID set). */
 struct raid_dev *
 alloc_raid_dev(struct lib_context *lc, const char *who)
 {
 	struct raid_dev *ret;
 
-	if ((ret = dbg_malloc(sizeof(*ret)))) {
+	if ((ret = arena_alloc(lc, sizeof(*ret)))) {
 		INIT_LIST_HEAD(&ret->list);
 		INIT_LIST_HEAD(&ret->devs);
 		ret->status = s_setup;
@@ -410,7 +712,7 @@ _free_raid_dev(struct lib_context *lc, struct raid_dev **rd)
 	if (r->name)
 		dbg_free(r->name);
 
-	dbg_free(r);
+	arena_free(lc, r, sizeof(*r));
 	*rd = NULL;
 }
 
@@ -439,10 +741,11 @@ alloc_raid_set(struct lib_context *lc, const char *who)
 {
 	struct raid_set *ret;
 
-	if ((ret = dbg_malloc(sizeof(*ret)))) {
+	if ((ret = arena_alloc(lc, sizeof(*ret)))) {
 		INIT_LIST_HEAD(&ret->list);
 		INIT_LIST_HEAD(&ret->sets);
 		INIT_LIST_HEAD(&ret->devs);
+		INIT_LIST_HEAD(&ret->index);
 		ret->status = s_setup;
 		ret->type = t_undef;
 	} else
@@ -451,6 +754,26 @@ alloc_raid_set(struct lib_context *lc, const char *who)
 	return ret;
 }
 
+/* Free a set name or drop the reference on it if it's interned. */
+static void
+free_set_name(struct lib_context *lc, char *name)
+{
+	if (!name)
+		return;
+
+	if (find_interned(lc, name) == name)
+		release_interned(lc, name);
+	else
+		dbg_free(name);
+}
+
+static void settle_sort(struct lib_context *lc, struct list_head *to);
+static void forget_sort(struct lib_context *lc, struct list_head *to);
+static int defer_sort(struct lib_context *lc, struct list_head *to,
+		      int (*f_sort) (struct list_head * pos,
+				     struct list_head * new));
+static void unstage_set(struct lib_context *lc, struct raid_set *rs);
+
 /* Free a single RAID set structure and its RAID devices. */
 static void
 _free_raid_set(struct lib_context *lc, struct raid_set *rs)
@@ -459,9 +782,11 @@ _free_raid_set(struct lib_context *lc, struct raid_set *rs)
 	struct list_head *elem, *tmp;
 
 	log_dbg(lc, "freeing devices of RAID set \"%s\"", rs->name);
+	lock_sets(lc);
 	list_for_each_safe(elem, tmp, &rs->devs) {
 		list_del(elem);
 		rd = RD(elem);
+		rd->owner = NULL;
 
 		log_dbg(lc, "freeing device \"%s\", path \"%s\"",
 			rd->name, (rd->di) ? rd->di->path : "?");
@@ -484,9 +809,18 @@ _free_raid_set(struct lib_context *lc, struct raid_set *rs)
 			free_raid_dev(lc, &rd);
 	}
 
+	forget_sort(lc, &rs->devs);
+	forget_sort(lc, &rs->sets);
+	invalidate_geometry(lc);
+	if (rs->geometry)
+		dbg_free(rs->geometry);
+
+	unstage_set(lc, rs);
 	list_del(&rs->list);
-	dbg_free(rs->name);
-	dbg_free(rs);
+	list_del(&rs->index);
+	unlock_sets(lc);
+	free_set_name(lc, rs->name);
+	arena_free(lc, rs, sizeof(*rs));
 }
 
 /* Remove a set or all sets (in case rs = NULL) recursively. */
@@ -525,6 +859,159 @@ get_set_name(struct lib_context *lc, void *rs)
 	return ((struct raid_set *) rs)->name;
 }
 
+/*
+ * RAID set name index.
+ *
+ * Named sets linked into the RAID set hierarchy by link_raid_set()
+ * are chained by name hash, so that find_set() doesn't need to walk
+ * the hierarchy.  Sets linked below a set which isn't in the hierarchy
+ * (yet) get indexed once that one gets linked.  Freeing drops them.
+ *
+ * Indexed sets carry interned names, which compare by pointer.
+ */
+static struct list_head *
+set_chain(struct lib_context *lc, const char *name)
+{
+	return lc->set_index + (interned_hash(name) & (SET_INDEX_SIZE - 1));
+}
+
+/*
+ * Replace the name of a RAID set by its interned copy,
+ * unless it holds a reference on that already.
+ */
+static int
+intern_set_name(struct lib_context *lc, struct raid_set *rs)
+{
+	const char *name;
+
+	if (find_interned(lc, rs->name) == rs->name)
+		return 1;
+
+	if (!(name = intern_str(lc, rs->name)))
+		return log_alloc_err(lc, __func__);
+
+	dbg_free(rs->name);
+	rs->name = (char *) name;
+	return 1;
+}
+
+static void
+index_set(struct lib_context *lc, struct raid_set *rs, unsigned int level)
+{
+	struct raid_set *r;
+
+	rs->level = level;
+	if (rs->name && list_empty(&rs->index) && intern_set_name(lc, rs)) {
+		lock_sets(lc);
+		list_add_tail(&rs->index, set_chain(lc, rs->name));
+		unlock_sets(lc);
+	}
+
+	list_for_each_entry(r, &rs->sets, list)
+		index_set(lc, r, level + 1);
+}
+
+/* Index a RAID set just linked to a list of sets and note its superset. */
+static void
+index_linked_set(struct lib_context *lc, struct raid_set *rs,
+		 struct list_head *list)
+{
+	unsigned int level = 1;
+
+	if (list != LC_RS(lc)) {
+		rs->parent = list_entry(list, struct raid_set, sets);
+		if ((level = rs->parent->level))
+			level++;
+	}
+
+	if (level)
+		index_set(lc, rs, level);
+}
+
+/* Rename a RAID set taking @name over, keeping the name index current. */
+void
+rename_raid_set(struct lib_context *lc, struct raid_set *rs, char *name)
+{
+	int indexed = !list_empty(&rs->index);
+
+	lock_sets(lc);
+	if (indexed)
+		list_del_init(&rs->index);
+
+	free_set_name(lc, rs->name);
+	rs->name = name;
+	if (indexed && intern_set_name(lc, rs))
+		list_add_tail(&rs->index, set_chain(lc, rs->name));
+
+	unlock_sets(lc);
+}
+
+enum set_op_type { op_tail, op_sorted, op_deferred };
+static int stage_set(struct lib_context *lc, struct raid_set *rs,
+		     struct list_head *list, enum set_op_type type,
+		     int (*f_sort) (struct list_head * pos,
+				    struct list_head * new));
+
+/* Link a RAID set to the top level list or to the subsets of another. */
+void
+link_raid_set(struct lib_context *lc, struct raid_set *rs,
+	      struct list_head *list,
+	      int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	if (!stage_set(lc, rs, list, f_sort ? op_sorted : op_tail, f_sort)) {
+		if (f_sort)
+			list_add_sorted(lc, list, &rs->list, f_sort);
+		else {
+			settle_sort(lc, list);
+			list_add_tail(&rs->list, list);
+		}
+	}
+
+	index_linked_set(lc, rs, list);
+	invalidate_geometry(lc);
+}
+
+/*
+ * Add a RAID device to the members of a set, appending it in case
+ * f_sort is NULL, and keep track of the set the device belongs to.
+ */
+void
+link_raid_dev(struct lib_context *lc, struct raid_set *rs,
+	      struct raid_dev *rd,
+	      int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	if (f_sort)
+		list_add_sorted(lc, &rs->devs, &rd->devs, f_sort);
+	else {
+		settle_sort(lc, &rs->devs);
+		list_add_tail(&rd->devs, &rs->devs);
+	}
+
+	rd->owner = rs;
+	invalidate_geometry(lc);
+}
+
+/* Same with sorting the members deferred (see list_add_deferred()). */
+void
+link_raid_dev_deferred(struct lib_context *lc, struct raid_set *rs,
+		       struct raid_dev *rd,
+		       int (*f_sort) (struct list_head * pos,
+				      struct list_head * new))
+{
+	list_add_deferred(lc, &rs->devs, &rd->devs, f_sort);
+	rd->owner = rs;
+	invalidate_geometry(lc);
+}
+
+/* Remove a RAID device from the members of its set. */
+void
+unlink_raid_dev(struct lib_context *lc, struct raid_dev *rd)
+{
+	list_del_init(&rd->devs);
+	rd->owner = NULL;
+	invalidate_geometry(lc);
+}
+
 /*
  * Find RAID set by name.
  *
@@ -558,16 +1045,41 @@ out:
 	return ret;
 }
 
+/* Look a set up in the name index preferring top level ones. */
+static struct raid_set *
+find_indexed_set(struct lib_context *lc, const char *name, enum find where)
+{
+	const char *iname;
+	struct raid_set *r, *ret = NULL;
+
+	/* Names of indexed sets are interned: no copy, no such set. */
+	if ((iname = find_interned(lc, name))) {
+		lock_sets(lc);
+		list_for_each_entry(r, set_chain(lc, iname), index) {
+			if ((r->level == 1 || (where == FIND_ALL && !ret)) &&
+			    r->name == iname) {
+				ret = r;
+				if (r->level == 1)
+					break;
+			}
+		}
+
+		unlock_sets(lc);
+	}
+
+	log_dbg(lc, "%s: %sfound %s", __func__, ret ? "" : "not ", name);
+	return ret;
+}
+
 struct raid_set *
 find_set(struct lib_context *lc,
 	 struct list_head *list, const char *name, enum find where)
 {
-	return _find_set(lc, list ? list : LC_RS(lc), name, where);
+	return (!list || list == LC_RS(lc)) ?
+		find_indexed_set(lc, name, where) :
+		_find_set(lc, list, name, where);
 }
 
-static int set_sort(struct list_head *pos, struct list_head *new);
-
-
 static int
 set_sort(struct list_head *pos, struct list_head *new)
 {
@@ -602,18 +1114,24 @@ find_or_alloc_raid_set(struct lib_context *lc,
 	rs->type = rd ? rd->type : t_undef;
 
 	/* If caller hands a list in, add to it. */
-	if (list)
-		list_add_sorted(lc, list, &rs->list, set_sort);
+	if (list) {
+		if (!stage_set(lc, rs, list, op_deferred, set_sort))
+			list_add_deferred(lc, list, &rs->list, set_sort);
+
+		index_linked_set(lc, rs, list);
+	}
 
 	/* Call any create callback. */
 	if (f_create)
 		f_create(rs, private);
 
+	invalidate_geometry(lc);
+
 out:
 	return rs;
 
 err:
-	dbg_free(rs);
+	arena_free(lc, rs, sizeof(*rs));
 	log_alloc_err(lc, __func__);
 
 	return NULL;
@@ -743,24 +1261,37 @@ dmraid_group(struct lib_context *lc, struct raid_dev *rd)
 	return rd->fmt->group(lc, rd);
 }
 
-/* Check that device names are members of the devices list. */
+/*
+ * Mark the discovered devices named in the devices list;
+ * return 0 in case all of them are wanted.
+ */
 static int
-_want_device(struct dev_info *di, char **devices)
+mark_wanted_devices(struct lib_context *lc, char **devices)
 {
-	char **dev;
+	struct dev_info *di;
 
 	if (!devices || !*devices)
-		return 1;
+		return 0;
 
-	for (dev = devices; *dev; dev++) {
-		if (!strcmp(*dev, di->path))
-			return 1;
+	for (; *devices; devices++) {
+		if ((di = find_indexed_disk(lc, DI_PATH, *devices)))
+			di->wanted = 1;
 	}
 
-	return 0;
+	return 1;
 }
 
-/* Discover RAID devices that are spares */
+/* Check that a device is a member of the devices list. */
+static int
+_want_device(struct dev_info *di, int marked)
+{
+	int ret = !marked || di->wanted;
+
+	di->wanted = 0;
+	return ret;
+}
+
+/* Discover RAID devices that are spares */
 static void
 discover_raid_devices_spares(struct lib_context *lc, const char *format)
 {
@@ -780,37 +1311,56 @@ discover_raid_devices_spares(struct lib_context *lc, const char *format)
 	}
 }
 
+/*
+ * Read the RAID metadata of a device for the formats on
+ * the separated names list (any format if names = NULL).
+ */
+static void
+discover_raid_device(struct lib_context *lc, struct dev_info *di, char *names)
+{
+	char *p, *sep = names;
+	const char delim = *OPT_STR_SEPARATOR(lc);
+	struct raid_dev *rd;
+
+	do {
+		p = sep;
+		sep = remove_delimiter(sep, delim);
+
+		if ((rd = dmraid_read(lc, di, p, FMT_RAID)))
+			list_add_tail(&rd->list, LC_RD(lc));
+
+		add_delimiter(&sep, delim);
+	} while (sep);
+}
+
+/* Duplicate the format identifiers to loop over them, if any. */
+static int
+format_names(struct lib_context *lc, char **names)
+{
+	*names = NULL;
+	if (OPT_FORMAT(lc) &&
+	    (!(*names = dbg_strdup((char *) OPT_STR_FORMAT(lc)))))
+		return log_alloc_err(lc, __func__);
+
+	return 1;
+}
+
 /* Discover RAID devices. */
 void
 discover_raid_devices(struct lib_context *lc, char **devices)
 {
+	int marked;
 	struct dev_info *di;
-	char *names = NULL;
-	const char delim = *OPT_STR_SEPARATOR(lc);
+	char *names;
 
-	/* In case we've got format identifiers -> duplicate string for loop. */
-	if (OPT_FORMAT(lc) &&
-	    (!(names = dbg_strdup((char *) OPT_STR_FORMAT(lc))))) {
-		log_alloc_err(lc, __func__);
+	if (!format_names(lc, &names))
 		return;
-	}
 
 	/* Walk the list of discovered block devices. */
+	marked = mark_wanted_devices(lc, devices);
 	list_for_each_entry(di, LC_DI(lc), list) {
-		if (_want_device(di, devices)) {
-			char *p, *sep = names;
-			struct raid_dev *rd;
-
-			do {
-				p = sep;
-				sep = remove_delimiter(sep, delim);
-
-				if ((rd = dmraid_read(lc, di, p, FMT_RAID)))
-					list_add_tail(&rd->list, LC_RD(lc));
-
-				add_delimiter(&sep, delim);
-			} while (sep);
-		}
+		if (_want_device(di, marked))
+			discover_raid_device(lc, di, names);
 	}
 
 	if (names)
@@ -820,15 +1370,41 @@ discover_raid_devices(struct lib_context *lc, char **devices)
 /*
  * Discover partitions on RAID sets.
  *
+ * The partition tables of all active RAID sets get read in parallel
+ * by a pool of worker threads, because those reads go through the
+ * (striped) mappings one set after the other otherwise.  Grouping
+ * the partitions into RAID sets is serialized in RAID set order.
+ *
  * FIXME: remove partition code in favour of kpartx ?
  */
-static void
-_discover_partitions(struct lib_context *lc, struct list_head *rs_list)
+#define	PARTITION_WORKERS	8
+
+struct partition_job {
+	struct raid_set *rs;
+	struct dev_info *di;
+	struct raid_dev *rd;
+};
+
+struct partition_jobs {
+	struct lib_context *lc;
+	struct partition_job *job;
+	unsigned int n, size, next;
+	char **names;		/* Mapped device names. */
+	unsigned int names_count;
+#ifndef __KLIBC__
+	pthread_mutex_t lock;
+#endif
+};
+
+/* Add a partition discovery job for each active RAID set. */
+static int
+add_partition_jobs(struct lib_context *lc, struct partition_jobs *jobs,
+		   struct list_head *rs_list)
 {
 	char *path;
 	struct dev_info *di;
-	struct raid_dev *rd;
-	struct raid_set *rs, *r;
+	struct raid_set *rs;
+	struct partition_job *job;
 
 	list_for_each_entry(rs, rs_list, list) {
 		/*
@@ -838,7 +1414,9 @@ _discover_partitions(struct lib_context *lc, struct list_head *rs_list)
 		 * Recurse into them.
 		 */
 		if (T_GROUP(rs)) {
-			_discover_partitions(lc, &rs->sets);
+			if (!add_partition_jobs(lc, jobs, &rs->sets))
+				return 0;
+
 			continue;
 		}
 
@@ -846,53 +1424,161 @@ _discover_partitions(struct lib_context *lc, struct list_head *rs_list)
 		 * Skip all "container" sets, which are not active.
 		 */
 		if (base_partitioned_set(lc, rs) ||
-		    partitioned_set(lc, rs) || !dm_status(lc, rs))
+		    partitioned_set(lc, rs) ||
+		    !(jobs->names ?
+		      dm_listed(jobs->names, jobs->names_count, rs->name) :
+		      dm_status(lc, rs)))
 			continue;
 
+		if (jobs->n == jobs->size) {
+			job = dbg_realloc(jobs->job, (jobs->size + 16) *
+						     sizeof(*job));
+			if (!job)
+				return log_alloc_err(lc, __func__);
+
+			jobs->job = job;
+			jobs->size += 16;
+		}
+
 		log_notice(lc, "discovering partitions on \"%s\"", rs->name);
 		if (!(path = mkdm_path(lc, rs->name)))
-			return;
+			return 0;
 
 		/* Allocate a temporary disk info struct for dmraid_read(). */
 		di = alloc_dev_info(lc, path);
 		dbg_free(path);
 		if (!di)
-			return;
+			return 0;
 
 		di->sectors = total_sectors(lc, rs);
-		if (!(rd = dmraid_read(lc, di, NULL, FMT_PARTITION))) {
-			free_dev_info(lc, di);
-			continue;
-		}
+		job = jobs->job + jobs->n++;
+		job->rs = rs;
+		job->di = di;
+		job->rd = NULL;
+	}
 
-		/*
-		 * WARNING: partition group function returns
-		 * a dummy pointer because of the creation of multiple
-		 * RAID sets (one per partition) it does.
-		 *
-		 * We don't want to access that 'pointer'!
-		 */
-		if ((r = dmraid_group(lc, rd))) {
-			log_notice(lc,
-				   "created partitioned RAID set(s) for %s",
-				   di->path);
-			rs->flags |= f_partitions;
-		} else
-			log_err(lc, "adding %s to RAID set", di->path);
+	return 1;
+}
 
-		/*
-		 * Free the RD. We don't need it any more, because we
-		 * don't support writing partition tables.
-		 */
-		free_dev_info(lc, di);
-		free_raid_dev(lc, &rd);
+/* Read the partition table off the RAID set of a job. */
+static void
+partition_job(struct partition_jobs *jobs, unsigned int i)
+{
+	jobs->job[i].rd = dmraid_read(jobs->lc, jobs->job[i].di,
+				      NULL, FMT_PARTITION);
+}
+
+#ifndef __KLIBC__
+/* Worker thread reading partition tables off RAID sets. */
+static void *
+partition_worker(void *arg)
+{
+	unsigned int i;
+	struct partition_jobs *jobs = arg;
+
+	while (1) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+
+		if (i >= jobs->n)
+			break;
+
+		partition_job(jobs, i);
+	}
+
+	return NULL;
+}
+
+/* Run the partition jobs on a worker pool. */
+static void
+run_partition_jobs(struct partition_jobs *jobs)
+{
+	unsigned int workers = 0;
+	pthread_t thread[PARTITION_WORKERS - 1];
+
+	/* The calling thread is a worker too. */
+	pthread_mutex_init(&jobs->lock, NULL);
+	while (workers + 1 < min(jobs->n, PARTITION_WORKERS) &&
+	       !pthread_create(thread + workers, NULL,
+			       partition_worker, jobs))
+		workers++;
+
+	partition_worker(jobs);
+	while (workers--)
+		pthread_join(thread[workers], NULL);
+
+	pthread_mutex_destroy(&jobs->lock);
+}
+#else
+/* klibc lacks pthreads: run the partition jobs one after the other. */
+static void
+run_partition_jobs(struct partition_jobs *jobs)
+{
+	unsigned int i;
+
+	for (i = 0; i < jobs->n; i++)
+		partition_job(jobs, i);
+}
+#endif
+
+/* Group the partitions discovered on a RAID set. */
+static void
+group_partitions(struct lib_context *lc, struct partition_job *job)
+{
+	struct raid_dev *rd = job->rd;
+
+	if (!rd) {
+		free_dev_info(lc, job->di);
+		return;
 	}
+
+	/*
+	 * WARNING: partition group function returns
+	 * a dummy pointer because of the creation of multiple
+	 * RAID sets (one per partition) it does.
+	 *
+	 * We don't want to access that 'pointer'!
+	 */
+	if (dmraid_group(lc, rd)) {
+		log_notice(lc, "created partitioned RAID set(s) for %s",
+			   job->di->path);
+		job->rs->flags |= f_partitions;
+	} else
+		log_err(lc, "adding %s to RAID set", job->di->path);
+
+	/*
+	 * Free the RD. We don't need it any more, because we
+	 * don't support writing partition tables.
+	 */
+	free_dev_info(lc, job->di);
+	free_raid_dev(lc, &rd);
 }
 
 void
 discover_partitions(struct lib_context *lc)
 {
-	_discover_partitions(lc, LC_RS(lc));
+	unsigned int i;
+	struct partition_jobs jobs = {
+		.lc = lc,
+		.job = NULL,
+		.n = 0,
+		.size = 0,
+		.next = 0,
+	};
+
+	/* Retrieve all mapped devices at once rather than per RAID set. */
+	jobs.names = dm_names(lc, &jobs.names_count);
+	add_partition_jobs(lc, &jobs, LC_RS(lc));
+	if (jobs.names)
+		dbg_free(jobs.names);
+
+	run_partition_jobs(&jobs);
+	for (i = 0; i < jobs.n; i++)
+		group_partitions(lc, jobs.job + i);
+
+	if (jobs.job)
+		dbg_free(jobs.job);
 }
 
 /*
@@ -927,8 +1613,10 @@ want_set(struct lib_context *lc, struct raid_set *rs, char *name)
 			 * set. Whats more, it looks like ddf1 check can
 			 * only be called once, yoweee !!!!
 			 */
-			if (fmt)
+			if (fmt) {
+				settle_sort(lc, &rs->devs);
 				fmt->check(lc, rs);
+			}
 
 			free_raid_set(lc, rs);
 		}
@@ -939,102 +1627,724 @@ want_set(struct lib_context *lc, struct raid_set *rs, char *name)
 struct dmraid_format *
 get_format(struct raid_set *rs)
 {
-	/* Decend RAID set hierarchy. */
-	while (SETS(rs))
-		rs = RS_RS(rs);
+	/* Decend RAID set hierarchy. */
+	while (SETS(rs))
+		rs = RS_RS(rs);
+
+	return DEVS(rs) ? (RD_RS(rs))->fmt : NULL;
+}
+
+/* Find the set a device is a member of. */
+struct raid_set *
+get_raid_set(struct lib_context *lc, struct raid_dev *rd)
+{
+	return rd->owner;
+}
+
+/*
+ * Check metadata consistency of a top level RAID set.
+ *
+ * Return 0 in case the set needs to be removed.
+ */
+static int
+_check_raid_set_metadata(struct lib_context *lc, struct raid_set *rs)
+{
+	struct dmraid_format *fmt;
+
+	/* Some metadata format handlers may not have a check method. */
+	if (!(fmt = get_format(rs)) || fmt->check(lc, rs))
+		return 1;
+
+	/*
+	 * FIXME: check needed if degraded activation
+	 *        is sensible.
+	 */
+	if (T_RAID1(rs)) {
+		log_err(lc, "keeping degraded mirror set \"%s\"", rs->name);
+		return 1;
+	}
+
+	log_err(lc, "removing inconsistent RAID set \"%s\"", rs->name);
+	return 0;
+}
+
+static void
+check_raid_set_metadata(struct lib_context *lc, struct raid_set *rs)
+{
+	if (!_check_raid_set_metadata(lc, rs))
+		free_raid_set(lc, rs);
+}
+
+/*
+ * Worker pool grouping and checking RAID sets.
+ *
+ * Metadata formats never share RAID sets, so the RAID devices of each
+ * format get grouped by a job of their own.  Top level sets don't
+ * depend on each other once grouped, so each one gets checked by a job.
+ *
+ * While workers run, the set index, the deferred sorts and the geometry
+ * generation are serialized by the sets lock.  Sets the workers add to
+ * the top level list are staged and get added in RAID device order once
+ * they're done.  Log messages get buffered per RAID device grouped or set
+ * checked and printed in list order, so that neither the RAID sets nor
+ * the messages differ from grouping and checking serially.
+ */
+#define	SET_WORKERS	8
+
+/* Top level set addition staged by a grouping worker. */
+struct set_op {
+	unsigned int seq;	/* Position of the RAID device grouped. */
+	enum set_op_type type;
+	int dead;		/* Set got freed while grouping. */
+	struct raid_set *rs;
+	int (*f_sort) (struct list_head * pos, struct list_head * new);
+};
+
+struct set_worker {
+	struct set_workers *w;
+	struct log_buffer *log;	/* Messages of the current object. */
+	unsigned int seq;	/* Position of the current object. */
+	struct set_op *op;	/* Staged additions in object order. */
+	unsigned int ops, size, next;
+};
+
+struct set_workers {
+	struct lib_context *lc;
+#ifndef __KLIBC__
+	pthread_mutex_t lock;	/* Job distribution. */
+	pthread_mutex_t sets_lock;	/* Sets and indexes; recursive. */
+	pthread_key_t key;	/* Worker of the calling thread. */
+#endif
+	unsigned int jobs, next;
+	void (*job) (struct set_workers * w, struct set_worker * sw,
+		     unsigned int i);
+
+	void **obj;		/* RAID devices grouped or sets checked. */
+	struct log_buffer *log;	/* Per object. */
+	unsigned int objs;
+	struct dmraid_format **fmt;	/* Per grouping job. */
+	char *name;		/* RAID set wanted. */
+	int *ok;		/* Per set checked. */
+	struct set_worker worker[SET_WORKERS];
+};
+
+#ifndef __KLIBC__
+/*
+ * Serialize changes to RAID sets, their indexes and the shared
+ * metadata registry (see format.c) while set workers run.
+ */
+void
+lock_sets(struct lib_context *lc)
+{
+	if (lc->workers)
+		pthread_mutex_lock(&lc->workers->sets_lock);
+}
+
+void
+unlock_sets(struct lib_context *lc)
+{
+	if (lc->workers)
+		pthread_mutex_unlock(&lc->workers->sets_lock);
+}
+
+/* Return the worker of the calling thread while workers run. */
+static struct set_worker *
+current_worker(struct lib_context *lc)
+{
+	return lc->workers ? pthread_getspecific(lc->workers->key) : NULL;
+}
+#else
+/* klibc lacks pthreads, hence set workers never run. */
+void
+lock_sets(struct lib_context *lc)
+{
+}
+
+void
+unlock_sets(struct lib_context *lc)
+{
+}
+
+static struct set_worker *
+current_worker(struct lib_context *lc)
+{
+	return NULL;
+}
+#endif
+
+/* Return the stream to log to @f by the calling thread. */
+FILE *
+worker_log(struct lib_context *lc, FILE *f)
+{
+	struct set_worker *sw = current_worker(lc);
+
+	return sw && sw->log ? log_buffer_stream(sw->log, f) : f;
+}
+
+/* Stage adding a set to the top level list in case a worker is grouping. */
+static int
+stage_set(struct lib_context *lc, struct raid_set *rs,
+	  struct list_head *list, enum set_op_type type,
+	  int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	struct set_op *op;
+	struct set_worker *sw;
+
+	if (list != LC_RS(lc) || !(sw = current_worker(lc)) || !sw->w->fmt)
+		return 0;
+
+	if (sw->ops == sw->size) {
+		if (!(op = dbg_realloc(sw->op, (sw->size + 16) * sizeof(*op)))) {
+			log_alloc_err(lc, __func__);
+			return 0;
+		}
+
+		sw->op = op;
+		sw->size += 16;
+	}
+
+	/*
+	 * Keep the staged additions in RAID device order:
+	 * a worker may run the jobs of more than one format.
+	 */
+	for (op = sw->op + sw->ops++; op > sw->op && op[-1].seq > sw->seq; op--)
+		*op = op[-1];
+
+	op->seq = sw->seq;
+	op->type = type;
+	op->dead = 0;
+	op->rs = rs;
+	op->f_sort = f_sort;
+	INIT_LIST_HEAD(&rs->list);
+	return 1;
+}
+
+/* Mark a staged set freed. */
+static void
+unstage_set(struct lib_context *lc, struct raid_set *rs)
+{
+	struct set_op *op;
+	struct set_worker *sw = current_worker(lc);
+
+	if (sw) {
+		for (op = sw->op; op < sw->op + sw->ops; op++) {
+			if (op->rs == rs)
+				op->dead = 1;
+		}
+	}
+}
+
+/*
+ * Add a staged set to the top level list.  A set freed while
+ * grouping would have been added and removed again: sort the
+ * list alike without adding it.
+ */
+static void
+replay_set(struct lib_context *lc, struct set_op *op)
+{
+	struct list_head *list = LC_RS(lc);
+
+	if (op->dead) {
+		if (op->type != op_deferred ||
+		    !defer_sort(lc, list, op->f_sort))
+			settle_sort(lc, list);
+
+		return;
+	}
+
+	switch (op->type) {
+	case op_tail:
+		settle_sort(lc, list);
+		list_add_tail(&op->rs->list, list);
+		break;
+
+	case op_sorted:
+		list_add_sorted(lc, list, &op->rs->list, op->f_sort);
+		break;
+
+	case op_deferred:
+		list_add_deferred(lc, list, &op->rs->list, op->f_sort);
+	}
+}
+
+/* Add the sets staged by all workers in RAID device order. */
+static void
+replay_sets(struct lib_context *lc, struct set_workers *w)
+{
+	unsigned int i;
+	struct set_worker *sw, *next;
+
+	while (1) {
+		for (next = NULL, i = 0; i < SET_WORKERS; i++) {
+			sw = w->worker + i;
+			if (sw->next < sw->ops &&
+			    (!next ||
+			     sw->op[sw->next].seq < next->op[next->next].seq))
+				next = sw;
+		}
+
+		if (!next)
+			break;
+
+		replay_set(lc, next->op + next->next++);
+	}
+}
+
+#ifndef __KLIBC__
+/* Worker thread running grouping or checking jobs. */
+static void *
+set_worker(void *arg)
+{
+	unsigned int i;
+	struct set_worker *sw = arg;
+	struct set_workers *w = sw->w;
+
+	pthread_setspecific(w->key, sw);
+	while (1) {
+		pthread_mutex_lock(&w->lock);
+		i = w->next++;
+		pthread_mutex_unlock(&w->lock);
+
+		if (i >= w->jobs)
+			break;
+
+		w->job(w, sw, i);
+	}
+
+	pthread_setspecific(w->key, NULL);
+	return NULL;
+}
+
+/* Run the jobs; return 0 in case they need to be run serially. */
+static int
+run_set_workers(struct lib_context *lc, struct set_workers *w)
+{
+	unsigned int i, workers = 0;
+	pthread_t thread[SET_WORKERS - 1];
+	pthread_mutexattr_t attr;
+
+	if (pthread_key_create(&w->key, NULL))
+		return 0;
+
+	w->lc = lc;
+	w->next = 0;
+	for (i = 0; i < SET_WORKERS; i++)
+		w->worker[i].w = w;
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&w->sets_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	/* The calling thread is a worker too. */
+	lc->workers = w;
+	while (workers + 1 < min(w->jobs, SET_WORKERS) &&
+	       !pthread_create(thread + workers, NULL,
+			       set_worker, w->worker + workers + 1))
+		workers++;
+
+	set_worker(w->worker);
+	while (workers--)
+		pthread_join(thread[workers], NULL);
+
+	lc->workers = NULL;
+	pthread_mutex_destroy(&w->sets_lock);
+	pthread_mutex_destroy(&w->lock);
+	pthread_key_delete(w->key);
+	return 1;
+}
+#else
+/* klibc lacks pthreads: the jobs always need to be run serially. */
+static int
+run_set_workers(struct lib_context *lc, struct set_workers *w)
+{
+	return 0;
+}
+#endif
+
+/* Allocate per object arrays for @n objects. */
+static int
+alloc_set_objs(struct lib_context *lc, struct set_workers *w, unsigned int n)
+{
+	w->objs = n;
+	if (!(w->obj = dbg_malloc(n * sizeof(*w->obj))) ||
+	    !(w->log = dbg_malloc(n * sizeof(*w->log))))
+		return log_alloc_err(lc, __func__);
+
+	return 1;
+}
+
+static void
+free_set_objs(struct set_workers *w)
+{
+	unsigned int i;
+
+	for (i = 0; i < SET_WORKERS; i++) {
+		if (w->worker[i].op)
+			dbg_free(w->worker[i].op);
+	}
+
+	if (w->ok)
+		dbg_free(w->ok);
+
+	if (w->fmt)
+		dbg_free(w->fmt);
+
+	if (w->log)
+		dbg_free(w->log);
+
+	if (w->obj)
+		dbg_free(w->obj);
+}
+
+/* Check a top level set. */
+static void
+check_job(struct set_workers *w, struct set_worker *sw, unsigned int i)
+{
+	sw->log = w->log + i;
+	w->ok[i] = _check_raid_set_metadata(w->lc, w->obj[i]);
+	sw->log = NULL;
+}
+
+/* Check top level sets in parallel; return 0 if they need checking serially. */
+static int
+check_raid_sets_parallel(struct lib_context *lc)
+{
+	int ret = 0;
+	unsigned int i = 0;
+	struct raid_set *rs;
+	struct set_workers w = {.job = check_job };
+
+	if ((w.jobs = count_sets(lc, LC_RS(lc))) < 2 ||
+	    !alloc_set_objs(lc, &w, w.jobs) ||
+	    !(w.ok = dbg_malloc(w.jobs * sizeof(*w.ok))))
+		goto out;
+
+	list_for_each_entry(rs, LC_RS(lc), list)
+		w.obj[i++] = rs;
+
+	if (!(ret = run_set_workers(lc, &w)))
+		goto out;
+
+	for (i = 0; i < w.objs; i++) {
+		release_log_buffer(w.log + i);
+		if (!w.ok[i])
+			free_raid_set(lc, w.obj[i]);
+	}
+
+out:
+	free_set_objs(&w);
+	return ret;
+}
+
+/* Check metadata consistency of RAID sets. */
+static void
+check_raid_sets(struct lib_context *lc)
+{
+	struct list_head *elem, *tmp;
+
+	if (check_raid_sets_parallel(lc))
+		return;
+
+	list_for_each_safe(elem, tmp, LC_RS(lc))
+		check_raid_set_metadata(lc, RS(elem));
+}
+
+static void group_raid_dev(struct lib_context *lc, struct raid_dev *rd,
+			   char *name);
+
+/* Group the RAID devices of a format in list order. */
+static void
+group_job(struct set_workers *w, struct set_worker *sw, unsigned int i)
+{
+	struct raid_dev *rd;
+
+	for (sw->seq = 0; sw->seq < w->objs; sw->seq++) {
+		rd = w->obj[sw->seq];
+		if (rd->fmt == w->fmt[i]) {
+			sw->log = w->log + sw->seq;
+			group_raid_dev(w->lc, rd, w->name);
+		}
+	}
+
+	sw->log = NULL;
+}
+
+/* Group RAID devices per format in parallel; return 0 if serially needed. */
+static int
+group_raid_devs_parallel(struct lib_context *lc, char *name)
+{
+	int ret = 0;
+	unsigned int i, j;
+	struct raid_dev *rd;
+	struct set_workers w = {.job = group_job,.name = name };
+
+	if ((i = count_devices(lc, RAID)) < 2 ||
+	    !alloc_set_objs(lc, &w, i) ||
+	    !(w.fmt = dbg_malloc(w.objs * sizeof(*w.fmt))))
+		goto out;
+
+	i = 0;
+
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		w.obj[i++] = rd;
+		for (j = 0; j < w.jobs && w.fmt[j] != rd->fmt; j++);
+		if (j == w.jobs)
+			w.fmt[w.jobs++] = rd->fmt;
+	}
+
+	if (w.jobs < 2 || !(ret = run_set_workers(lc, &w)))
+		goto out;
+
+	replay_sets(lc, &w);
+	for (i = 0; i < w.objs; i++)
+		release_log_buffer(w.log + i);
+
+out:
+	free_set_objs(&w);
+	return ret;
+}
+
+/* Group a RAID device into its set, dropping the set on failure. */
+static void
+group_raid_dev(struct lib_context *lc, struct raid_dev *rd, char *name)
+{
+	struct raid_set *rs;
+
+	/* FIXME: optimize dropping of unwanted RAID sets. */
+	if ((rs = dmraid_group(lc, rd))) {
+		log_notice(lc, "added %s to RAID set \"%s\"",
+			   rd->di->path, rs->name);
+		want_set(lc, rs, name);
+		return;
+	}
+
+	if (!T_SPARE(rd))
+		log_err(lc, "adding %s to RAID set \"%s\"",
+			rd->di->path, rd->name);
+
+	/* Need to find the set and remove it. */
+	if ((rs = find_set(lc, NULL, rd->name, FIND_ALL))) {
+		log_err(lc, "removing RAID set \"%s\"", rs->name);
+		free_raid_set(lc, rs);
+	}
+}
+
+/* Build RAID sets from devices on global RD list. */
+static int
+build_set(struct lib_context *lc, char *name)
+{
+	struct list_head *elem, *tmp;
+
+	if (name && find_set(lc, NULL, name, FIND_TOP))
+		LOG_ERR(lc, 0, "RAID set %s already exists", name);
+
+	/* Sort sets and their devices once they're all grouped. */
+	defer_sorts(lc);
+	if (!group_raid_devs_parallel(lc, name)) {
+		list_for_each_safe(elem, tmp, LC_RD(lc))
+			group_raid_dev(lc, list_entry(elem, struct raid_dev,
+						      list), name);
+	}
+
+	flush_sorts(lc);
+
+	/* Check sanity of grouped RAID sets. */
+	check_raid_sets(lc);
+	return 1;
+}
+
+/*
+ * Incremental rescan of a single device.
+ *
+ * Rather than rediscovering all disks and regrouping all RAID sets,
+ * drop the top level sets the device is a member of, probe the device
+ * again and regroup and check the disks of the dropped sets only.
+ */
+
+/* Return the top level set of a RAID set stack. */
+static struct raid_set *
+top_set(struct raid_set *rs)
+{
+	while (rs->parent)
+		rs = rs->parent;
 
-	return DEVS(rs) ? (RD_RS(rs))->fmt : NULL;
+	return rs;
 }
 
-/* Find the set associated with a device */
-struct raid_set *
-get_raid_set(struct lib_context *lc, struct raid_dev *dev)
+/* Mark the disks of a RAID set stack to read their metadata again. */
+static void
+mark_set_disks(struct raid_set *rs)
 {
-	struct raid_set *rs = NULL, *sub_rs = NULL;
-	struct raid_dev *rd = NULL;
+	struct raid_set *r;
+	struct raid_dev *rd;
 
-	list_for_each_entry(rs, LC_RS(lc), list) {
-		list_for_each_entry(rd, &rs->devs, devs) if (dev == rd)
-			return rs;
-		if (T_GROUP(rs)) {
-			list_for_each_entry(sub_rs, &rs->sets, list) {
-				list_for_each_entry(rd, &rs->devs, devs)
-					if (dev == rd)
-					return rs;
-			}
-		}
-	}
+	list_for_each_entry(r, &rs->sets, list)
+		mark_set_disks(r);
 
-	return NULL;
+	list_for_each_entry(rd, &rs->devs, devs)
+		rd->di->wanted = 1;
 }
 
-/* Check metadata consistency of RAID sets. */
+/*
+ * Drop the RAID sets and devices on the marked disks to read them again.
+ *
+ * Disks of dropped sets may carry RAID devices of other formats,
+ * so the sets of all RAID devices on marked disks get dropped until
+ * no more disks get marked before any RAID device gets freed.
+ */
 static void
-check_raid_sets(struct lib_context *lc)
+drop_marked_disks(struct lib_context *lc)
 {
+	int again;
 	struct list_head *elem, *tmp;
+	struct raid_dev *rd;
 	struct raid_set *rs;
-	struct dmraid_format *fmt;
-
-	list_for_each_safe(elem, tmp, LC_RS(lc)) {
-		/* Some metadata format handlers may not have a check method. */
-		if (!(fmt = get_format((rs = RS(elem)))))
-			continue;
 
-		if (!fmt->check(lc, rs)) {
-			/*
-			 * FIXME: check needed if degraded activation
-			 *        is sensible.
-			 */
-			if (T_RAID1(rs))
-				log_err(lc, "keeping degraded mirror "
-					"set \"%s\"", rs->name);
-			else {
-				log_err(lc, "removing inconsistent RAID "
-					"set \"%s\"", rs->name);
+	do {
+		again = 0;
+		list_for_each_entry(rd, LC_RD(lc), list) {
+			if (rd->di->wanted && rd->owner) {
+				rs = top_set(rd->owner);
+				mark_set_disks(rs);
 				free_raid_set(lc, rs);
+
+				/* Start over, the lists changed. */
+				again = 1;
+				break;
 			}
 		}
+	} while (again);
+
+	list_for_each_safe(elem, tmp, LC_RD(lc)) {
+		rd = list_entry(elem, struct raid_dev, list);
+		if (rd->di->wanted)
+			free_raid_dev(lc, &rd);
 	}
+}
 
-	return;
+/* Drop a disk together with the RAID sets and devices it's part of. */
+static void
+drop_disk(struct lib_context *lc, struct dev_info *di)
+{
+	di->wanted = 1;
+	drop_marked_disks(lc);
+	list_del(&di->list);
+	free_dev_info(lc, di);
 }
 
-/* Build RAID sets from devices on global RD list. */
-static int
-build_set(struct lib_context *lc, char *name)
+/* Return the name of the device to probe. */
+static char *
+rescan_name(struct lib_context *lc, const char *path, dev_t dev)
+{
+	char *ret;
+	struct dev_info *di;
+
+	if (path)
+		ret = dbg_strdup(get_basename(lc, (char *) path));
+	else if ((di = find_disk_by_dev(lc, dev)))
+		ret = dbg_strdup(get_basename(lc, di->path));
+	else
+		return devno_name(lc, dev);
+
+	if (!ret)
+		log_alloc_err(lc, __func__);
+
+	return ret;
+}
+
+/*
+ * Rescan a device which appeared, changed or vanished given by
+ * path (eg, "/dev/sda") or by device number in case path = NULL.
+ */
+int
+libdmraid_rescan_device(struct lib_context *lc, const char *path, dev_t dev)
 {
+	int ret = 0;
+	unsigned int i, n = 0;
+	char *name, *names;
+	struct dev_info *di;
 	struct raid_dev *rd;
-	struct raid_set *rs;
-	struct list_head *elem, *tmp;
+	struct raid_set *rs, **sets = NULL;
+	struct list_head *elem, *tmp, *last;
 
-	if (name && find_set(lc, NULL, name, FIND_TOP))
-		LOG_ERR(lc, 0, "RAID set %s already exists", name);
+	if (!(name = rescan_name(lc, path, dev)))
+		return 0;
 
-	list_for_each_safe(elem, tmp, LC_RD(lc)) {
-		rd = list_entry(elem, struct raid_dev, list);
-		/* FIXME: optimize dropping of unwanted RAID sets. */
-		if ((rs = dmraid_group(lc, rd))) {
-			log_notice(lc, "added %s to RAID set \"%s\"",
-				   rd->di->path, rs->name);
-			want_set(lc, rs, name);
-			continue;
-		}
+	if (!format_names(lc, &names))
+		goto out;
 
-		if (!T_SPARE(rd))
-			log_err(lc, "adding %s to RAID set \"%s\"",
-				rd->di->path, rd->name);
+	/*
+	 * RAID devices of sets dropped as inconsistent are left without
+	 * a set; read them again in case the device completes their set.
+	 */
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (!rd->owner)
+			rd->di->wanted = 1;
+	}
 
-		/* Need to find the set and remove it. */
-		if ((rs = find_set(lc, NULL, rd->name, FIND_ALL))) {
-			log_err(lc, "removing RAID set \"%s\"", rs->name);
-			free_raid_set(lc, rs);
+	if ((di = path ? find_disk(lc, path) : find_disk_by_dev(lc, dev)))
+		drop_disk(lc, di);
+	else
+		drop_marked_disks(lc);
+
+	/* Probe the device again; it vanished if it's not found. */
+	if (discover_device(lc, name) && (di = find_disk(lc, name)))
+		di->wanted = 1;
+
+	/* Read the metadata of the marked disks. */
+	last = LC_RD(lc)->prev;
+	list_for_each_entry(di, LC_DI(lc), list) {
+		if (di->wanted) {
+			di->wanted = 0;
+			discover_raid_device(lc, di, names);
 		}
 	}
 
-	/* Check sanity of grouped RAID sets. */
-	check_raid_sets(lc);
-	return 1;
+	/* Group the RAID devices read... */
+	defer_sorts(lc);
+	for (elem = last->next; elem != LC_RD(lc); elem = tmp) {
+		tmp = elem->next;
+		group_raid_dev(lc, list_entry(elem, struct raid_dev, list),
+			       NULL);
+		n++;
+	}
+
+	flush_sorts(lc);
+
+	/* ...and check the top level sets they ended up in once. */
+	if (n && !(sets = dbg_malloc(n * sizeof(*sets)))) {
+		log_alloc_err(lc, __func__);
+		goto out;
+	}
+
+	n = 0;
+	for (elem = last->next; elem != LC_RD(lc); elem = elem->next) {
+		rd = list_entry(elem, struct raid_dev, list);
+		if (!rd->owner)
+			continue;
+
+		rs = top_set(rd->owner);
+		for (i = 0; i < n && sets[i] != rs; i++);
+		if (i == n)
+			sets[n++] = rs;
+	}
+
+	for (i = 0; i < n; i++)
+		check_raid_set_metadata(lc, sets[i]);
+
+	ret = 1;
+
+out:
+	if (sets)
+		dbg_free(sets);
+
+	if (names)
+		dbg_free(names);
+
+	dbg_free(name);
+	return ret;
 }
 
 struct raid_set_descr {
@@ -1222,13 +2532,11 @@ find_disk(struct lib_context *lc, const char *dp)
 	if ((dp == NULL) || (*dp == '\0'))
 		LOG_ERR(lc, 0, "failed to provide an array of disks");
 
+	/* Take a bare device name (eg, "sda") as well. */
+	if (!(di = find_indexed_disk(lc, DI_PATH, dp)) && !strchr(dp, '/'))
+		di = find_indexed_disk(lc, DI_NAME, dp);
 
-	list_for_each_entry(di, LC_DI(lc), list) {
-		if (!strcmp(di->path, dp))
-			return di;
-	}
-
-	return NULL;
+	return di;
 }
 
 static struct dmraid_format *
@@ -1431,7 +2739,7 @@ create_raidset(struct lib_context *lc, struct raid_set_descr *rsd)
 		rd->type = t_undef;
 		rd->offset = 0;
 		rd->sectors = 0;
-		list_add_tail(&rd->devs, &rs->devs);
+		link_raid_dev(lc, rs, rd, NULL);
 		n++;
 	} while (end++ != '\0');
 
@@ -1448,7 +2756,7 @@ create_raidset(struct lib_context *lc, struct raid_set_descr *rsd)
 			goto err;
 
 		rs_sub->type = rt;
-		list_add_tail(&rs_sub->list, &rs_tmp->sets);
+		link_raid_set(lc, rs_sub, &rs_tmp->sets, NULL);
 		rs_tmp = rs_sub;
 	}
 
@@ -1483,7 +2791,7 @@ rebuild_config_raidset(struct lib_context *lc, struct raid_set *rs)
 		list_for_each_safe(elem, tmp, LC_RD(lc)) {
 			//list_del(elem);
 			rd = RD(elem);
-			rd->status = s_ok;
+			set_rd_status(lc, rd, s_ok);
 			if (!(rs1 = dmraid_group(lc, rd)))
 				LOG_ERR(lc, 0,
 					"failed to build the created RAID set");
@@ -1516,9 +2824,9 @@ config_raidset(struct lib_context *lc, struct raid_set *rs)
 		free_raid_set(lc, NULL);
 
 		list_for_each_safe(elem, tmp, &rs->devs) {
-			list_del(elem);
 			rd = RD(elem);
-			rd->status = s_ok;
+			unlink_raid_dev(lc, rd);
+			set_rd_status(lc, rd, s_ok);
 
 			if (!(rs1 = dmraid_group(lc, rd)))
 				LOG_ERR(lc, 0,
@@ -1628,62 +2936,85 @@ process_sets(struct lib_context *lc,
 	list_for_each_entry(rs, LC_RS(lc), list) p(lc, rs, func, arg);
 }
 
-/* Write RAID set metadata to devices. */
-int
-write_set(struct lib_context *lc, void *v)
+/*
+ * Queue RAID set metadata writes to devices.
+ *
+ * Stop at the first failure: write_set() writes all
+ * devices of a set or none, so the rest would get dropped.
+ */
+static int
+_write_set(struct lib_context *lc, struct raid_set *rs)
 {
-	int ret = 1;
-	struct raid_set *r, *rs = v;
+	struct raid_set *r;
 	struct raid_dev *rd;
 
 	/* Decend hierarchy */
 	list_for_each_entry(r, &rs->sets, list) {
-		/*
-		 * FIXME: does it make sense to try the rest of the subset
-		 *        in case we fail writing one ?
-		 */
-		if (!write_set(lc, (void *) r))
-			log_err(lc,
-				"writing RAID subset \"%s\", continuing",
-				r->name);
+		if (!_write_set(lc, r))
+			LOG_ERR(lc, 0, "writing RAID subset \"%s\" failed, "
+				"aborting write of RAID set \"%s\"",
+				r->name, rs->name);
 	}
 
 	/* Write metadata to the RAID devices of a set. */
 	list_for_each_entry(rd, &rs->devs, devs) {
-		/*
-		 * FIXME: does it make sense to try the rest of the
-		 *        devices in case we fail writing one ?
-		 */
-		if (!write_dev(lc, rd, 0)) {
-			log_err(lc,
-				"writing RAID device \"%s\", continuing",
-				rd->di->path);
-			ret = 0;
-		}
+		if (!write_dev(lc, rd, 0))
+			LOG_ERR(lc, 0, "writing RAID device \"%s\" failed, "
+				"aborting write of RAID set \"%s\"",
+				rd->di->path, rs->name);
 	}
 
-	return ret;
+	return 1;
+}
+
+/*
+ * Queue the metadata writes to all devices of a RAID set
+ * to carry them out in parallel and in a defined order.
+ * All or nothing: no device gets written unless the
+ * writes to all of them got queued.
+ */
+int
+write_set(struct lib_context *lc, void *rs)
+{
+	queue_writes(lc);
+	return _write_set(lc, rs) ? flush_writes(lc) : cancel_writes(lc);
 }
 
-/* Erase ondisk metadata. */
+/*
+ * Erase ondisk metadata.
+ *
+ * After a single confirmation for all RAID devices (unless
+ * erasing got confirmed up front), they get erased in parallel.
+ */
 int
 erase_metadata(struct lib_context *lc)
 {
 	int ret = 1;
+	unsigned int n = 0;
 	struct raid_dev *rd;
 
 	list_for_each_entry(rd, LC_RD(lc), list) {
-		if (yes_no_prompt(lc, "Do you really want to erase \"%s\" "
-				  "ondisk metadata on %s",
-				  rd->fmt->name, rd->di->path) &&
-		    !write_dev(lc, rd, 1)) {
+		log_print(lc, "%s: \"%s\" ondisk metadata",
+			  rd->di->path, rd->fmt->name);
+		n++;
+	}
+
+	if (!n ||
+	    (!OPT_ERASE_CONFIRMED(lc) &&
+	     !yes_no_prompt(lc, "Do you really want to erase the ondisk "
+			    "metadata on %u device%s", n, n > 1 ? "s" : "")))
+		return 1;
+
+	queue_writes(lc);
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (!write_dev(lc, rd, 1)) {
 			log_err(lc, "erasing ondisk metadata on %s",
 				rd->di->path);
 			ret = 0;
 		}
 	}
 
-	return ret;
+	return ret ? flush_writes(lc) : cancel_writes(lc);
 }
 
 /*
@@ -1713,6 +3044,231 @@ rd_status(struct states *s, unsigned int status, enum compare cmp)
 	return s->unified_status;
 }
 
+/*
+ * Deferred list sorting.
+ *
+ * Between defer_sorts() and flush_sorts(), list_add_deferred() appends
+ * to a list and remembers to sort it once when flush_sorts() gets called
+ * rather than walking it on each insert.  The stable merge sort results
+ * in the order inserting one by one with list_add_sorted() would have,
+ * provided the sort function orders consistently and the list
+ * isn't relied upon being sorted until it gets flushed.
+ */
+#define	SORT_INDEX_SIZE	256
+
+struct deferred_sort {
+	struct list_head list;	/* LC_SORTS in order of deferral. */
+	struct list_head chain;	/* Hash chain by list. */
+	struct list_head *to;
+	int (*f_sort) (struct list_head * pos, struct list_head * new);
+};
+
+static struct deferred_sort *
+find_deferred_sort(struct lib_context *lc, struct list_head *to)
+{
+	struct deferred_sort *ds;
+
+	if (lc->sort_index) {
+		list_for_each_entry(ds, lc->sort_index +
+				    (((unsigned long) to >> 4) &
+				     (SORT_INDEX_SIZE - 1)), chain) {
+			if (ds->to == to)
+				return ds;
+		}
+	}
+
+	return NULL;
+}
+
+/* Merge two NULL terminated chains; b holds the later entries. */
+static struct list_head *
+merge_sorted(struct list_head *a, struct list_head *b,
+	     int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	struct list_head head, *tail = &head;
+
+	while (a && b) {
+		if (f_sort(a, b)) {
+			tail->next = b;
+			b = b->next;
+		} else {
+			tail->next = a;
+			a = a->next;
+		}
+
+		tail = tail->next;
+	}
+
+	tail->next = a ? a : b;
+	return head.next;
+}
+
+/* Bottom up merge sort of a list. */
+static void
+sort_list(struct list_head *to,
+	  int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	unsigned int i;
+	struct list_head *part[32] = { NULL }, *pos, *next, *prev = to;
+
+	if (list_empty(to))
+		return;
+
+	/* part[i] holds 2^i entries added before those of part[i - 1]. */
+	to->prev->next = NULL;
+	for (pos = to->next; pos; pos = next) {
+		next = pos->next;
+		pos->next = NULL;
+		for (i = 0; i < 31 && part[i]; i++) {
+			pos = merge_sorted(part[i], pos, f_sort);
+			part[i] = NULL;
+		}
+
+		part[i] = part[i] ? merge_sorted(part[i], pos, f_sort) : pos;
+	}
+
+	for (pos = NULL, i = 0; i < 32; i++) {
+		if (part[i])
+			pos = pos ? merge_sorted(part[i], pos, f_sort) : part[i];
+	}
+
+	/* Relink backwards. */
+	for (; pos; prev = pos, pos = pos->next) {
+		prev->next = pos;
+		pos->prev = prev;
+	}
+
+	prev->next = to;
+	to->prev = prev;
+}
+
+static void
+drop_deferred_sort(struct deferred_sort *ds)
+{
+	list_del(&ds->list);
+	list_del(&ds->chain);
+	dbg_free(ds);
+}
+
+/* Sort a list now in case it has its sort deferred. */
+static void
+settle_sort(struct lib_context *lc, struct list_head *to)
+{
+	struct deferred_sort *ds;
+
+	lock_sets(lc);
+	if ((ds = find_deferred_sort(lc, to))) {
+		sort_list(to, ds->f_sort);
+		drop_deferred_sort(ds);
+	}
+
+	unlock_sets(lc);
+}
+
+/* Forget a deferred sort of a list about to be freed. */
+static void
+forget_sort(struct lib_context *lc, struct list_head *to)
+{
+	struct deferred_sort *ds;
+
+	lock_sets(lc);
+	if ((ds = find_deferred_sort(lc, to)))
+		drop_deferred_sort(ds);
+
+	unlock_sets(lc);
+}
+
+/* Start deferring sorts; calls nest. */
+void
+defer_sorts(struct lib_context *lc)
+{
+	unsigned int i;
+
+	if (lc->sort_defer++)
+		return;
+
+	/* Without the index, list_add_deferred() sorts at once. */
+	if (!(lc->sort_index =
+	      dbg_malloc(SORT_INDEX_SIZE * sizeof(*lc->sort_index)))) {
+		log_alloc_err(lc, __func__);
+		return;
+	}
+
+	for (i = 0; i < SORT_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(lc->sort_index + i);
+}
+
+/* Sort the lists deferred once the outermost defer_sorts() got matched. */
+void
+flush_sorts(struct lib_context *lc)
+{
+	struct deferred_sort *ds, *tmp;
+
+	if (--lc->sort_defer)
+		return;
+
+	list_for_each_entry_safe(ds, tmp, LC_SORTS(lc), list) {
+		sort_list(ds->to, ds->f_sort);
+		drop_deferred_sort(ds);
+	}
+
+	if (lc->sort_index) {
+		dbg_free(lc->sort_index);
+		lc->sort_index = NULL;
+	}
+}
+
+/*
+ * Defer sorting a list with f_sort, settling a sort
+ * deferred differently before.  Return 0 if it can't.
+ */
+static int
+defer_sort(struct lib_context *lc, struct list_head *to,
+	   int (*f_sort) (struct list_head * pos, struct list_head * new))
+{
+	int ret = 1;
+	struct deferred_sort *ds;
+
+	lock_sets(lc);
+	if ((ds = find_deferred_sort(lc, to)) && ds->f_sort == f_sort)
+		goto out;
+
+	if (!f_sort || !lc->sort_index ||
+	    !(ds = dbg_malloc(sizeof(*ds)))) {
+		ret = 0;
+		goto out;
+	}
+
+	settle_sort(lc, to);
+	ds->to = to;
+	ds->f_sort = f_sort;
+	list_add_tail(&ds->list, LC_SORTS(lc));
+	list_add_tail(&ds->chain, lc->sort_index +
+		      (((unsigned long) to >> 4) & (SORT_INDEX_SIZE - 1)));
+
+out:
+	unlock_sets(lc);
+	return ret;
+}
+
+/*
+ * Support function for metadata format handlers.
+ *
+ * Add an element to a list to be sorted by flush_sorts()
+ * or sort it in at once if sorts aren't deferred.
+ */
+void
+list_add_deferred(struct lib_context *lc,
+		  struct list_head *to, struct list_head *new,
+		  int (*f_sort) (struct list_head * pos,
+				 struct list_head * new))
+{
+	if (defer_sort(lc, to, f_sort))
+		list_add_tail(new, to);
+	else
+		list_add_sorted(lc, to, new, f_sort);
+}
+
 /*
  * Support function for metadata format handlers.
  *
@@ -1726,6 +3282,7 @@ list_add_sorted(struct lib_context *lc,
 {
 	struct list_head *pos;
 
+	settle_sort(lc, to);
 	list_for_each(pos, to) {
 		/*
 		 * Add in at the beginning of the list
@@ -2156,25 +3713,32 @@ lib_perform(struct lib_context *lc, enum action action,
 int
 dso_get_members(struct lib_context *lc, int arg)
 {
-	static char disks[100] = "\0";
+	size_t len = 1;
+	char *disks, *p;
 	const char *vol_name = lc->options[LC_REBUILD_SET].arg.str;
 	struct raid_set *sub_rs;
 	struct raid_dev *rd;
 
-	if ((sub_rs = find_set(lc, NULL, vol_name, FIND_ALL))) {
-		lc->options[LC_REBUILD_SET].opt = 0;
+	if (!(sub_rs = find_set(lc, NULL, vol_name, FIND_ALL)))
+		/* RAID set not found. */
+		return 1;
 
-		list_for_each_entry(rd, &sub_rs->devs, devs) {
-			strcat(disks, rd->di->path);
-			strcat(disks, " ");
-			lc->options[LC_REBUILD_SET].opt++;
-		}
+	/* Size the space separated list of member paths. */
+	list_for_each_entry(rd, &sub_rs->devs, devs)
+		len += strlen(rd->di->path) + 1;
 
-		dbg_free((char *) lc->options[LC_REBUILD_SET].arg.str);
-		lc->options[LC_REBUILD_SET].arg.str = dbg_strdup(disks);
-		return 0;
-	}
-	else
-		/* RAID set not found. */
+	if (!(p = disks = dbg_malloc(len))) {
+		log_alloc_err(lc, __func__);
 		return 1;
+	}
+
+	lc->options[LC_REBUILD_SET].opt = 0;
+	list_for_each_entry(rd, &sub_rs->devs, devs) {
+		p += sprintf(p, "%s ", rd->di->path);
+		lc->options[LC_REBUILD_SET].opt++;
+	}
+
+	dbg_free((char *) lc->options[LC_REBUILD_SET].arg.str);
+	lc->options[LC_REBUILD_SET].arg.str = disks;
+	return 0;
 }
@@ -17,7 +17,6 @@
  * See file LICENSE at the top of this source tree for license information.
  */
 #include "internal.h"
-int dso = 0;
 
 #define	add_to_log(entry, log)	\
 	list_add_tail(&(entry)->changes, &(log));
@@ -34,7 +33,7 @@ static int
 nuke_spare(struct lib_context *lc, struct raid_dev *rd)
 {
 	printf("Nuking Spare\n");
-	list_del_init(&rd->devs);
+	unlink_raid_dev(lc, rd);
 	return 0;
 }
 
@@ -186,6 +185,8 @@ add_dev_to_raid(struct lib_context *lc, struct raid_set *rs,
 					list_del(&rd->devs)
 						list_add_tail(&rd->devs,
 							      &before_rd->devs);
+					rd->owner = sub_rs;
+					invalidate_geometry(lc);
 					break;
 				}
 
@@ -224,7 +225,7 @@ add_dev_to_raid(struct lib_context *lc, struct raid_set *rs,
 
 #ifdef DMRAID_AUTOREGISTER
 	/* if call is from dmraid (not from dso) */
-	if (!dso) {
+	if (!lc->dso) {
 		int pending;
 		char lib_name[LIB_NAME_LENGTH] = { 0 };
 		struct dmraid_format *fmt = get_format(sub_rs);
@@ -340,13 +341,13 @@ add_dev_to_array(struct lib_context *lc, struct raid_set *rs,
 		rd->di = new_rd->di;
 		rd->fmt = new_rd->fmt;
 
-		rd->status = s_init;
+		set_rd_status(lc, rd, s_init);
 		rd->type = type;
 		rd->offset = 0;
 		rd->sectors = 0;
 
 		list_add_tail(&rd->list, LC_RD(lc));
-		list_add_tail(&rd->devs, &rs->devs);
+		link_raid_dev(lc, rs, rd, NULL);
 
 		/* add a spare to raid set */
 		sub_rs = find_set(lc, NULL, set_name, FIND_ALL);
@@ -358,11 +359,11 @@ add_dev_to_array(struct lib_context *lc, struct raid_set *rs,
 		rd->name = NULL;
 		rd->di = new_rd->di;
 		rd->fmt = new_rd->fmt;
-		rd->status = s_init;
+		set_rd_status(lc, rd, s_init);
 		rd->type = type;
 		rd->offset = 0;
 		rd->sectors = 0;
-		list_add_tail(&rd->devs, &sub_rs->devs);
+		link_raid_dev(lc, sub_rs, rd, NULL);
 		sub_rs->total_devs++;
 	}
 
@@ -389,15 +390,12 @@ del_dev_in_raid1(struct lib_context *lc, struct raid_set *rs,
 	entry->rs = rs;
 	entry->rd = rd;
 	add_to_log(entry, log);
-	list_del_init(&rd->devs);
+	unlink_raid_dev(lc, rd);
 	rd->type = t_spare;
 
 	/* Check that this is a sane configuration */
-	list_for_each_entry(tmp, &rs->devs, devs) {
-		ret = tmp->fmt->check(lc, rs);
-		if (ret)
-			goto err;
-	}
+	if (DEVS(rs) && (ret = RD_RS(rs)->fmt->check(lc, rs)))
+		goto err;
 
 	/* Write the metadata of the drive we're removing _first_ */
 	ret = alloc_entry(&entry, lc);
@@ -788,7 +786,7 @@ add_spare_dev_to_array(struct lib_context *lc, struct raid_set *rs)
 	rs_sub->type = t_spare;
 	rs_sub->flags = 0;
 	rs_sub->status = s_init;
-	list_add_tail(&rs_sub->list, &rs->sets);
+	link_raid_set(lc, rs_sub, &rs->sets, NULL);
 
 	/* Find disk by name. */
 	if (!(di = find_disk(lc, (char *) disk_name)))
@@ -801,14 +799,14 @@ add_spare_dev_to_array(struct lib_context *lc, struct raid_set *rs)
 	rd->name = NULL;
 	rd->di = di;
 	rd->fmt = fmt_hand;
-	rd->status = s_init;
+	set_rd_status(lc, rd, s_init);
 	rd->type = t_spare;
 	rd->offset = 0;
 	rd->sectors = 0;
 
 	/* add dev to lc list and to group rs */
 	list_add_tail(&rd->list, LC_RD(lc));
-	list_add_tail(&rd->devs, &rs->devs);
+	link_raid_dev(lc, rs, rd, NULL);
 
 	if (!(rd = alloc_raid_dev(lc, "rebuild")))
 		LOG_ERR(lc, 0, "failed to allocate space for a raid_dev");
@@ -816,11 +814,11 @@ add_spare_dev_to_array(struct lib_context *lc, struct raid_set *rs)
 	rd->name = NULL;
 	rd->di = di;
 	rd->fmt = fmt_hand;
-	rd->status = s_init;
+	set_rd_status(lc, rd, s_init);
 	rd->type = t_spare;
 	rd->offset = 0;
 	rd->sectors = 0;
-	list_add_tail(&rd->devs, &rs_sub->devs);
+	link_raid_dev(lc, rs_sub, rd, NULL);
 	return add_spare_dev_to_raid(lc, rs);
 }
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Additive checksums and CRC32 used by metadata format handlers.
+ *
+ * Data is summed in CPU byte order; handlers convert their metadata
+ * before checksumming it.  Each function sums into 4 independent
+ * accumulators so that the compiler can keep several additions in
+ * flight and vectorize the main loop.
+ */
+
+#include "internal.h"
+
+/*
+ * CRC table code to avoid linking to zlib, because Ubuntu has
+ * problems with that plus this additionally saves space.
+ */
+#include "crc32_table.h"
+
+/* Sum of n bytes. */
+uint32_t
+sum8(const void *buf, size_t n)
+{
+	const uint8_t *p = buf;
+	uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	for (; n >= 4; p += 4, n -= 4) {
+		s0 += p[0];
+		s1 += p[1];
+		s2 += p[2];
+		s3 += p[3];
+	}
+
+	while (n--)
+		s0 += *p++;
+
+	return s0 + s1 + s2 + s3;
+}
+
+/* Sum of n 16 bit words modulo 2^16. */
+uint16_t
+sum16(const void *buf, size_t n)
+{
+	const uint16_t *p = buf;
+	uint16_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	for (; n >= 4; p += 4, n -= 4) {
+		s0 += p[0];
+		s1 += p[1];
+		s2 += p[2];
+		s3 += p[3];
+	}
+
+	while (n--)
+		s0 += *p++;
+
+	return s0 + s1 + s2 + s3;
+}
+
+/* Sum of n 32 bit words modulo 2^32. */
+uint32_t
+sum32(const void *buf, size_t n)
+{
+	const uint32_t *p = buf;
+	uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	for (; n >= 4; p += 4, n -= 4) {
+		s0 += p[0];
+		s1 += p[1];
+		s2 += p[2];
+		s3 += p[3];
+	}
+
+	while (n--)
+		s0 += *p++;
+
+	return s0 + s1 + s2 + s3;
+}
+
+/* Fetch 32 bits little endian independent of alignment and CPU. */
+static inline uint32_t
+le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*
+ * Update a running CRC32 (IEEE 802.3 polynomial) with the bytes
+ * buf[0..len-1] and return its 1's complement.  The CRC should be
+ * initialized to all 1's.
+ *
+ * 8 bytes are processed per table lookup round (slice-by-8).
+ */
+uint32_t
+crc32_ieee(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		crc ^= le32(p);
+		crc = crc_table[7][crc & 0xFF] ^
+		      crc_table[6][(crc >> 8) & 0xFF] ^
+		      crc_table[5][(crc >> 16) & 0xFF] ^
+		      crc_table[4][crc >> 24] ^
+		      crc_table[3][p[4]] ^
+		      crc_table[2][p[5]] ^
+		      crc_table[1][p[6]] ^
+		      crc_table[0][p[7]];
+	}
+
+	while (len--)
+		crc = crc_table[0][(crc ^ *p++) & (CRC_TABLE_SIZE - 1)] ^
+		      (crc >> 8);
+
+	return crc ^ 0xFFFFFFFF;
+}
@@ -5,6 +5,11 @@
  * See file LICENSE at the top of this source tree for license information.
  */
 
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#ifndef __KLIBC__
+#include <pthread.h>
+#endif
 #include "internal.h"
 
 /* Create directory recusively. */
@@ -51,32 +56,41 @@ mk_dir(struct lib_context *lc, const char *dir)
 	LOG_ERR(lc, 0, "directory %s not found", dir);
 }
 
+#ifdef __KLIBC__
+#define	DMRAID_LSEEK	lseek
+#define	DMRAID_PREAD	pread
+#define	DMRAID_PWRITE	pwrite
+#else
+#define	DMRAID_LSEEK	lseek64
+#define	DMRAID_PREAD	pread64
+#define	DMRAID_PWRITE	pwrite64
+#endif
+
 static int
-rw_file(struct lib_context *lc, const char *who, int flags,
-	char *path, void *buffer, size_t size, loff_t offset)
+rwv_file(struct lib_context *lc, const char *who, int flags,
+	 char *path, struct iovec *iov, int iovcnt, loff_t offset)
 {
-	int fd, ret = 0;
+	int fd, i, ret = 0;
 	loff_t o;
+	size_t size = 0;
 	struct {
 		ssize_t(*func) ();
 		const char *what;
 	} rw_spec[] = {
-		{ read, "read"},
-		{ write, "writ"},
+		{ readv, "read"},
+		{ writev, "writ"},
 	}, *rw = rw_spec + ((flags & O_WRONLY) ? 1 : 0);
 
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
 	if ((fd = open(path, flags, lc->mode)) == -1)
 		LOG_ERR(lc, 0, "opening \"%s\"", path);
 
-#ifdef __KLIBC__
-#define	DMRAID_LSEEK	lseek
-#else
-#define	DMRAID_LSEEK	lseek64
-#endif
 	if (offset && (o = DMRAID_LSEEK(fd, offset, SEEK_SET)) == (loff_t) - 1)
 		log_err(lc, "%s: seeking device \"%s\" to %" PRIu64,
 			who, path, offset);
-	else if (rw->func(fd, buffer, size) != size)
+	else if (rw->func(fd, iov, iovcnt) != size)
 		log_err(lc, "%s: %sing %s[%s]", who, rw->what,
 			path, strerror(errno));
 	else
@@ -86,6 +100,18 @@ rw_file(struct lib_context *lc, const char *who, int flags,
 	return ret;
 }
 
+static int
+rw_file(struct lib_context *lc, const char *who, int flags,
+	char *path, void *buffer, size_t size, loff_t offset)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = size,
+	};
+
+	return rwv_file(lc, who, flags, path, &iov, 1, offset);
+}
+
 int
 read_file(struct lib_context *lc, const char *who, char *path,
 	  void *buffer, size_t size, loff_t offset)
@@ -93,11 +119,521 @@ read_file(struct lib_context *lc, const char *who, char *path,
 	return rw_file(lc, who, O_RDONLY, path, buffer, size, offset);
 }
 
-int
-write_file(struct lib_context *lc, const char *who, char *path,
-	   void *buffer, size_t size, loff_t offset)
+/*
+ * Queued metadata writes.
+ *
+ * Between queue_writes() and flush_writes(), write_file() and
+ * write_file_body() take copies of the data to write rather than
+ * writing it, so that format handlers can go on converting their
+ * metadata in place.  flush_writes() writes the bodies to all devices
+ * in parallel and syncs them before it writes the anchors the same way,
+ * so that an anchor never points to a body that didn't make it to disk.
+ * Each device is written through one descriptor, adjacent writes in one go.
+ * cancel_writes() drops the queue instead, eg. when queueing failed.
+ *
+ * erase_file() queues ranges to zero, which get read back to confirm
+ * they've been erased.
+ */
+struct queued_write {
+	struct list_head list;
+	const char *who;
+	char *path;
+	loff_t offset;
+	size_t size;
+	enum write_phase phase;
+	int zero;		/* Erase range rather than write buffer. */
+	uint8_t buffer[];
+};
+
+static int
+queue_write(struct lib_context *lc, const char *who, char *path,
+	    void *buffer, size_t size, loff_t offset, enum write_phase phase)
+{
+	struct queued_write *qw;
+
+	/* RAID devices sharing metadata write the same area repeatedly. */
+	list_for_each_entry(qw, LC_WRITES(lc), list) {
+		if (qw->offset == offset && qw->size == size &&
+		    qw->phase == phase && qw->zero == !buffer &&
+		    !strcmp(qw->path, path)) {
+			if (buffer)
+				memcpy(qw->buffer, buffer, size);
+
+			return 1;
+		}
+	}
+
+	if (!(qw = dbg_malloc(sizeof(*qw) + (buffer ? size : 0))))
+		return log_alloc_err(lc, __func__);
+
+	if (!(qw->path = dbg_strdup(path))) {
+		dbg_free(qw);
+		return log_alloc_err(lc, __func__);
+	}
+
+	qw->who = who;
+	qw->offset = offset;
+	qw->size = size;
+	qw->phase = phase;
+	if (!(qw->zero = !buffer))
+		memcpy(qw->buffer, buffer, size);
+
+	list_add_tail(&qw->list, LC_WRITES(lc));
+	return 1;
+}
+
+static int
+_write_file(struct lib_context *lc, const char *who, char *path,
+	    void *buffer, size_t size, loff_t offset, enum write_phase phase)
 {
+	if (lc->write_queue)
+		return queue_write(lc, who, path, buffer, size, offset, phase);
+
 	/* O_CREAT|O_TRUNC are noops on a devnode. */
 	return rw_file(lc, who, O_WRONLY | O_CREAT | O_TRUNC, path,
 		       buffer, size, offset);
 }
+
+int
+write_file(struct lib_context *lc, const char *who, char *path,
+	   void *buffer, size_t size, loff_t offset)
+{
+	return _write_file(lc, who, path, buffer, size, offset, WRITE_LAST);
+}
+
+/* Write data an anchor written with write_file() refers to. */
+int
+write_file_body(struct lib_context *lc, const char *who, char *path,
+		void *buffer, size_t size, loff_t offset)
+{
+	return _write_file(lc, who, path, buffer, size, offset, WRITE_FIRST);
+}
+
+/* Erase a device range, flushing it at once unless writes are queued. */
+int
+erase_file(struct lib_context *lc, const char *who, char *path,
+	   size_t size, loff_t offset, enum write_phase phase)
+{
+	if (!size)
+		return 1;
+
+	if (lc->write_queue)
+		return queue_write(lc, who, path, NULL, size, offset, phase);
+
+	queue_writes(lc);
+	return queue_write(lc, who, path, NULL, size, offset, phase) ?
+	       flush_writes(lc) : cancel_writes(lc);
+}
+
+/* Start queueing writes; calls nest. */
+void
+queue_writes(struct lib_context *lc)
+{
+	lc->write_queue++;
+}
+
+#define	WRITE_WORKERS	16
+
+/* A device to write the queued writes to. */
+struct write_job {
+	char *path;
+	int fd;		/* Kept open across phases. */
+	int ret;
+};
+
+struct write_jobs {
+	struct lib_context *lc;
+	struct write_job *job;
+	unsigned int n, next;
+	enum write_phase phase;
+#ifndef __KLIBC__
+	pthread_mutex_t lock;
+#endif
+};
+
+#ifdef __KLIBC__
+/* klibc lacks pwritev(). */
+static ssize_t
+dmraid_pwritev(int fd, const struct iovec *iov, int iovcnt, loff_t offset)
+{
+	int i;
+	ssize_t r, ret = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if ((r = pwrite(fd, iov[i].iov_base, iov[i].iov_len,
+				offset + ret)) < 0)
+			return r;
+
+		ret += r;
+		if (r != iov[i].iov_len)
+			break;
+	}
+
+	return ret;
+}
+#define	DMRAID_PWRITEV	dmraid_pwritev
+#else
+#define	DMRAID_PWRITEV	pwritev64
+#endif
+
+/* Ranges to erase get written from this unless the device zeroes them. */
+static const uint8_t zero_page[4096];
+
+/* Maximum number of vectors passed to pwritev() at once. */
+#define	WRITE_IOVS	64
+
+static int
+pwrite_iov(int fd, struct iovec *iov, unsigned int iovcnt, loff_t *offset)
+{
+	unsigned int i;
+	size_t size = 0;
+
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
+	if (DMRAID_PWRITEV(fd, iov, iovcnt, *offset) != size)
+		return 0;
+
+	*offset += size;
+	return 1;
+}
+
+/*
+ * Write a run of adjacent queued writes with as few pwritev() calls as
+ * possible.  A run of ranges to erase is zeroed by the device (eg. by
+ * WRITE SAME or unmapping) if it supports that.
+ */
+static int
+write_run(struct lib_context *lc, int fd, struct queued_write **qw,
+	  unsigned int n)
+{
+	unsigned int i, iovcnt = 0;
+	size_t len, pos;
+	loff_t offset = qw[0]->offset;
+	struct iovec iov[WRITE_IOVS];
+
+	if (qw[0]->zero) {
+		uint64_t range[2] = { offset, 0 };
+
+		for (i = 0; i < n; i++)
+			range[1] += qw[i]->size;
+
+		if (!ioctl(fd, BLKZEROOUT, range))
+			return 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		for (pos = 0; pos < qw[i]->size; pos += len) {
+			len = qw[i]->size - pos;
+			if (qw[i]->zero) {
+				len = min(len, sizeof(zero_page));
+				iov[iovcnt].iov_base = (void *) zero_page;
+			} else
+				iov[iovcnt].iov_base = qw[i]->buffer + pos;
+
+			iov[iovcnt].iov_len = len;
+			if (++iovcnt == WRITE_IOVS) {
+				if (!pwrite_iov(fd, iov, iovcnt, &offset))
+					return 0;
+
+				iovcnt = 0;
+			}
+		}
+	}
+
+	return !iovcnt || pwrite_iov(fd, iov, iovcnt, &offset);
+}
+
+/* Alignment of O_DIRECT reads, good for 512 byte and 4k blocks. */
+#define	DIRECT_ALIGN	4096
+#define	DIRECT_ALIGN_DOWN(x)	((x) & ~((loff_t) DIRECT_ALIGN - 1))
+
+/* Drop the cached pages of a synced range so that it's read from disk. */
+static void
+drop_cache(int fd, loff_t offset, size_t size)
+{
+#ifdef __KLIBC__
+	/* klibc lacks posix_fadvise(); works on block devices only. */
+	ioctl(fd, BLKFLSBUF, 0);
+#else
+	posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+/*
+ * Read an erased range back from the device rather than
+ * the page cache to confirm it's zeroed: through O_DIRECT if
+ * supported or after dropping the range from the cache else.
+ */
+static int
+zero_confirmed(struct lib_context *lc, struct write_job *job,
+	       struct queued_write *qw)
+{
+	int fd, ret = 0;
+	loff_t start = DIRECT_ALIGN_DOWN(qw->offset);
+	size_t skip = qw->offset - start, size = DIRECT_ALIGN_DOWN(
+		qw->offset + qw->size + DIRECT_ALIGN - 1) - start;
+	uint8_t *buf, *data, *p;
+
+	if (!(buf = dbg_malloc(size + DIRECT_ALIGN)))
+		return log_alloc_err(lc, __func__);
+
+	data = (uint8_t *) (((uintptr_t) buf + DIRECT_ALIGN - 1) &
+			    ~((uintptr_t) DIRECT_ALIGN - 1));
+
+	/* A short read is fine if it covers the range (ie. at EOF). */
+	if ((fd = open(job->path, O_RDONLY | O_DIRECT)) != -1) {
+		ret = DMRAID_PREAD(fd, data, size, start) >=
+		      (ssize_t) (skip + qw->size);
+		close(fd);
+	}
+
+	if (!ret) {
+		drop_cache(job->fd, start, size);
+		ret = DMRAID_PREAD(job->fd, data, size, start) >=
+		      (ssize_t) (skip + qw->size);
+	}
+
+	for (p = data + skip; ret && p < data + skip + qw->size; p++) {
+		if (*p)
+			ret = 0;
+	}
+
+	dbg_free(buf);
+	return ret;
+}
+
+/*
+ * Write and sync all queued writes of a phase to a device,
+ * coalescing adjacent ones into single pwritev() calls.
+ */
+static int
+write_device(struct lib_context *lc, struct write_job *job,
+	     enum write_phase phase)
+{
+	int ret = 1;
+	unsigned int i, j, n = 0;
+	struct queued_write *qw, **qws;
+
+	list_for_each_entry(qw, LC_WRITES(lc), list) {
+		if (qw->phase == phase && !strcmp(qw->path, job->path))
+			n++;
+	}
+
+	if (!n)
+		return 1;
+
+	if (!(qws = dbg_malloc(n * sizeof(*qws))))
+		return log_alloc_err(lc, __func__);
+
+	/* Sort by offset keeping the queue order of equal ones. */
+	n = 0;
+	list_for_each_entry(qw, LC_WRITES(lc), list) {
+		if (qw->phase != phase || strcmp(qw->path, job->path))
+			continue;
+
+		for (i = n++; i && qws[i - 1]->offset > qw->offset; i--)
+			qws[i] = qws[i - 1];
+
+		qws[i] = qw;
+	}
+
+	if (job->fd == -1 && (job->fd = open(job->path, O_RDWR)) == -1) {
+		log_err(lc, "opening \"%s\"", job->path);
+		ret = 0;
+		goto out;
+	}
+
+	for (i = 0; ret && i < n; i = j) {
+		for (j = i + 1; j < n && qws[j]->zero == qws[i]->zero &&
+		     qws[j]->offset == qws[j - 1]->offset + qws[j - 1]->size;
+		     j++);
+
+		if (!(ret = write_run(lc, job->fd, qws + i, j - i)))
+			log_err(lc, "%s: writing %s[%s]", qws[i]->who,
+				job->path, strerror(errno));
+
+		/* Report each area of the run. */
+		for (; i < j; i++)
+			log_level(lc, ret ? _PLOG_DEBUG : _PLOG_ERR,
+				  "%s: %s %s at sector %" PRIu64 ", size %zu "
+				  "bytes returned %d", qws[i]->who,
+				  qws[i]->zero ? "erasing" : "writing",
+				  job->path, (uint64_t) qws[i]->offset >> 9,
+				  qws[i]->size, ret);
+	}
+
+	if (ret && fdatasync(job->fd)) {
+		log_err(lc, "syncing %s[%s]", job->path, strerror(errno));
+		ret = 0;
+	}
+
+	for (i = 0; ret && i < n; i++) {
+		if (qws[i]->zero && !zero_confirmed(lc, job, qws[i])) {
+			log_err(lc, "%s: erasing %s at sector %" PRIu64
+				" not confirmed", qws[i]->who, job->path,
+				(uint64_t) qws[i]->offset >> 9);
+			ret = 0;
+		}
+	}
+
+      out:
+	dbg_free(qws);
+	return ret;
+}
+
+#ifndef __KLIBC__
+static void *
+write_worker(void *arg)
+{
+	unsigned int i;
+	struct write_jobs *jobs = arg;
+
+	while (1) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+
+		if (i >= jobs->n)
+			break;
+
+		jobs->job[i].ret = write_device(jobs->lc, jobs->job + i,
+						jobs->phase);
+	}
+
+	return NULL;
+}
+
+#endif
+
+/*
+ * Run the queued writes of a phase on all devices in parallel
+ * or one device after the other with klibc, which lacks pthreads.
+ */
+static int
+write_phase(struct lib_context *lc, struct write_jobs *jobs,
+	    enum write_phase phase)
+{
+	int ret = 1;
+	unsigned int i;
+#ifndef __KLIBC__
+	unsigned int workers = 0;
+	pthread_t thread[WRITE_WORKERS - 1];
+#endif
+
+	jobs->phase = phase;
+	jobs->next = 0;
+
+#ifndef __KLIBC__
+	/* The calling thread is a worker too. */
+	pthread_mutex_init(&jobs->lock, NULL);
+	while (workers + 1 < min(jobs->n, WRITE_WORKERS) &&
+	       !pthread_create(thread + workers, NULL, write_worker, jobs))
+		workers++;
+
+	write_worker(jobs);
+	while (workers--)
+		pthread_join(thread[workers], NULL);
+
+	pthread_mutex_destroy(&jobs->lock);
+#else
+	for (i = 0; i < jobs->n; i++)
+		jobs->job[i].ret = write_device(lc, jobs->job + i, phase);
+#endif
+
+	for (i = 0; i < jobs->n; i++) {
+		if (!jobs->job[i].ret)
+			ret = 0;
+	}
+
+	return ret;
+}
+
+/*
+ * Write the queued writes once the outermost queue_writes()
+ * call got matched and drop them.  The second phase is left
+ * out on all devices in case the first one failed on any.
+ */
+int
+flush_writes(struct lib_context *lc)
+{
+	int ret = 0;
+	unsigned int i, n = 0;
+	struct queued_write *qw, *tmp;
+	struct write_jobs jobs = {
+		.lc = lc,
+		.n = 0,
+	};
+
+	if (--lc->write_queue)
+		return !lc->write_cancel;
+
+	if (lc->write_cancel) {
+		log_err(lc, "dropping the queued metadata writes");
+		lc->write_cancel = 0;
+		goto out;
+	}
+
+	/* One job per device. */
+	list_for_each_entry(qw, LC_WRITES(lc), list)
+		n++;
+
+	if (n && !(jobs.job = dbg_malloc(n * sizeof(*jobs.job)))) {
+		log_alloc_err(lc, __func__);
+		goto out;
+	}
+
+	list_for_each_entry(qw, LC_WRITES(lc), list) {
+		for (i = 0; i < jobs.n; i++) {
+			if (!strcmp(jobs.job[i].path, qw->path))
+				break;
+		}
+
+		if (i == jobs.n) {
+			jobs.job[jobs.n].path = qw->path;
+			jobs.job[jobs.n++].fd = -1;
+		}
+	}
+
+	if (!(ret = write_phase(lc, &jobs, WRITE_FIRST)))
+		log_err(lc, "skipping the remaining metadata writes");
+	else
+		ret = write_phase(lc, &jobs, WRITE_LAST);
+
+	for (i = 0; i < jobs.n; i++) {
+		if (jobs.job[i].fd != -1)
+			close(jobs.job[i].fd);
+	}
+
+	if (jobs.job)
+		dbg_free(jobs.job);
+
+      out:
+	list_for_each_entry_safe(qw, tmp, LC_WRITES(lc), list) {
+		list_del(&qw->list);
+		dbg_free(qw->path);
+		dbg_free(qw);
+	}
+
+	return ret;
+}
+
+/*
+ * Drop the writes queued rather than flushing them, once the outermost
+ * queue_writes() got matched.  Always returns 0 for callers to pass on.
+ */
+int
+cancel_writes(struct lib_context *lc)
+{
+	lc->write_cancel = 1;
+	flush_writes(lc);
+	return 0;
+}
+
+/* Read a contiguous device range into a vector of buffers at once. */
+int
+read_file_vec(struct lib_context *lc, const char *who, char *path,
+	      struct iovec *iov, int iovcnt, loff_t offset)
+{
+	return rwv_file(lc, who, O_RDONLY, path, iov, iovcnt, offset);
+}
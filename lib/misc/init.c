@@ -7,17 +7,14 @@
 
 #include "internal.h"
 
-extern int dso;
-
 /* Library initialization. */
 struct lib_context *
 libdmraid_init(int argc, char **argv)
 {
 	struct lib_context *lc;
 
-	dso = (argv[0] && !strcmp(argv[0], "dso")) ? 1 : 0;
-
 	if ((lc = alloc_lib_context(argv))) {
+		lc->dso = (argv[0] && !strcmp(argv[0], "dso")) ? 1 : 0;
 		if (!register_format_handlers(lc)) {
 			libdmraid_exit(lc);
 			lc = NULL;
@@ -120,6 +120,15 @@ init_lists(struct lib_context *lc, void *arg)
 
 	while (i--)
 		INIT_LIST_HEAD(lc->lists + i);
+
+	for (i = 0; i < SET_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(lc->set_index + i);
+
+	for (i = 0; i < DISK_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(lc->disk_index + i);
+
+	for (i = 0; i < META_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(lc->meta_index + i);
 }
 
 static void
@@ -135,20 +144,20 @@ init_paths(struct lib_context *lc, void *arg)
 }
 
 /* FIXME: add lib flavour info (e.g., DEBUG). */
+#define	_STR(x)	#x
+#define	STR(x)	_STR(x)
 static void
 init_version(struct lib_context *lc, void *arg)
 {
-	static char version[80];
-
-	lc->version.text = version;
+	lc->version.text = STR(DMRAID_LIB_MAJOR_VERSION) "."
+			   STR(DMRAID_LIB_MINOR_VERSION) "."
+			   STR(DMRAID_LIB_SUBMINOR_VERSION) "."
+			   DMRAID_LIB_VERSION_SUFFIX;
 	lc->version.date = DMRAID_LIB_DATE;
 	lc->version.v.major = DMRAID_LIB_MAJOR_VERSION;
 	lc->version.v.minor = DMRAID_LIB_MINOR_VERSION;
 	lc->version.v.sub_minor = DMRAID_LIB_SUBMINOR_VERSION;
 	lc->version.v.suffix = DMRAID_LIB_VERSION_SUFFIX;
-	snprintf(version, sizeof(version), "%d.%d.%d.%s",
-		 lc->version.v.major, lc->version.v.minor,
-		 lc->version.v.sub_minor, lc->version.v.suffix);
 }
 
 /* Put init functions into an array because of the potentially growing list. */
@@ -170,6 +179,11 @@ alloc_lib_context(char **argv)
 	struct init_fn *f;
 
 	if ((lc = dbg_malloc(sizeof(*lc)))) {
+		if (!(lc->arena = alloc_arena(lc))) {
+			dbg_free(lc);
+			goto err;
+		}
+
 		for (f = init_fn; f < ARRAY_END(init_fn); f++)
 			f->func(lc, argv);
 #ifdef	DEBUG_MALLOC
@@ -180,10 +194,12 @@ alloc_lib_context(char **argv)
 		lc_inc_opt(lc, LC_DEBUG);
 #endif
 
-	} else
-		fprintf(stderr, "allocating library context\n");
+		return lc;
+	}
 
-	return lc;
+err:
+	fprintf(stderr, "allocating library context\n");
+	return NULL;
 }
 
 void
@@ -196,6 +212,7 @@ free_lib_context(struct lib_context *lc)
 			dbg_free((char *) lc->options[o].arg.str);
 	}
 
+	free_arena(lc, lc->arena);
 	dbg_free(lc);
 }
 
@@ -15,7 +15,7 @@
 int
 yes_no_prompt(struct lib_context *lc, const char *prompt, ...)
 {
-	int c = '\n';
+	int c = '\n', c2;
 	va_list ap;
 
 	/* Use getc() for klibc compatibility. */
@@ -26,10 +26,13 @@ yes_no_prompt(struct lib_context *lc, const char *prompt, ...)
 			va_end(ap);
 			log_print_nnl(lc, " ? [y/n] :");
 		}
-	} while ((c = tolower(getc(stdin))) && c != 'y' && c != 'n');
+	} while ((c = tolower(getc(stdin))) != EOF && c != 'y' && c != 'n');
 
-	/* Ignore rest. */
-	while (getc(stdin) != '\n');
+	/* Ignore rest; no answer at end of input. */
+	if (c == EOF)
+		return 0;
+
+	while ((c2 = getc(stdin)) != '\n' && c2 != EOF);
 
 	return c == 'y';
 }
@@ -283,7 +286,7 @@ led(const char *path, int status)
 #ifdef DMRAID_INTEL_LED
 	FILE *fd;
 	int sgpio = 0;
-	static char com[100];
+	char com[100];
 
 	/* Check if sgpio app is installed. */
 	if ((fd = popen("which sgpio", "r"))) {
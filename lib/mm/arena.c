@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+#ifndef __KLIBC__
+#include <pthread.h>
+#endif
+#include <stddef.h>
+#include "internal.h"
+
+/* Chunk sizes grow from ARENA_MIN to ARENA_MAX bytes. */
+#define	ARENA_MIN	(16 * 1024)
+#define	ARENA_MAX	(256 * 1024)
+#define	ARENA_ALIGN	16
+
+/* Hash chains of interned strings. */
+#define	INTERN_SIZE	1024
+
+/* Objects up to ARENA_MIN / 4 bytes freed get kept by size. */
+#define	ARENA_CLASSES	(ARENA_MIN / 4 / ARENA_ALIGN)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	char *free;		/* Next free byte. */
+	char *end;		/* End of the chunk. */
+};
+
+struct interned {
+	struct interned *next;
+	uint32_t hash;
+	unsigned int count;	/* References. */
+	char str[];
+};
+
+struct arena_free {
+	struct arena_free *next;
+};
+
+struct arena {
+#ifndef __KLIBC__
+	pthread_mutex_t lock;	/* Partition discovery allocates in threads. */
+#endif
+	struct arena_chunk *chunks;	/* Chunk allocated from first. */
+	size_t size;		/* Size of the next chunk. */
+	struct arena_free *free[ARENA_CLASSES];	/* Freed objects by size. */
+	struct interned *intern[INTERN_SIZE];
+};
+
+#define	ALIGN_UP(x)	(((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define	CHUNK_DATA(c)	((char *) (c) + ALIGN_UP(sizeof(struct arena_chunk)))
+
+#ifndef __KLIBC__
+#define	lock_arena(a)	pthread_mutex_lock(&(a)->lock)
+#define	unlock_arena(a)	pthread_mutex_unlock(&(a)->lock)
+#else
+/* klibc lacks pthreads, hence the library never allocates in threads. */
+#define	lock_arena(a)
+#define	unlock_arena(a)
+#endif
+
+/* Free list for objects of an aligned size or NULL if there's none. */
+static struct arena_free **
+free_list(struct arena *a, size_t size)
+{
+	return size && size <= ARENA_MIN / 4 ?
+	       a->free + size / ARENA_ALIGN - 1 : NULL;
+}
+
+struct arena *
+alloc_arena(struct lib_context *lc)
+{
+	struct arena *ret;
+
+	if ((ret = dbg_malloc(sizeof(*ret)))) {
+#ifndef __KLIBC__
+		pthread_mutex_init(&ret->lock, NULL);
+#endif
+		ret->size = ARENA_MIN;
+	}
+
+	return ret;
+}
+
+void
+free_arena(struct lib_context *lc, struct arena *arena)
+{
+	struct arena_chunk *c;
+
+	while ((c = arena->chunks)) {
+		arena->chunks = c->next;
+		dbg_free(c);
+	}
+
+#ifndef __KLIBC__
+	pthread_mutex_destroy(&arena->lock);
+#endif
+	dbg_free(arena);
+}
+
+static struct arena_chunk *
+alloc_chunk(struct lib_context *lc, size_t size)
+{
+	struct arena_chunk *ret;
+
+	size += ALIGN_UP(sizeof(*ret));
+	if ((ret = dbg_malloc(size))) {
+		ret->free = CHUNK_DATA(ret);
+		ret->end = (char *) ret + size;
+	}
+
+	return ret;
+}
+
+/* Carve an object out of the arena; caller holds the lock. */
+static void *
+_arena_alloc(struct lib_context *lc, struct arena *a, size_t size)
+{
+	void *ret;
+	struct arena_chunk *c;
+	struct arena_free **f;
+
+	size = ALIGN_UP(size);
+	if ((f = free_list(a, size)) && (ret = *f)) {
+		*f = (*f)->next;
+		memset(ret, 0, size);
+		return ret;
+	}
+
+	if ((c = a->chunks) && size <= (size_t) (c->end - c->free))
+		goto out;
+
+	/* Large objects get a chunk of their own behind the current one. */
+	if (size > ARENA_MIN / 4) {
+		if (!(c = alloc_chunk(lc, size)))
+			return NULL;
+
+		if (a->chunks) {
+			c->next = a->chunks->next;
+			a->chunks->next = c;
+		} else
+			a->chunks = c;
+	} else {
+		if (!(c = alloc_chunk(lc, a->size)))
+			return NULL;
+
+		c->next = a->chunks;
+		a->chunks = c;
+		if (a->size < ARENA_MAX)
+			a->size *= 2;
+	}
+
+out:
+	ret = c->free;
+	c->free += size;
+	return ret;
+}
+
+/* Allocate zeroed memory living as long as the library context. */
+void *
+arena_alloc(struct lib_context *lc, size_t size)
+{
+	void *ret;
+	struct arena *a = lc->arena;
+
+	lock_arena(a);
+	ret = _arena_alloc(lc, a, size);
+	unlock_arena(a);
+
+	return ret;
+}
+
+char *
+arena_strdup(struct lib_context *lc, const char *str)
+{
+	char *ret;
+	size_t len = strlen(str) + 1;
+
+	if ((ret = arena_alloc(lc, len)))
+		memcpy(ret, str, len);
+
+	return ret;
+}
+
+/*
+ * Release an arena object of size bytes for reuse.  Large
+ * objects, having a chunk of their own, go with the context.
+ */
+static void
+_arena_free(struct arena *a, void *ptr, size_t size)
+{
+	struct arena_free **f, *o = ptr;
+
+	if ((f = free_list(a, ALIGN_UP(size)))) {
+		o->next = *f;
+		*f = o;
+	}
+}
+
+void
+arena_free(struct lib_context *lc, void *ptr, size_t size)
+{
+	struct arena *a = lc->arena;
+
+	if (ptr) {
+		lock_arena(a);
+		_arena_free(a, ptr, size);
+		unlock_arena(a);
+	}
+}
+
+/* FNV-1a hash of a string continuing hash @h. */
+uint32_t
+hash_str(uint32_t h, const char *str)
+{
+	while (*str)
+		h = (h ^ (uint8_t) *str++) * 16777619U;
+
+	return h;
+}
+
+static struct interned *
+_find_interned(struct arena *a, const char *str, uint32_t hash)
+{
+	struct interned *i;
+
+	for (i = a->intern[hash & (INTERN_SIZE - 1)]; i; i = i->next) {
+		if (i->hash == hash && !strcmp(i->str, str))
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Interned strings.
+ *
+ * Equal strings interned in a context share one arena copy, so
+ * they compare by pointer and carry their hash (see interned_hash()).
+ * Each intern_str() takes a reference, which release_interned() drops,
+ * returning the copy to the arena with the last one.
+ */
+const char *
+intern_str(struct lib_context *lc, const char *str)
+{
+	uint32_t hash = hash_str(HASH_INIT, str);
+	size_t len = strlen(str) + 1;
+	struct arena *a = lc->arena;
+	struct interned *i;
+
+	lock_arena(a);
+	if (!(i = _find_interned(a, str, hash)) &&
+	    (i = _arena_alloc(lc, a, sizeof(*i) + len))) {
+		i->hash = hash;
+		memcpy(i->str, str, len);
+		i->next = a->intern[hash & (INTERN_SIZE - 1)];
+		a->intern[hash & (INTERN_SIZE - 1)] = i;
+	}
+
+	if (i)
+		i->count++;
+
+	unlock_arena(a);
+
+	return i ? i->str : NULL;
+}
+
+/* Drop a reference on an interned string. */
+void
+release_interned(struct lib_context *lc, const char *str)
+{
+	struct arena *a = lc->arena;
+	struct interned **p, *i = (struct interned *)
+		(str - offsetof(struct interned, str));
+
+	lock_arena(a);
+	if (!--i->count) {
+		for (p = a->intern + (i->hash & (INTERN_SIZE - 1));
+		     *p != i; p = &(*p)->next);
+
+		*p = i->next;
+		_arena_free(a, i, sizeof(*i) + strlen(str) + 1);
+	}
+
+	unlock_arena(a);
+}
+
+/* Return the interned copy of a string or NULL if there's none. */
+const char *
+find_interned(struct lib_context *lc, const char *str)
+{
+	struct arena *a = lc->arena;
+	struct interned *i;
+
+	lock_arena(a);
+	i = _find_interned(a, str, hash_str(HASH_INIT, str));
+	unlock_arena(a);
+
+	return i ? i->str : NULL;
+}
+
+/* Return the hash of an interned string. */
+uint32_t
+interned_hash(const char *str)
+{
+	return ((const struct interned *)
+		(str - offsetof(struct interned, str)))->hash;
+}
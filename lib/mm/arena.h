@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Arena holding objects living as long as the library context.
+ *
+ * Objects get carved out of large chunks and are released in one
+ * go with the context.  arena_free() keeps an object of size bytes
+ * for arena_alloc() to hand out again for one of the same size.
+ */
+struct lib_context;
+struct arena;
+
+struct arena *alloc_arena(struct lib_context *lc);
+void free_arena(struct lib_context *lc, struct arena *arena);
+void *arena_alloc(struct lib_context *lc, size_t size);
+char *arena_strdup(struct lib_context *lc, const char *str);
+void arena_free(struct lib_context *lc, void *ptr, size_t size);
+
+/* FNV-1a string hashing and interned strings. */
+#define	HASH_INIT	2166136261U
+uint32_t hash_str(uint32_t h, const char *str);
+const char *intern_str(struct lib_context *lc, const char *str);
+void release_interned(struct lib_context *lc, const char *str);
+const char *find_interned(struct lib_context *lc, const char *str);
+uint32_t interned_hash(const char *str);
+
+#endif
@@ -32,7 +32,7 @@ int add_dev_to_array(struct lib_context *lc, struct raid_set *rs,
 /*
  * Command line options.
  */
-static char const *short_opts = "a:bc::C:dDEf:ghiIlM:"
+static char const *short_opts = "a:bc::C:dDE::f:ghiIlM:"
 #ifdef	DMRAID_NATIVE_LOG
 	"n"
 #endif
@@ -47,7 +47,7 @@ static struct option long_opts[] = {
 	{"display_columns", optional_argument, NULL, 'c'},
 	{"display_group", no_argument, NULL, 'g'},
 	{"dump_metadata", no_argument, NULL, 'D'},
-	{"erase_metadata", no_argument, NULL, 'E'},
+	{"erase_metadata", optional_argument, NULL, 'E'},
 	{"format", required_argument, NULL, 'f'},
 	{"help", no_argument, NULL, 'h'},
 	{"ignorelocking", no_argument, NULL, 'i'},
@@ -128,6 +128,22 @@ check_active(struct lib_context *lc, struct actions *a)
 	return check_optarg(lc, 's', def);
 }
 
+/* Check erase option argument confirming the erase up front. */
+static int
+check_erase(struct lib_context *lc, struct actions *a)
+{
+	if (optarg) {
+		str_tolower(optarg);
+		if (!*optarg || strncmp(optarg, "yes", strlen(optarg)))
+			LOG_ERR(lc, 0, "invalid option argument for -%c",
+				a->option);
+
+		lc_inc_opt(lc, LC_ERASE_CONFIRMED);
+	}
+
+	return 1;
+}
+
 /* lc_inc_opt wrapper to allow for (struct actions) call interface. */
 static int _lc_inc_opt(struct lib_context *lc, struct actions *a)
 {
@@ -246,7 +262,7 @@ help(struct lib_context *lc, struct actions *a)
 		  "\t[-f|--format FORMAT[,FORMAT...]]\n"
 		  "\t[--separator SEPARATOR]\n" "\t[device-path...]\n", c);
 	log_print(lc, "%s\t{-r|--raid_devices} *\n"
-		  "\t{-E|--erase_metadata}\n"
+		  "\t{-E[yes]|--erase_metadata[=yes]}\n"
 		  "\t[-f|--format FORMAT[,FORMAT...]]\n"
 		  "\t[--separator SEPARATOR]\n" "\t[device-path...]\n", c);
 	log_print(lc, "%s\t{-s|--sets}...[a|i|active|inactive] *\n"
@@ -344,7 +360,7 @@ static struct actions actions[] = {
 	 RAID_DEVICES,
 	 COLUMN | DBG | FORMAT | HELP | IGNORELOCKING | SEPARATOR | VERBOSE,
 	 ARGS,
-	 NULL,
+	 check_erase,
 	 0,
 	 },
 
@@ -0,0 +1,836 @@
+/*
+ * Copyright (C) 2026  dmraid contributors. All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Library checks on loopback devices.
+ *
+ * loop_test.sh sets up the loopback devices and runs one check per
+ * call of "loop_test CHECK DEVICE...".  Each check writes the metadata
+ * it needs onto its devices, runs the library code on them and prints
+ * "PASS CHECK" or "FAIL CHECK: reason".  Exit status is != 0 on failure.
+ *
+ * Not installed; see the "check" target in Makefile.in.
+ */
+
+#include <sys/ioctl.h>
+#include "internal.h"
+#include "device/dev-io.h"
+
+#define	FORMAT_HANDLER
+#include "format/partition/gpt.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/hpt45x.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/pdc.h"
+
+#define	SECTOR	DMRAID_SECTOR_SIZE
+
+static const char *check_name;
+static int failures;
+
+/* Log a failed condition of the running check. */
+#define	CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			printf("FAIL %s: ", check_name);	\
+			printf(__VA_ARGS__);			\
+			putchar('\n');				\
+			failures++;				\
+			return 0;				\
+		}						\
+	} while (0)
+
+/* Return the size of a device in sectors. */
+static uint64_t
+dev_sectors(const char *path)
+{
+	int fd;
+	unsigned long ret = 0;
+
+	if ((fd = open(path, O_RDONLY)) != -1) {
+		if (ioctl(fd, BLKGETSIZE, &ret))
+			ret = lseek(fd, 0, SEEK_END) / SECTOR;
+
+		close(fd);
+	}
+
+	return ret;
+}
+
+/* Write size bytes of buf to path at sector. */
+static int
+put(const char *path, const void *buf, size_t size, uint64_t sector)
+{
+	int fd, ret;
+
+	if ((fd = open(path, O_WRONLY)) == -1)
+		return 0;
+
+	ret = pwrite(fd, buf, size, sector * SECTOR) == (ssize_t) size &&
+	      !fsync(fd);
+	close(fd);
+	return ret;
+}
+
+/* Return the format handler called name. */
+static struct dmraid_format *
+format(struct lib_context *lc, const char *name)
+{
+	struct format_list *fl;
+
+	list_for_each_entry(fl, LC_FMT(lc), list) {
+		if (!strcmp(fl->fmt->name, name))
+			return fl->fmt;
+	}
+
+	return NULL;
+}
+
+/* Return the top level RAID set called name. */
+static struct raid_set *
+top_set(struct lib_context *lc, const char *name)
+{
+	struct raid_set *rs;
+
+	list_for_each_entry(rs, LC_RS(lc), list) {
+		if (!strcmp(rs->name, name))
+			return rs;
+	}
+
+	return NULL;
+}
+
+/*
+ * The library only probes whole IDE and SCSI disks (and dm test devices),
+ * so hook loopback devices up the way discover_devices() would.
+ */
+static struct dev_info *
+add_disk(struct lib_context *lc, const char *path)
+{
+	struct dev_info *di;
+
+	if ((di = alloc_dev_info(lc, (char *) path))) {
+		di->sectors = dev_sectors(path);
+		if ((di->serial = dbg_strdup(strrchr(path, '/') + 1)))
+			link_dev_info(lc, di);
+		else {
+			free_dev_info(lc, di);
+			di = NULL;
+		}
+	}
+
+	return di;
+}
+
+/* Count the top level sets of format fmt and the devices in them. */
+static unsigned int
+format_sets(struct lib_context *lc, const char *fmt, unsigned int *devs)
+{
+	unsigned int ret = 0;
+	struct raid_set *rs;
+	struct raid_dev *rd;
+
+	*devs = 0;
+	list_for_each_entry(rs, LC_RS(lc), list) {
+		if (list_empty(&rs->devs) || strcmp(RD_RS(rs)->fmt->name, fmt))
+			continue;
+
+		ret++;
+		list_for_each_entry(rd, &rs->devs, devs)
+			(*devs)++;
+	}
+
+	return ret;
+}
+
+/* Count the RAID devices discovered. */
+static unsigned int
+raid_devs(struct lib_context *lc)
+{
+	unsigned int ret = 0;
+	struct list_head *pos;
+
+	list_for_each(pos, LC_RD(lc))
+		ret++;
+
+	return ret;
+}
+
+/* Size of the sets the checks below set up. */
+#define	SET_SECTORS	8192
+
+/*
+ * Write HPT45x metadata for member disk of a RAID0 or,
+ * in case of raid10, of a mirror of two RAID0 sets.
+ */
+static int
+put_hpt45x(const char *path, unsigned int disk, int raid10)
+{
+	struct hpt45x hpt;
+
+	memset(&hpt, 0, sizeof(hpt));
+	hpt.magic = HPT45X_MAGIC_OK;
+	hpt.magic_0 = 0x1111;
+	hpt.magic_1 = 0x2222;
+	hpt.total_secs = SET_SECTORS;
+	hpt.type = HPT45X_T_RAID0;
+	hpt.raid_disks = 2;
+	hpt.disk_number = disk % 2;
+	hpt.raid0_shift = 7;
+	if (raid10) {
+		hpt.raid1_type = HPT45X_T_RAID1;
+		hpt.raid1_raid_disks = 2;
+		hpt.raid1_disk_number = disk / 2;
+	}
+
+	return put(path, &hpt, sizeof(hpt), dev_sectors(path) - 11);
+}
+
+/* Write Promise RAID1 metadata for member disk of the set magic. */
+static int
+put_pdc(const char *path, uint32_t magic, unsigned int disk)
+{
+	struct pdc pdc;
+
+	memset(&pdc, 0, sizeof(pdc));
+	memcpy(pdc.promise_id, PDC_MAGIC, PDC_ID_LENGTH);
+	pdc.magic_1 = pdc.raid.magic_1 = magic;
+	pdc.raid.disk_number = disk;
+	pdc.raid.disk_secs = pdc.raid.total_secs = SET_SECTORS;
+	pdc.raid.type = PDC_T_RAID1;
+	pdc.raid.total_disks = pdc.raid.raid0_disks = 2;
+	pdc.raid.disk[0].disk_number = 0;
+	pdc.raid.disk[1].disk_number = 1;
+	pdc.checksum = sum32(&pdc, 511);
+	return put(path, &pdc, sizeof(pdc), dev_sectors(path) - 63);
+}
+
+/* Discover and group the RAID devices on the disks added. */
+static int
+discover(struct lib_context *lc, const char *formats)
+{
+	lc_inc_opt(lc, LC_FORMAT);
+	if (!lc_stralloc_opt(lc, LC_FORMAT, (char *) formats))
+		return 0;
+
+	discover_raid_devices(lc, NULL);
+	return group_set(lc, (char *[]) { NULL });
+}
+
+/*
+ * GPT partitions (gpt format handler).
+ */
+#define	GPT_ENTRIES	128
+#define	GPT_ENTRIES_SECTORS	(GPT_ENTRIES * sizeof(struct gpt_entry) / SECTOR)
+
+static const struct {
+	unsigned int idx;	/* Partition entry. */
+	uint64_t start, end;
+} gpt_parts[] = {
+	{ 0, 34, 2081 },
+	{ 2, 2082, 4129 },
+};
+
+/* Write a GPT header and its entries at lba; entries are at entries_lba. */
+static int
+put_gpt_header(const char *path, uint64_t sectors, uint64_t lba,
+	       uint64_t entries_lba, struct gpt_entry *e)
+{
+	struct gpt_header h;
+	size_t size = GPT_ENTRIES * sizeof(*e);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(&h.signature, GPT_SIGNATURE, sizeof(h.signature));
+	h.revision = 0x00010000;
+	h.header_size = GPT_HEADER_SIZE_MIN;
+	h.my_lba = lba;
+	h.alternate_lba = lba == 1 ? sectors - 1 : 1;
+	h.first_usable_lba = 2 + GPT_ENTRIES_SECTORS;
+	h.last_usable_lba = sectors - 2 - GPT_ENTRIES_SECTORS;
+	h.partition_entry_lba = entries_lba;
+	h.num_partition_entries = GPT_ENTRIES;
+	h.sizeof_partition_entry = sizeof(*e);
+	h.partition_entry_array_crc32 = crc32_ieee(0xFFFFFFFF, e, size);
+	h.header_crc32 = crc32_ieee(0xFFFFFFFF, &h, h.header_size);
+
+	return put(path, e, size, entries_lba) &&
+	       put(path, &h, sizeof(h), lba);
+}
+
+/* Check partition sets created for the partitions in gpt_parts[]. */
+static int
+gpt_sets_ok(struct lib_context *lc, const char *path)
+{
+	unsigned int i, n = 0;
+	char name[64];
+	const char *base = strrchr(path, '/') + 1;
+	struct raid_set *rs;
+	struct raid_dev *rd;
+
+	list_for_each_entry(rs, LC_RS(lc), list)
+		n++;
+
+	CHECK(n == ARRAY_SIZE(gpt_parts), "%u partition sets instead of %zu",
+	      n, ARRAY_SIZE(gpt_parts));
+
+	for (i = 0; i < ARRAY_SIZE(gpt_parts); i++) {
+		snprintf(name, sizeof(name), "%s%s%u", base,
+			 isdigit(base[strlen(base) - 1]) ?
+			 OPT_STR_PARTCHAR(lc) : "", gpt_parts[i].idx + 1);
+		CHECK((rs = top_set(lc, name)), "no partition set %s", name);
+		rd = list_entry(rs->devs.next, struct raid_dev, devs);
+		CHECK(rd->offset == gpt_parts[i].start &&
+		      rd->sectors == gpt_parts[i].end - gpt_parts[i].start + 1,
+		      "%s maps %" PRIu64 "+%" PRIu64, name, rd->offset,
+		      rd->sectors);
+	}
+
+	return 1;
+}
+
+/* Read and group the GPT on di; return 0 if there's none. */
+static int
+gpt_read_group(struct lib_context *lc, struct dev_info *di)
+{
+	struct dmraid_format *fmt = format(lc, "gpt");
+	struct raid_dev *rd;
+
+	if (!(rd = fmt->read(lc, di)))
+		return 0;
+
+	rd->fmt = fmt;
+	fmt->group(lc, rd);
+	free_raid_dev(lc, &rd);
+	return 1;
+}
+
+static int
+check_gpt(struct lib_context *lc, char **dev)
+{
+	uint8_t mbr[SECTOR], bad = 0xff;
+	uint64_t sectors = dev_sectors(*dev);
+	struct gpt_entry *e;
+	struct gpt_mbr_partition *p = (void *) (mbr + 446);
+	struct dev_info *di;
+	unsigned int i;
+
+	CHECK((e = dbg_malloc(GPT_ENTRIES * sizeof(*e))), "allocation");
+	for (i = 0; i < ARRAY_SIZE(gpt_parts); i++) {
+		memset(e[gpt_parts[i].idx].partition_type_guid, i + 1, 16);
+		e[gpt_parts[i].idx].starting_lba = gpt_parts[i].start;
+		e[gpt_parts[i].idx].ending_lba = gpt_parts[i].end;
+	}
+
+	/* Protective MBR, primary and backup headers. */
+	memset(mbr, 0, sizeof(mbr));
+	p->type = GPT_MBR_TYPE;
+	p->start = 1;
+	p->length = sectors - 1;
+	mbr[510] = 0x55;
+	mbr[511] = 0xAA;
+	CHECK(put(*dev, mbr, sizeof(mbr), 0) &&
+	      put_gpt_header(*dev, sectors, 1, 2, e) &&
+	      put_gpt_header(*dev, sectors, sectors - 1,
+			     sectors - 1 - GPT_ENTRIES_SECTORS, e),
+	      "writing GPT to %s", *dev);
+	dbg_free(e);
+
+	CHECK((di = alloc_dev_info(lc, *dev)), "allocation");
+	di->sectors = sectors;
+
+	/* Primary table. */
+	CHECK(gpt_read_group(lc, di), "primary GPT not found");
+	if (!gpt_sets_ok(lc, *dev))
+		return 0;
+
+	free_raid_set(lc, NULL);
+
+	/* Backup table with the primary header corrupted. */
+	CHECK(put(*dev, &bad, 1, 1), "corrupting primary GPT header");
+	CHECK(gpt_read_group(lc, di), "backup GPT not found");
+	if (!gpt_sets_ok(lc, *dev))
+		return 0;
+
+	free_raid_set(lc, NULL);
+
+	/* Neither header valid. */
+	CHECK(put(*dev, &bad, 1, sectors - 1), "corrupting backup GPT header");
+	CHECK(!gpt_read_group(lc, di), "corrupted GPT accepted");
+	free_dev_info(lc, di);
+	return 1;
+}
+
+/*
+ * Rescan dropping and adding back disks (libdmraid_rescan_device()).
+ *
+ * Disks A and B carry a HPT45x RAID0, disks B and C a Promise RAID1,
+ * so dropping either set has to drop the other one too because of B.
+ */
+/*
+ * Check the devices in the HPT45x and Promise sets (0 = no set)
+ * and the number of RAID devices discovered.
+ */
+static int
+rescan_sets_ok(struct lib_context *lc, const char *what,
+	       unsigned int hpt_devs, unsigned int pdc_devs, unsigned int rds)
+{
+	unsigned int sets, devs;
+
+	sets = format_sets(lc, "hpt45x", &devs);
+	CHECK(sets == !!hpt_devs && devs == hpt_devs, "%s: %u HPT45x set(s) "
+	      "with %u device(s) instead of %u", what, sets, devs, hpt_devs);
+	sets = format_sets(lc, "pdc", &devs);
+	CHECK(sets == !!pdc_devs && devs == pdc_devs, "%s: %u Promise set(s) "
+	      "with %u device(s) instead of %u", what, sets, devs, pdc_devs);
+	CHECK((devs = raid_devs(lc)) == rds,
+	      "%s: %u RAID devices instead of %u", what, devs, rds);
+	return 1;
+}
+
+/*
+ * Add disk path back.  Loopback devices aren't probed by the
+ * library, so mark it for the rescan of a name it doesn't know
+ * to read and group it together with the devices it probed.
+ */
+static int
+rescan_add(struct lib_context *lc, const char *path)
+{
+	struct dev_info *di;
+
+	if (!(di = add_disk(lc, path)))
+		return 0;
+
+	di->wanted = 1;
+	return libdmraid_rescan_device(lc, "/dev/loop_test_none", 0);
+}
+
+static int
+check_rescan(struct lib_context *lc, char **dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3; i++) {
+		CHECK((i == 2 || put_hpt45x(dev[i], i, 0)) &&
+		      (!i || put_pdc(dev[i], 0x3333, i - 1)),
+		      "writing metadata to %s", dev[i]);
+		CHECK(add_disk(lc, dev[i]), "allocation");
+	}
+
+	CHECK(discover(lc, "hpt45x,pdc"), "grouping");
+	if (!rescan_sets_ok(lc, "discovery", 2, 2, 4))
+		return 0;
+
+	/*
+	 * Drop A and C in turn and add them back.  Without A, the
+	 * HPT45x RAID0 gets removed, without C, the Promise RAID1 is
+	 * left degraded.
+	 */
+	for (i = 0; i < 3; i += 2) {
+		CHECK(libdmraid_rescan_device(lc, dev[i], 0),
+		      "rescanning %s", dev[i]);
+		if (!rescan_sets_ok(lc, dev[i], i ? 2 : 0, i ? 1 : 2, 3))
+			return 0;
+
+		CHECK(rescan_add(lc, dev[i]), "rescanning %s", dev[i]);
+		if (!rescan_sets_ok(lc, dev[i], 2, 2, 4))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Order of sets grouped in parallel (group_raid_devs_parallel()).
+ *
+ * The disks carry Promise RAID1 sets on disks 0 and 5 and on disks 2
+ * and 3 and a HPT45x RAID0 on disks 1 and 4.  The sets grouped per
+ * format by the workers have to end up in the order grouping the RAID
+ * devices one after the other adds them, either way round the disks
+ * get discovered: a Promise set, the HPT45x set, a Promise set.
+ */
+static int
+check_order(struct lib_context *lc, char **dev)
+{
+	unsigned int i, n = 0;
+	struct raid_dev *rd;
+	struct raid_set *rs, *sets[3];
+	struct list_head *pos;
+
+	for (i = 0; i < 6; i++) {
+		CHECK(i == 1 || i == 4 ? put_hpt45x(dev[i], i > 1, 0) :
+		      put_pdc(dev[i], i == 2 || i == 3 ? 0x4444 : 0x3333,
+			      i > 2), "writing metadata to %s", dev[i]);
+		CHECK(add_disk(lc, dev[i]), "allocation");
+	}
+
+	CHECK(discover(lc, "hpt45x,pdc"), "grouping");
+
+	/* Top level sets in order of their first RAID device. */
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		CHECK(rd->owner, "%s not grouped", rd->di->path);
+		for (rs = rd->owner; rs->parent; rs = rs->parent);
+		for (i = 0; i < n && sets[i] != rs; i++);
+		if (i == n) {
+			CHECK(n < ARRAY_SIZE(sets), "more than %zu sets",
+			      ARRAY_SIZE(sets));
+			sets[n++] = rs;
+		}
+	}
+
+	i = 0;
+	list_for_each(pos, LC_RS(lc)) {
+		CHECK(i < n && pos == &sets[i]->list,
+		      "set %u is %s instead of %s", i, RS(pos)->name,
+		      i < n ? sets[i]->name : "none");
+		i++;
+	}
+
+	CHECK(i == n, "%u sets instead of %u", i, n);
+	return 1;
+}
+
+/*
+ * Status counters of set members (set_rd_status()).
+ *
+ * Disks 0 to 3 carry a HPT45x RAID10, disks 0 and 1 a Promise RAID1.
+ * Change device states and check the counters of the sets changed
+ * incrementally against counting the members of all sets.
+ */
+static int
+members_ok(struct lib_context *lc, struct list_head *sets)
+{
+	struct set_members m;
+	struct raid_set *rs, *r;
+	struct raid_dev *rd;
+
+	list_for_each_entry(rs, sets, list) {
+		if (!members_ok(lc, &rs->sets))
+			return 0;
+
+		/* Sets never changed yet haven't been counted. */
+		if (!rs->members.total)
+			continue;
+
+		memset(&m, 0, sizeof(m));
+		list_for_each_entry(r, &rs->sets, list) {
+			m.total++;
+			if (S_OK(r->status) || S_INCONSISTENT(r->status))
+				m.operational++;
+		}
+
+		list_for_each_entry(rd, &rs->devs, devs) {
+			m.total++;
+			if (S_OK(rd->status))
+				m.operational++;
+			else if (S_INCONSISTENT(rd->status))
+				m.inconsistent++;
+			else if (S_NOSYNC(rd->status))
+				m.nosync++;
+		}
+
+		CHECK(m.total == rs->members.total &&
+		      m.operational == rs->members.operational &&
+		      m.inconsistent == rs->members.inconsistent &&
+		      m.nosync == rs->members.nosync,
+		      "%s counts %u/%u/%u/%u instead of %u/%u/%u/%u "
+		      "(total/operational/inconsistent/nosync)", rs->name,
+		      rs->members.total, rs->members.operational,
+		      rs->members.inconsistent, rs->members.nosync,
+		      m.total, m.operational, m.inconsistent, m.nosync);
+	}
+
+	return 1;
+}
+
+/* Return the RAID device of format fmt on disk path. */
+static struct raid_dev *
+disk_rd(struct lib_context *lc, const char *path, const char *fmt)
+{
+	struct raid_dev *rd;
+
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (!strcmp(rd->di->path, path) && !strcmp(rd->fmt->name, fmt))
+			return rd;
+	}
+
+	return NULL;
+}
+
+static int
+check_status(struct lib_context *lc, char **dev)
+{
+	unsigned int i;
+	struct raid_dev *rd;
+	struct raid_set *rs;
+	static const struct {
+		unsigned int disk;
+		const char *fmt;
+		enum status status;
+		enum status set_status;	/* Of the top level set. */
+	} steps[] = {
+		{ 0, "pdc", s_broken, s_inconsistent },
+		{ 1, "pdc", s_nosync, s_nosync },
+		{ 0, "pdc", s_inconsistent, s_inconsistent },
+		{ 0, "pdc", s_ok, s_inconsistent },
+		{ 1, "pdc", s_ok, s_ok },
+		{ 0, "hpt45x", s_broken, s_ok },
+		{ 1, "hpt45x", s_broken, s_ok },
+		{ 2, "hpt45x", s_inconsistent, s_ok },
+		{ 0, "hpt45x", s_ok, s_ok },
+		{ 1, "hpt45x", s_ok, s_ok },
+		{ 2, "hpt45x", s_ok, s_ok },
+	};
+
+	for (i = 0; i < 4; i++) {
+		CHECK(put_hpt45x(dev[i], i, 1) &&
+		      (i > 1 || put_pdc(dev[i], 0x3333, i)),
+		      "writing metadata to %s", dev[i]);
+		CHECK(add_disk(lc, dev[i]), "allocation");
+	}
+
+	CHECK(discover(lc, "hpt45x,pdc"), "grouping");
+
+	for (i = 0; i < ARRAY_SIZE(steps); i++) {
+		CHECK((rd = disk_rd(lc, dev[steps[i].disk], steps[i].fmt)) &&
+		      rd->owner, "no %s set on %s", steps[i].fmt,
+		      dev[steps[i].disk]);
+
+		/* Counters have to follow changes of the hierarchy too. */
+		if (i == ARRAY_SIZE(steps) / 2) {
+			rs = rd->owner;
+			unlink_raid_dev(lc, rd);
+			link_raid_dev(lc, rs, rd, NULL);
+		}
+
+		set_rd_status(lc, rd, steps[i].status);
+		for (rs = rd->owner; rs->parent; rs = rs->parent);
+		CHECK(rs->status == steps[i].set_status,
+		      "step %u: %s status %s instead of %s", i, rs->name,
+		      get_status(lc, rs->status),
+		      get_status(lc, steps[i].set_status));
+		if (!members_ok(lc, LC_RS(lc)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Erasing confirmed by reading back from disk (erase_file()).
+ *
+ * Erase ranges not aligned to the O_DIRECT block size on the device
+ * and, as O_DIRECT may not be supported on it, on a regular file of a
+ * size which isn't either, and check that only those got zeroed.
+ */
+#define	ERASE_SECTORS	128
+
+static const struct {
+	uint64_t sector;	/* From the end if ~0. */
+	size_t sectors;
+} erase_ranges[] = {
+	{ 3, 5 },
+	{ 9, 16 },
+	{ ~0, 3 },
+};
+
+static int
+erase_ok(struct lib_context *lc, char *path, uint64_t sectors)
+{
+	int fd;
+	unsigned int i;
+	uint64_t sector;
+	uint8_t buf[ERASE_SECTORS * SECTOR], zero[sizeof(buf)];
+
+	memset(buf, 0xff, sizeof(buf));
+	CHECK(put(path, buf, sizeof(buf), 0) &&
+	      put(path, buf, 3 * SECTOR, sectors - 3), "writing %s", path);
+
+	for (i = 0; i < ARRAY_SIZE(erase_ranges); i++) {
+		sector = erase_ranges[i].sector == ~0 ?
+			 sectors - erase_ranges[i].sectors :
+			 erase_ranges[i].sector;
+		CHECK(erase_file(lc, check_name, path,
+				 erase_ranges[i].sectors * SECTOR,
+				 sector * SECTOR, WRITE_LAST),
+		      "erasing %s at sector %" PRIu64, path, sector);
+	}
+
+	/* The sectors in between mustn't have been touched. */
+	CHECK((fd = open(path, O_RDONLY)) != -1, "opening %s", path);
+	i = pread(fd, buf, sizeof(buf), 0) == sizeof(buf) &&
+	    pread(fd, zero, 3 * SECTOR, (sectors - 3) * SECTOR) ==
+	    3 * SECTOR;
+	close(fd);
+	CHECK(i, "reading %s", path);
+
+	for (sector = 0; sector < ERASE_SECTORS; sector++) {
+		i = (sector >= 3 && sector < 8) ||
+		    (sector >= 9 && sector < 25);
+		CHECK(buf[sector * SECTOR] == (i ? 0 : 0xff) &&
+		      buf[sector * SECTOR + SECTOR - 1] == (i ? 0 : 0xff),
+		      "%s sector %" PRIu64 " %serased", path, sector,
+		      i ? "not " : "");
+	}
+
+	for (i = 0; i < 3 * SECTOR; i++)
+		CHECK(!zero[i], "%s end not erased", path);
+
+	return 1;
+}
+
+static int
+check_erase(struct lib_context *lc, char **dev)
+{
+	int fd, ret;
+	char path[] = "/tmp/loop_test.XXXXXX";
+
+	if (!erase_ok(lc, *dev, dev_sectors(*dev)))
+		return 0;
+
+	CHECK((fd = mkstemp(path)) != -1, "creating %s", path);
+	close(fd);
+	ret = erase_ok(lc, path, ERASE_SECTORS + 3);
+	unlink(path);
+	return ret;
+}
+
+/*
+ * CRC32 (crc32_ieee()) against a bitwise reference for
+ * all lengths up to CRC_BYTES at each alignment, chained
+ * and for the check value of the IEEE 802.3 polynomial.
+ */
+#define	CRC_BYTES	300
+
+static uint32_t
+crc32_bitwise(uint32_t crc, const uint8_t *p, size_t len)
+{
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+	}
+
+	return crc ^ 0xFFFFFFFF;
+}
+
+static int
+check_crc32(struct lib_context *lc, char **dev)
+{
+	unsigned int i, off;
+	uint32_t crc;
+	uint8_t buf[CRC_BYTES + 8];
+
+	CHECK(crc32_ieee(0xFFFFFFFF, "123456789", 9) == 0xCBF43926,
+	      "check value 0x%x", crc32_ieee(0xFFFFFFFF, "123456789", 9));
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 131 + (i >> 3);
+
+	for (off = 0; off < 8; off++) {
+		for (i = 0; i <= CRC_BYTES; i++) {
+			crc = crc32_bitwise(0xFFFFFFFF, buf + off, i);
+			CHECK(crc32_ieee(0xFFFFFFFF, buf + off, i) == crc,
+			      "%u bytes at offset %u", i, off);
+			CHECK(crc32_ieee(crc32_ieee(0xFFFFFFFF, buf + off,
+						    i / 3) ^ 0xFFFFFFFF,
+					 buf + off + i / 3, i - i / 3) == crc,
+			      "%u bytes at offset %u chained", i, off);
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Additive checksums (sum8(), sum16() and sum32()) against
+ * plain loops for all lengths up to SUM_WORDS, so that each
+ * remainder of the unrolled loops is covered, with words
+ * large enough for the sums to wrap.
+ */
+#define	SUM_WORDS	67
+
+static int
+check_sums(struct lib_context *lc, char **dev)
+{
+	unsigned int i, n;
+	uint16_t s16;
+	uint32_t s32;
+	union {
+		uint8_t u8[SUM_WORDS * 4];
+		uint16_t u16[SUM_WORDS * 2];
+		uint32_t u32[SUM_WORDS];
+	} buf;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf.u8[i] = 0xff - i;
+
+	for (n = 0; n <= SUM_WORDS; n++) {
+		for (i = s32 = 0; i < n; i++)
+			s32 += buf.u8[i];
+
+		CHECK(sum8(buf.u8, n) == s32, "sum8 of %u bytes", n);
+
+		for (i = s16 = 0; i < n; i++)
+			s16 += buf.u16[i];
+
+		CHECK(sum16(buf.u16, n) == s16, "sum16 of %u words", n);
+
+		for (i = s32 = 0; i < n; i++)
+			s32 += buf.u32[i];
+
+		CHECK(sum32(buf.u32, n) == s32, "sum32 of %u words", n);
+	}
+
+	return 1;
+}
+
+static struct check {
+	const char *name;
+	unsigned int devs;	/* Number of devices needed. */
+	int (*f) (struct lib_context * lc, char **dev);
+} checks[] = {
+	{ "gpt", 1, check_gpt },
+	{ "rescan", 3, check_rescan },
+	{ "order", 6, check_order },
+	{ "status", 4, check_status },
+	{ "erase", 1, check_erase },
+	{ "crc32", 0, check_crc32 },
+	{ "sums", 0, check_sums },
+};
+
+int
+main(int argc, char **argv)
+{
+	struct check *c;
+	struct lib_context *lc;
+	char *av[] = { argv[0], NULL };
+
+	for (c = checks; argc > 1 && c < ARRAY_END(checks); c++) {
+		if (!strcmp(argv[1], c->name))
+			break;
+	}
+
+	if (argc < 2 || c == ARRAY_END(checks) || argc - 2 < c->devs) {
+		fprintf(stderr, "usage: %s CHECK DEVICE...\nchecks:", *argv);
+		for (c = checks; c < ARRAY_END(checks); c++)
+			fprintf(stderr, " %s(%u)", c->name, c->devs);
+
+		fputc('\n', stderr);
+		return 2;
+	}
+
+	if (!(lc = libdmraid_init(1, av)))
+		return 1;
+
+	check_name = c->name;
+	if (c->f(lc, argv + 2))
+		printf("PASS %s\n", c->name);
+
+	libdmraid_exit(lc);
+	return !!failures;
+}
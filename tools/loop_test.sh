@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Copyright (C) 2026  dmraid contributors. All rights reserved.
+#
+# See file LICENSE at the top of this source tree for license information.
+#
+
+#
+# Run the loop_test library checks on loopback devices.
+#
+# Usage: loop_test.sh [LOOP_TEST [CHECK...]]
+#
+# Every check gets fresh sparse images attached to loopback devices,
+# which get detached again when it's done.  Needs root and losetup.
+#
+
+LOOP_TEST=${1:-./loop_test}
+[ $# -gt 0 ] && shift
+
+# Image size in 512 byte sectors.
+SECTORS=16384
+
+TMP=`mktemp -d ${TMPDIR:-/tmp}/dmraid_loop.XXXXXX` || exit 1
+LOOPS=
+
+cleanup() {
+	for l in $LOOPS; do
+		losetup -d $l
+	done
+
+	LOOPS=
+	rm -f $TMP/*.img
+}
+
+trap 'cleanup; rmdir $TMP' EXIT
+trap 'exit 1' HUP INT TERM
+
+# Attach $1 fresh images and add the loopback devices to $LOOPS.
+attach() {
+	i=0
+	while [ $i -lt $1 ]; do
+		dd if=/dev/zero of=$TMP/$i.img bs=512 count=0 seek=$SECTORS \
+		   2>/dev/null || return 1
+		l=`losetup -f --show $TMP/$i.img` || return 1
+		LOOPS="$LOOPS $l"
+		i=`expr $i + 1`
+	done
+}
+
+# Checks and the number of devices they need.
+CHECKS=`$LOOP_TEST 2>&1 | sed -n 's/^checks://p'`
+if [ -z "$CHECKS" ]; then
+	echo "$0: can't run $LOOP_TEST" >&2
+	exit 1
+fi
+
+[ $# -eq 0 ] && set -- `echo $CHECKS | sed 's/([0-9]*)//g'`
+
+ret=0
+for check in "$@"; do
+	devs=`echo " $CHECKS" | sed -n "s/.* $check(\([0-9]*\)).*/\1/p"`
+	if [ -z "$devs" ]; then
+		echo "FAIL $check: unknown check"
+		ret=1
+		continue
+	fi
+
+	if attach $devs; then
+		$LOOP_TEST $check $LOOPS || ret=1
+	else
+		echo "FAIL $check: can't attach $devs loopback device(s)"
+		ret=1
+	fi
+
+	cleanup
+done
+
+exit $ret